@@ -0,0 +1,227 @@
+// Throughput and accuracy of grn::fastmath against libm.
+//
+//   grn_fastmath_bench [elements]
+//
+// Times each function over an array that stays in L1 and reports
+// nanoseconds per element (best of several runs) and the maximum error
+// against double-precision libm over the same inputs.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <grn/fastmath.h>
+#include <grn/matrix.h>
+
+namespace
+{
+    volatile float sink;
+
+    template <typename Fn>
+    double nanosecondsPerElement(size_t count, Fn fn)
+    {
+        using Clock = std::chrono::steady_clock;
+        const int repeats = 200;
+        double best = 1e30;
+        for (int run = 0; run < 5; ++run)
+        {
+            const Clock::time_point start = Clock::now();
+            for (int i = 0; i < repeats; ++i)
+                fn();
+            best = std::min(best, std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+        }
+        return best / (double(repeats) * double(count));
+    }
+
+    void report(const char *name, double libm, double scalar, double sse, double avx, double error, const char *errorKind)
+    {
+        std::printf("%-8s %8.2f %8.2f %8.2f ", name, libm, scalar, sse);
+        if (avx > 0.0)
+            std::printf("%8.2f", avx);
+        else
+            std::printf("%8s", "-");
+        std::printf("   %.2e %s\n", error, errorKind);
+    }
+
+    // Runs `vector` over the inputs a float4 (or float8) at a time
+    template <typename V, typename Fn>
+    void forEachVector(const std::vector<float> &in, std::vector<float> &out, Fn fn)
+    {
+        using T = grn::simd::vector_traits<V>;
+        for (size_t i = 0; i + T::width <= in.size(); i += T::width)
+            grn::simd::store(out.data() + i, fn(T::load(in.data() + i)));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    using namespace grn;
+    const size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) & ~size_t(7) : 2048;
+    if (count == 0)
+    {
+        std::fprintf(stderr, "usage: %s [elements]\n", argv[0]);
+        return 1;
+    }
+
+    std::mt19937 rng(1);
+    std::vector<float> angles(count), positive(count), unit(count), ys(count), xs(count);
+    std::vector<float> out(count), out2(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        angles[i] = std::uniform_real_distribution<float>(-10.0f, 10.0f)(rng);
+        positive[i] = std::uniform_real_distribution<float>(1e-3f, 1e3f)(rng);
+        unit[i] = std::uniform_real_distribution<float>(-1.0f, 1.0f)(rng);
+        ys[i] = std::uniform_real_distribution<float>(-100.0f, 100.0f)(rng);
+        xs[i] = std::uniform_real_distribution<float>(-100.0f, 100.0f)(rng);
+    }
+
+#if defined(GRN_SIMD_AVX)
+    const bool haveAvx = true;
+#else
+    const bool haveAvx = false;
+#endif
+
+    std::printf("%zu elements, ns per element\n", count);
+    std::printf("%-8s %8s %8s %8s %8s   %s\n", "", "libm", "scalar", "float4", "float8", "max error");
+
+    // sincos
+    {
+        auto libm = [&]
+        {
+            for (size_t i = 0; i < count; ++i)
+                out[i] = std::sin(angles[i]), out2[i] = std::cos(angles[i]);
+            sink = out[count / 2] + out2[count / 2];
+        };
+        auto scalar = [&]
+        {
+            for (size_t i = 0; i < count; ++i)
+                fastmath::sincos(angles[i], out[i], out2[i]);
+            sink = out[count / 2] + out2[count / 2];
+        };
+        auto vector = [&](auto width)
+        {
+            using V = decltype(width);
+            forEachVector<V>(angles, out, [](V x)
+                             { V s, c; fastmath::sincos(x, s, c); return s + c; });
+            sink = out[count / 2];
+        };
+        double error = 0.0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            float s, c;
+            fastmath::sincos(angles[i], s, c);
+            error = std::max({error, std::fabs(s - std::sin(double(angles[i]))), std::fabs(c - std::cos(double(angles[i])))});
+        }
+        double avx = 0.0;
+#if defined(GRN_SIMD_AVX)
+        avx = nanosecondsPerElement(count, [&]
+                                    { vector(simd::float8()); });
+#endif
+        report("sincos", nanosecondsPerElement(count, libm), nanosecondsPerElement(count, scalar),
+               nanosecondsPerElement(count, [&]
+                                     { vector(simd::float4()); }),
+               avx, error, "absolute");
+    }
+
+    // Unary functions: rsqrt and acos
+    auto unary = [&](const char *name, const std::vector<float> &in, auto libmFn, auto fastFn, auto exact, bool relative)
+    {
+        auto libm = [&]
+        {
+            for (size_t i = 0; i < count; ++i)
+                out[i] = libmFn(in[i]);
+            sink = out[count / 2];
+        };
+        auto scalar = [&]
+        {
+            for (size_t i = 0; i < count; ++i)
+                out[i] = fastFn(in[i]);
+            sink = out[count / 2];
+        };
+        double error = 0.0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const double expected = exact(double(in[i]));
+            const double difference = std::fabs(fastFn(in[i]) - expected);
+            error = std::max(error, relative ? difference / std::fabs(expected) : difference);
+        }
+        double avx = 0.0;
+#if defined(GRN_SIMD_AVX)
+        avx = nanosecondsPerElement(count, [&]
+                                    { forEachVector<simd::float8>(in, out, fastFn); sink = out[count / 2]; });
+#endif
+        report(name, nanosecondsPerElement(count, libm), nanosecondsPerElement(count, scalar),
+               nanosecondsPerElement(count, [&]
+                                     { forEachVector<simd::float4>(in, out, fastFn); sink = out[count / 2]; }),
+               avx, error, relative ? "relative" : "absolute");
+    };
+    unary("rsqrt", positive, [](float x)
+          { return 1.0f / std::sqrt(x); }, [](auto x)
+          { return fastmath::rsqrt(x); }, [](double x)
+          { return 1.0 / std::sqrt(x); }, true);
+    unary("acos", unit, [](float x)
+          { return std::acos(x); }, [](auto x)
+          { return fastmath::acos(x); }, [](double x)
+          { return std::acos(x); }, false);
+
+    // atan2
+    {
+        auto libm = [&]
+        {
+            for (size_t i = 0; i < count; ++i)
+                out[i] = std::atan2(ys[i], xs[i]);
+            sink = out[count / 2];
+        };
+        auto scalar = [&]
+        {
+            for (size_t i = 0; i < count; ++i)
+                out[i] = fastmath::atan2(ys[i], xs[i]);
+            sink = out[count / 2];
+        };
+        auto vector = [&](auto width)
+        {
+            using V = decltype(width);
+            using T = simd::vector_traits<V>;
+            for (size_t i = 0; i + T::width <= count; i += T::width)
+                simd::store(out.data() + i, fastmath::atan2(T::load(ys.data() + i), T::load(xs.data() + i)));
+            sink = out[count / 2];
+        };
+        double error = 0.0;
+        for (size_t i = 0; i < count; ++i)
+            error = std::max(error, std::fabs(fastmath::atan2(ys[i], xs[i]) - std::atan2(double(ys[i]), double(xs[i]))));
+        double avx = 0.0;
+#if defined(GRN_SIMD_AVX)
+        avx = nanosecondsPerElement(count, [&]
+                                    { vector(simd::float8()); });
+#endif
+        report("atan2", nanosecondsPerElement(count, libm), nanosecondsPerElement(count, scalar),
+               nanosecondsPerElement(count, [&]
+                                     { vector(simd::float4()); }),
+               avx, error, "absolute");
+    }
+
+    // The per-object hot path that motivated the module
+    {
+        std::vector<Matrix> models(count);
+        auto build = [&](auto policy)
+        {
+            using Math = decltype(policy);
+            for (size_t i = 0; i < count; ++i)
+            {
+                const Vector rotation(angles[i], angles[count - 1 - i], unit[i]);
+                models[i] = Matrix::getModelMatrix<Math>(Vector(xs[i], ys[i], unit[i]), rotation, Vector(1.0f, 1.0f, 1.0f));
+            }
+            sink = models[count / 2][5];
+        };
+        const double libm = nanosecondsPerElement(count, [&]
+                                                  { build(StdMath()); });
+        const double fast = nanosecondsPerElement(count, [&]
+                                                  { build(FastMath()); });
+        std::printf("\nMatrix::getModelMatrix: %.2f ns with StdMath, %.2f ns with FastMath%s\n", libm, fast,
+                    haveAvx ? " (AVX build)" : "");
+    }
+    return 0;
+}
@@ -0,0 +1,433 @@
+// Microbenchmarks of the engine's CPU code: matrix construction, batch
+// transforms, OBJ parsing and loading of generated meshes, and tangent
+// generation. Runs without a window or GL context.
+//
+//   grn_bench [--filter text] [--max-faces N] [--samples N] [--output file]
+//
+// Results are written as JSON (to stdout unless --output is given) so runs of
+// two commits can be diffed:
+//
+//   {"build": {...}, "results": [{"name": "obj/parse/1000000", "size": 999698, "unit": "faces",
+//     "samples": 15, "median_ns": ..., "p95_ns": ..., "throughput": ..., "bytes_per_second": ...}]}
+//
+// median_ns and p95_ns are per run of the benchmark over `size` items;
+// throughput is `size` items per second at the median. Logger output is
+// discarded while benchmarks run so it can't interleave with the JSON.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <grn/fastmath.h>
+#include <grn/matrix.h>
+#include <grn/mesh_data.h>
+#include <grn/obj_parser.h>
+#include <grn/quaternion.h>
+#include <grn/tangents.h>
+#include <grn/transform_batch.h>
+#include <grn/vector_stream.h>
+
+namespace
+{
+    using namespace grn;
+    using Clock = std::chrono::steady_clock;
+
+    struct Options
+    {
+        std::string filter;
+        std::string output;
+        size_t maxFaces = 10000000;
+        int samples = 15;
+    };
+
+    struct Result
+    {
+        std::string name;
+        size_t size;
+        const char *unit;
+        size_t bytes; // input bytes per run, 0 if throughput in bytes means nothing
+        std::vector<double> nanoseconds;
+    };
+
+    volatile float sink;
+
+    double percentile(std::vector<double> values, double fraction)
+    {
+        std::sort(values.begin(), values.end());
+        const size_t index = static_cast<size_t>(std::ceil(fraction * values.size())) - 1;
+        return values[std::min(index, values.size() - 1)];
+    }
+
+    class Runner
+    {
+    public:
+        explicit Runner(const Options &options) : m_options(options) {}
+
+        // Times `run` over `size` items. `setup` runs before every sample,
+        // outside the timing. Fast runs are repeated within a sample until it
+        // takes about a millisecond; slow ones get fewer samples, at least three.
+        void run(const std::string &name, size_t size, const char *unit, size_t bytes,
+                 const std::function<void()> &setup, const std::function<void()> &run)
+        {
+            if (!selected(name))
+                return;
+
+            setup();
+            const double first = elapsed(run, 1); // warms caches and the allocator
+            const int repeats = static_cast<int>(std::clamp(1e6 / std::max(first, 1.0), 1.0, 1e6));
+            const int samples = first > 1e9 ? 3 : first > 1e8 ? std::min(m_options.samples, 5) : m_options.samples;
+
+            Result result = {name, size, unit, bytes, {}};
+            for (int sample = 0; sample < samples; ++sample)
+            {
+                setup();
+                result.nanoseconds.push_back(elapsed(run, repeats) / repeats);
+            }
+            std::fprintf(stderr, "%-32s %10zu %-9s median %12.0f ns\n", name.c_str(), size, unit, percentile(result.nanoseconds, 0.5));
+            m_results.push_back(std::move(result));
+        }
+
+        void run(const std::string &name, size_t size, const char *unit, const std::function<void()> &run)
+        {
+            this->run(name, size, unit, 0, [] {}, run);
+        }
+
+        bool selected(const std::string &name) const
+        {
+            return name.find(m_options.filter) != std::string::npos;
+        }
+
+        std::string json() const
+        {
+            std::ostringstream out;
+            out.precision(6);
+            out << "{\n  \"build\": {";
+#if defined(GRN_SIMD_AVX)
+            out << "\"simd\": \"avx2\"";
+#elif defined(GRN_SIMD_SSE)
+            out << "\"simd\": \"sse\"";
+#elif defined(GRN_SIMD_NEON)
+            out << "\"simd\": \"neon\"";
+#else
+            out << "\"simd\": \"scalar\"";
+#endif
+            out << ", \"threads\": " << hardwareThreads();
+#if defined(__VERSION__)
+            out << ", \"compiler\": \"" << __VERSION__ << "\"";
+#endif
+            out << "},\n  \"results\": [";
+            for (size_t i = 0; i < m_results.size(); ++i)
+            {
+                const Result &result = m_results[i];
+                const double median = percentile(result.nanoseconds, 0.5);
+                out << (i ? ",\n" : "\n") << "    {\"name\": \"" << result.name << "\", \"size\": " << result.size
+                    << ", \"unit\": \"" << result.unit << "\", \"samples\": " << result.nanoseconds.size()
+                    << std::fixed << ", \"median_ns\": " << median << ", \"p95_ns\": " << percentile(result.nanoseconds, 0.95)
+                    << ", \"throughput\": " << result.size * 1e9 / median;
+                if (result.bytes)
+                    out << ", \"bytes_per_second\": " << result.bytes * 1e9 / median;
+                out << std::defaultfloat << "}";
+            }
+            out << "\n  ]\n}\n";
+            return out.str();
+        }
+
+    private:
+        static double elapsed(const std::function<void()> &run, int repeats)
+        {
+            const Clock::time_point start = Clock::now();
+            for (int i = 0; i < repeats; ++i)
+                run();
+            return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        }
+
+        const Options &m_options;
+        std::vector<Result> m_results;
+    };
+
+    // A grid of columns * rows quads in the xz plane, two triangles each, with
+    // a gentle height field so normals and tangents are not all the same
+    struct Grid
+    {
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        size_t columns, rows;
+
+        size_t faceCount() const { return indices.size() / 3; }
+    };
+
+    Grid makeGrid(size_t faces)
+    {
+        Grid grid;
+        const size_t quads = std::max<size_t>(faces / 2, 1);
+        grid.columns = std::max<size_t>(static_cast<size_t>(std::sqrt(double(quads))), 1);
+        grid.rows = std::max<size_t>(quads / grid.columns, 1);
+
+        const size_t stride = grid.columns + 1;
+        grid.vertices.resize(stride * (grid.rows + 1));
+        for (size_t row = 0; row <= grid.rows; ++row)
+        {
+            for (size_t column = 0; column <= grid.columns; ++column)
+            {
+                const float u = float(column) / float(grid.columns), v = float(row) / float(grid.rows);
+                Vertex &vertex = grid.vertices[row * stride + column];
+                vertex = {};
+                vertex.position[0] = u * 100.0f;
+                vertex.position[1] = std::sin(u * 31.0f) * std::cos(v * 17.0f);
+                vertex.position[2] = v * 100.0f;
+                vertex.normal[1] = 1.0f;
+                vertex.texCoord[0] = u;
+                vertex.texCoord[1] = v;
+            }
+        }
+
+        grid.indices.reserve(grid.columns * grid.rows * 6);
+        for (size_t row = 0; row < grid.rows; ++row)
+        {
+            for (size_t column = 0; column < grid.columns; ++column)
+            {
+                const unsigned int corner = static_cast<unsigned int>(row * stride + column);
+                const unsigned int next = corner + static_cast<unsigned int>(stride);
+                grid.indices.insert(grid.indices.end(), {corner, next, corner + 1, corner + 1, next, next + 1});
+            }
+        }
+        return grid;
+    }
+
+    // The grid as OBJ text with v, vt and vn records and v/vt/vn face corners
+    std::string toOBJ(const Grid &grid)
+    {
+        std::string text;
+        text.reserve(grid.vertices.size() * 96 + grid.indices.size() * 24);
+        char line[128];
+        for (const Vertex &vertex : grid.vertices)
+        {
+            text.append(line, std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", vertex.position[0], vertex.position[1], vertex.position[2]));
+            text.append(line, std::snprintf(line, sizeof(line), "vt %.6f %.6f\n", vertex.texCoord[0], vertex.texCoord[1]));
+            text.append(line, std::snprintf(line, sizeof(line), "vn %.6f %.6f %.6f\n", vertex.normal[0], vertex.normal[1], vertex.normal[2]));
+        }
+        for (size_t i = 0; i < grid.indices.size(); i += 3)
+        {
+            const unsigned int a = grid.indices[i] + 1, b = grid.indices[i + 1] + 1, c = grid.indices[i + 2] + 1;
+            text.append(line, std::snprintf(line, sizeof(line), "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, c, c, c));
+        }
+        return text;
+    }
+
+    void benchmarkMatrices(Runner &runner)
+    {
+        constexpr size_t count = 1024;
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> angle(-3.14159f, 3.14159f), offset(-100.0f, 100.0f), scale(0.5f, 2.0f);
+        std::vector<Vector> positions(count), rotations(count), scales(count);
+        std::vector<Quaternion> quaternions(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            positions[i] = Vector(offset(rng), offset(rng), offset(rng));
+            rotations[i] = Vector(angle(rng), angle(rng), angle(rng));
+            scales[i] = Vector(scale(rng), scale(rng), scale(rng));
+            quaternions[i] = Quaternion::fromEuler(rotations[i]);
+        }
+
+        std::vector<Matrix> models(count), out(count);
+        std::vector<Matrix3> normals(count);
+        for (size_t i = 0; i < count; ++i)
+            models[i] = Matrix::getModelMatrix(positions[i], rotations[i], scales[i]);
+
+        runner.run("matrix/model_euler", count, "matrices", [&]
+                   {
+            for (size_t i = 0; i < count; ++i)
+                out[i] = Matrix::getModelMatrix(positions[i], rotations[i], scales[i]);
+            sink = out[count / 2][0]; });
+        runner.run("matrix/model_euler_fastmath", count, "matrices", [&]
+                   {
+            for (size_t i = 0; i < count; ++i)
+                out[i] = Matrix::getModelMatrix<FastMath>(positions[i], rotations[i], scales[i]);
+            sink = out[count / 2][0]; });
+        runner.run("matrix/model_quaternion", count, "matrices", [&]
+                   {
+            for (size_t i = 0; i < count; ++i)
+                out[i] = Quaternion::getModelMatrix(positions[i], quaternions[i], scales[i]);
+            sink = out[count / 2][0]; });
+        runner.run("matrix/view", count, "matrices", [&]
+                   {
+            for (size_t i = 0; i < count; ++i)
+                out[i] = Matrix::getViewMatrix(positions[i], positions[count - 1 - i], Vector(0.0f, 1.0f, 0.0f));
+            sink = out[count / 2][0]; });
+        runner.run("matrix/multiply", count, "matrices", [&]
+                   {
+            for (size_t i = 0; i < count; ++i)
+                out[i] = models[i] * models[count - 1 - i];
+            sink = out[count / 2][0]; });
+        runner.run("matrix/inverse", count, "matrices", [&]
+                   {
+            for (size_t i = 0; i < count; ++i)
+                out[i] = models[i].inverse();
+            sink = out[count / 2][0]; });
+        runner.run("matrix/normal_matrix", count, "matrices", [&]
+                   {
+            for (size_t i = 0; i < count; ++i)
+                normals[i] = Matrix::getNormalMatrix(models[i]);
+            sink = normals[count / 2][0]; });
+    }
+
+    void benchmarkBatches(Runner &runner)
+    {
+        constexpr size_t count = 100000;
+        std::mt19937 rng(2);
+        std::uniform_real_distribution<float> angle(-3.14159f, 3.14159f), offset(-100.0f, 100.0f), scale(0.5f, 2.0f);
+        TransformArray euler, quaternions;
+        quaternions.rotation = TransformArray::Rotation::Quaternion;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const Vector position(offset(rng), offset(rng), offset(rng)), rotation(angle(rng), angle(rng), angle(rng));
+            const Vector size(scale(rng), scale(rng), scale(rng));
+            euler.push_back(position, rotation, size);
+            quaternions.push_back(position, Quaternion::fromEuler(rotation), size);
+        }
+
+        std::vector<Matrix> models(count);
+        std::vector<Matrix3> normals(count);
+        runner.run("batch/model_matrices_euler", count, "matrices", [&]
+                   { buildModelMatrices(euler, models.data()); sink = models[count / 2][0]; });
+        runner.run("batch/model_matrices_quaternion", count, "matrices", [&]
+                   { buildModelMatrices(quaternions, models.data()); sink = models[count / 2][0]; });
+        runner.run("batch/model_and_normal_matrices", count, "matrices", [&]
+                   { buildModelMatrices(euler, models.data(), normals.data()); sink = normals[count / 2][0]; });
+
+        constexpr size_t pointCount = 1000000;
+        VectorStream points, transformed;
+        std::vector<float> packed, packedOut(pointCount * 3);
+        points.reserve(pointCount);
+        for (size_t i = 0; i < pointCount; ++i)
+        {
+            const Vector point(offset(rng), offset(rng), offset(rng));
+            points.push_back(point);
+            packed.insert(packed.end(), {point.x, point.y, point.z});
+        }
+        const Matrix model = Matrix::getModelMatrix(Vector(1.0f, 2.0f, 3.0f), Vector(0.1f, 0.2f, 0.3f), Vector(2.0f, 2.0f, 2.0f));
+        runner.run("batch/transform_points_xyz", pointCount, "points", pointCount * 12, [] {}, [&]
+                   { transformPoints(model, packed.data(), packedOut.data(), pointCount); sink = packedOut[pointCount]; });
+        runner.run("batch/transform_points_stream", pointCount, "points", pointCount * 12, [] {}, [&]
+                   { transformPoints(model, points, transformed); sink = transformed.x[pointCount / 2]; });
+    }
+
+    void benchmarkMeshes(Runner &runner, const Options &options)
+    {
+        const std::filesystem::path directory = std::filesystem::temp_directory_path();
+        for (size_t faces = 10000; faces <= options.maxFaces; faces *= 10)
+        {
+            const std::string suffix = "/" + std::to_string(faces);
+            if (!runner.selected("obj/parse" + suffix) && !runner.selected("obj/load" + suffix) && !runner.selected("tangents/generate" + suffix))
+                continue;
+
+            Grid grid = makeGrid(faces);
+            const std::string text = toOBJ(grid);
+
+            runner.run("obj/parse" + suffix, grid.faceCount(), "faces", text.size(), [] {}, [&]
+                       {
+                ObjData obj;
+                parseOBJParallel(text.data(), text.data() + text.size(), obj);
+                sink = obj.positions[0]; });
+
+            // Cold loads: parse, weld, tangents and bounds, with the cooked
+            // cache deleted before every sample (writing it is part of the load)
+            if (runner.selected("obj/load" + suffix))
+            {
+                const std::string filename = (directory / ("grn_bench_" + std::to_string(faces) + ".obj")).string();
+                {
+                    std::ofstream file(filename, std::ios::binary);
+                    file.write(text.data(), text.size());
+                }
+                runner.run("obj/load" + suffix, grid.faceCount(), "faces", text.size(), [&]
+                           { std::filesystem::remove(cookedMeshPath(filename)); }, [&]
+                           {
+                    MeshData data = loadMeshDataOBJ(filename);
+                    sink = data.bounds.max[0]; });
+                std::filesystem::remove(cookedMeshPath(filename));
+                std::filesystem::remove(filename);
+            }
+
+            runner.run("tangents/generate" + suffix, grid.faceCount(), "faces", [&]
+                       {
+                generateTangents(grid.vertices.data(), grid.vertices.size(), grid.indices.data(), grid.indices.size());
+                sink = grid.vertices[0].tangent[0]; });
+        }
+    }
+
+    bool parseArguments(int argc, char **argv, Options &options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            if (i + 1 == argc)
+                return false;
+            const char *value = argv[++i];
+            if (argument == "--filter")
+                options.filter = value;
+            else if (argument == "--output")
+                options.output = value;
+            else if (argument == "--max-faces")
+                options.maxFaces = std::strtoull(value, nullptr, 10);
+            else if (argument == "--samples")
+                options.samples = std::max(1, std::atoi(value));
+            else
+                return false;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options))
+    {
+        std::fprintf(stderr, "usage: %s [--filter text] [--max-faces N] [--samples N] [--output file]\n", argv[0]);
+        return 1;
+    }
+
+    // Logger writes to std::cout; keep stdout for the JSON
+    std::ostringstream discarded;
+    std::streambuf *const coutBuffer = std::cout.rdbuf(discarded.rdbuf());
+
+    Runner runner(options);
+    try
+    {
+        benchmarkMatrices(runner);
+        benchmarkBatches(runner);
+        benchmarkMeshes(runner, options);
+    }
+    catch (const std::exception &exception)
+    {
+        std::cout.rdbuf(coutBuffer);
+        std::fprintf(stderr, "grn_bench: %s\n", exception.what());
+        return 1;
+    }
+    std::cout.rdbuf(coutBuffer);
+
+    const std::string json = runner.json();
+    if (options.output.empty())
+    {
+        std::fputs(json.c_str(), stdout);
+        return 0;
+    }
+    std::ofstream file(options.output, std::ios::binary);
+    file << json;
+    if (!file)
+    {
+        std::fprintf(stderr, "grn_bench: could not write %s\n", options.output.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+#include <grn/matrix.h>
+#include "frustum.h"
+#include "simd.h"
+#include "vertex.h"
+
+namespace grn
+{
+    // World-space bounds of a model-space sphere; non-uniform scale is covered
+    // by the largest axis scale
+    inline BoundingSphere transformSphere(const Matrix &model, const BoundingSphere &sphere)
+    {
+        BoundingSphere result;
+        for (int row = 0; row < 3; ++row)
+        {
+            result.center[row] = model[row] * sphere.center[0] + model[4 + row] * sphere.center[1] +
+                                 model[8 + row] * sphere.center[2] + model[12 + row];
+        }
+
+        float maxScaleSquared = 0.0f;
+        for (int column = 0; column < 3; ++column)
+        {
+            const float *axis = &model[column * 4];
+            maxScaleSquared = std::max(maxScaleSquared, axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        }
+        result.radius = sphere.radius * std::sqrt(maxScaleSquared);
+        return result;
+    }
+
+    // Bounding spheres of many objects as structure of arrays, so the frustum
+    // test covers four (SSE/NEON) or eight (AVX) objects per instruction
+    struct SphereArray
+    {
+        std::vector<float> x, y, z, radius;
+
+        size_t size() const { return x.size(); }
+
+        void clear()
+        {
+            x.clear(), y.clear(), z.clear(), radius.clear();
+        }
+
+        void reserve(size_t count)
+        {
+            x.reserve(count), y.reserve(count), z.reserve(count), radius.reserve(count);
+        }
+
+        // Returns the index of the new sphere
+        size_t push_back(const BoundingSphere &sphere)
+        {
+            x.push_back(sphere.center[0]);
+            y.push_back(sphere.center[1]);
+            z.push_back(sphere.center[2]);
+            radius.push_back(sphere.radius);
+            return x.size() - 1;
+        }
+
+        void set(size_t index, const BoundingSphere &sphere)
+        {
+            x[index] = sphere.center[0];
+            y[index] = sphere.center[1];
+            z[index] = sphere.center[2];
+            radius[index] = sphere.radius;
+        }
+    };
+
+    // Sets visible[i] to 1 for every sphere that intersects the frustum and to 0
+    // for the rest; returns the number of visible spheres. Frustum and spheres
+    // must be in the same space, usually world space with planes taken from
+    // projection * view. Every path evaluates the plane distances in the same
+    // order, so the result does not depend on the instruction set.
+    inline size_t cullSpheres(const Frustum &frustum, const float *x, const float *y, const float *z, const float *radius,
+                              size_t count, uint8_t *visible)
+    {
+        size_t i = 0;
+        size_t visibleCount = 0;
+
+#if defined(__AVX__)
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256 cx = _mm256_loadu_ps(x + i), cy = _mm256_loadu_ps(y + i), cz = _mm256_loadu_ps(z + i);
+            const __m256 negativeRadius = _mm256_xor_ps(_mm256_loadu_ps(radius + i), _mm256_set1_ps(-0.0f));
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (const float *plane : frustum.planes)
+            {
+                __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane[0]), cx),
+                                                                            _mm256_mul_ps(_mm256_set1_ps(plane[1]), cy)),
+                                                              _mm256_mul_ps(_mm256_set1_ps(plane[2]), cz)),
+                                                _mm256_set1_ps(plane[3]));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+            }
+            const int lanes = _mm256_movemask_ps(inside);
+            for (int lane = 0; lane < 8; ++lane)
+            {
+                visible[i + lane] = static_cast<uint8_t>(lanes >> lane & 1);
+                visibleCount += lanes >> lane & 1;
+            }
+        }
+#endif
+
+        {
+            using namespace simd;
+            for (; i + 4 <= count; i += 4)
+            {
+                const float4 cx = load(x + i), cy = load(y + i), cz = load(z + i);
+                const float4 negativeRadius = -load(radius + i);
+                mask4 inside = splat(0.0f) >= splat(0.0f);
+                for (const float *plane : frustum.planes)
+                {
+                    float4 distance = splat(plane[0]) * cx + splat(plane[1]) * cy + splat(plane[2]) * cz + splat(plane[3]);
+                    inside = inside & (distance >= negativeRadius);
+                }
+                const int lanes = bits(inside);
+                for (int lane = 0; lane < 4; ++lane)
+                {
+                    visible[i + lane] = static_cast<uint8_t>(lanes >> lane & 1);
+                    visibleCount += lanes >> lane & 1;
+                }
+            }
+        }
+
+        for (; i < count; ++i)
+        {
+            const float center[3] = {x[i], y[i], z[i]};
+            visible[i] = frustum.intersectsSphere(center, radius[i]) ? 1 : 0;
+            visibleCount += visible[i];
+        }
+        return visibleCount;
+    }
+
+    inline size_t cullSpheres(const Frustum &frustum, const SphereArray &spheres, uint8_t *visible)
+    {
+        return cullSpheres(frustum, spheres.x.data(), spheres.y.data(), spheres.z.data(), spheres.radius.data(), spheres.size(), visible);
+    }
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <grn/simd.h>
+#include <grn/vector.h>
+
+namespace grn
+{
+    // Polynomial replacements for the libm functions on the per-object hot
+    // paths. Every function is a template over float, simd::float4 and (in AVX
+    // builds) simd::float8, and runs the same operations on each, so a lane's
+    // result does not depend on the width it was computed at. rsqrt() is the
+    // exception: its hardware estimate differs between CPU vendors.
+    //
+    // Maximum errors, measured against double-precision libm:
+    //   sincos   9.3e-8 absolute for |x| <= 8192 (grows with |x| beyond)
+    //   rsqrt    2.8e-7 relative for normal x > 0
+    //   acos     3.0e-7 absolute on [-1, 1]
+    //   atan2    2.8e-7 absolute for finite arguments
+    namespace fastmath
+    {
+        template <typename V>
+        inline void sincos(V x, V &sine, V &cosine)
+        {
+            simd::sincos(x, sine, cosine);
+        }
+
+        // simd::sincos() for one float, with the quadrant handled in integer
+        // bits instead of selects that compile to unpredictable branches.
+        // Same results as the vector versions.
+        inline void sincos(float x, float &sine, float &cosine)
+        {
+            const float q = simd::roundNearest(x * 0.636619772f);
+            const float r = ((x - q * 1.5703125f) - q * 4.837512969970703125e-4f) - q * 7.54978995489188216e-8f;
+            const float r2 = r * r;
+            const float polynomials[2] = {
+                r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f)),
+                1.0f - 0.5f * r2 + r2 * r2 * (4.166664568298827e-2f + r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f))};
+
+            const uint32_t quadrant = uint32_t(int32_t(q)) & 3;
+            uint32_t sineBits, cosineBits;
+            std::memcpy(&sineBits, &polynomials[quadrant & 1], sizeof(float));
+            std::memcpy(&cosineBits, &polynomials[(quadrant & 1) ^ 1], sizeof(float));
+            sineBits ^= (quadrant & 2) << 30;             // quadrants 2 and 3
+            cosineBits ^= ((quadrant + 1) & 2) << 30;     // quadrants 1 and 2
+            std::memcpy(&sine, &sineBits, sizeof(float));
+            std::memcpy(&cosine, &cosineBits, sizeof(float));
+        }
+
+        // 1 / sqrt(x): the hardware estimate plus one Newton-Raphson step.
+        // Zero, infinite and negative x give NaN.
+        template <typename V>
+        inline V rsqrt(V x)
+        {
+            using T = simd::vector_traits<V>;
+            const V y = simd::rsqrtEstimate(x);
+            return y * (T::splat(1.5f) - T::splat(0.5f) * x * y * y);
+        }
+
+        // Cephes asinf polynomial on [0, 0.5]; beyond that acos(x) is
+        // 2 asin(sqrt((1 - x) / 2)). x must lie in [-1, 1].
+        template <typename V>
+        inline V acos(V x)
+        {
+            using T = simd::vector_traits<V>;
+            using namespace simd;
+            const V a = abs(x);
+            const auto large = a >= T::splat(0.5f);
+            const V z = select(large, T::splat(0.5f) * (T::splat(1.0f) - a), a * a);
+            const V s = select(large, sqrt(z), a);
+            const V asinS = s + s * z * ((((T::splat(4.2163199048e-2f) * z + T::splat(2.4181311049e-2f)) * z + T::splat(4.5470025998e-2f)) * z +
+                                          T::splat(7.4953002686e-2f)) * z + T::splat(1.6666752422e-1f));
+            const V result = select(large, T::splat(2.0f) * asinS, T::splat(1.57079632679f) - asinS); // acos(|x|)
+            return select(x < T::splat(0.0f), T::splat(3.14159265359f) - result, result);
+        }
+
+        // Angle of (x, y) in [-pi, pi]: Cephes atanf on min(|x|, |y|) / max(|x|, |y|)
+        // and the octant from the signs and magnitudes. Signed zeros are not
+        // told apart: atan2(0, -0) is 0, not pi.
+        template <typename V>
+        inline V atan2(V y, V x)
+        {
+            using T = simd::vector_traits<V>;
+            using namespace simd;
+            const V ax = abs(x), ay = abs(y);
+            const V low = min(ax, ay), high = max(ax, ay);
+            const V t = low / select(high < T::splat(std::numeric_limits<float>::denorm_min()), T::splat(1.0f), high);
+
+            // atan(t) on [0, 1], reduced to [-tan(pi/8), tan(pi/8)]
+            const auto reduce = t >= T::splat(0.414213562f);
+            const V u = select(reduce, (t - T::splat(1.0f)) / (t + T::splat(1.0f)), t);
+            const V u2 = u * u;
+            V angle = select(reduce, T::splat(0.785398163f), T::splat(0.0f)) +
+                      (u + u * u2 * (((T::splat(8.05374449538e-2f) * u2 - T::splat(1.38776856032e-1f)) * u2 + T::splat(1.99777106478e-1f)) * u2 -
+                                     T::splat(3.33329491539e-1f)));
+
+            angle = select(ax < ay, T::splat(1.57079632679f) - angle, angle);
+            angle = select(x < T::splat(0.0f), T::splat(3.14159265359f) - angle, angle);
+            return select(y < T::splat(0.0f), -angle, angle);
+        }
+    }
+
+    // Math policy for the templated vector, matrix and quaternion code that
+    // swaps libm for the fastmath kernels (see StdMath in vector.h)
+    struct FastMath
+    {
+        static float sqrt(float x) { return x > 0.0f ? x * fastmath::rsqrt(x) : 0.0f; }
+        static float rsqrt(float x) { return fastmath::rsqrt(x); }
+        static void sincos(float x, float &sine, float &cosine) { fastmath::sincos(x, sine, cosine); }
+        // All three in one float4, built in registers: going through memory
+        // stalls store forwarding for longer than the polynomials take
+        static void sincos(const Vector &x, Vector &sine, Vector &cosine)
+        {
+#if defined(GRN_SIMD_SSE) || defined(GRN_SIMD_NEON)
+            using namespace simd;
+            float4 s, c;
+            fastmath::sincos(set(x.x, x.y, x.z, 0.0f), s, c);
+            sine = Vector(lane<0>(s), lane<1>(s), lane<2>(s));
+            cosine = Vector(lane<0>(c), lane<1>(c), lane<2>(c));
+#else
+            fastmath::sincos(x.x, sine.x, cosine.x);
+            fastmath::sincos(x.y, sine.y, cosine.y);
+            fastmath::sincos(x.z, sine.z, cosine.z);
+#endif
+        }
+        static float acos(float x) { return fastmath::acos(x); }
+        static float atan2(float y, float x) { return fastmath::atan2(y, x); }
+    };
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cmath>
+#include <grn/matrix.h>
+
+namespace grn
+{
+    // Six inward-facing planes (a, b, c, d) with unit normals, so that
+    // a*x + b*y + c*z + d is the signed distance of a point from the plane.
+    struct Frustum
+    {
+        enum Plane
+        {
+            Left,
+            Right,
+            Bottom,
+            Top,
+            Near,
+            Far,
+            PlaneCount
+        };
+
+        float planes[PlaneCount][4];
+
+        // Extracts the planes of a column-major clip matrix (Gribb & Hartmann).
+        // With projection * view the planes are in world space; with
+        // projection * view * model they are in that model's space, which lets
+        // model-space bounds be tested without transforming them.
+        static Frustum fromMatrix(const Matrix &clip)
+        {
+            Frustum frustum;
+            for (int i = 0; i < 3; ++i)
+            {
+                for (int k = 0; k < 4; ++k)
+                {
+                    float row = clip[k * 4 + i];
+                    float w = clip[k * 4 + 3];
+                    frustum.planes[i * 2][k] = w + row;
+                    frustum.planes[i * 2 + 1][k] = w - row;
+                }
+            }
+
+            for (float *plane : frustum.planes)
+            {
+                float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+                if (length > 0.0f)
+                {
+                    for (int k = 0; k < 4; ++k)
+                        plane[k] /= length;
+                }
+            }
+            return frustum;
+        }
+
+        // Conservative: a sphere near a frustum corner may pass while outside
+        bool intersectsSphere(const float *center, float radius) const
+        {
+            for (const float *plane : planes)
+            {
+                if (plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3] < -radius)
+                    return false;
+            }
+            return true;
+        }
+    };
+}
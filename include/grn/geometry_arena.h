@@ -0,0 +1,338 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "logger.h"
+#include "mesh.h"
+#include "mesh_data.h"
+#include "vertex.h"
+
+namespace grn
+{
+    // First-fit sub-allocator over [0, capacity) in caller-defined units. Free
+    // ranges are kept sorted by offset and merged with their neighbours on free().
+    class FreeListAllocator
+    {
+    public:
+        static constexpr uint64_t InvalidOffset = ~uint64_t(0);
+
+        explicit FreeListAllocator(uint64_t capacity = 0) { reset(capacity); }
+
+        // Forgets all allocations; [0, used) is taken, the rest is one free range
+        void reset(uint64_t capacity, uint64_t used = 0)
+        {
+            m_free.clear();
+            m_capacity = capacity;
+            m_freeSize = capacity - used;
+            if (used < capacity)
+                m_free.emplace(used, capacity - used);
+        }
+
+        // Returns the offset of `size` units aligned to `alignment`, or
+        // InvalidOffset if no free range is large enough. Padding in front of an
+        // aligned allocation stays free.
+        uint64_t allocate(uint64_t size, uint64_t alignment = 1)
+        {
+            if (size == 0)
+                return 0;
+            for (auto range = m_free.begin(); range != m_free.end(); ++range)
+            {
+                const uint64_t begin = range->first, end = range->first + range->second;
+                const uint64_t offset = (begin + alignment - 1) / alignment * alignment;
+                if (offset + size > end)
+                    continue;
+
+                m_free.erase(range);
+                if (offset > begin)
+                    m_free.emplace(begin, offset - begin);
+                if (offset + size < end)
+                    m_free.emplace(offset + size, end - offset - size);
+                m_freeSize -= size;
+                return offset;
+            }
+            return InvalidOffset;
+        }
+
+        void free(uint64_t offset, uint64_t size)
+        {
+            if (size == 0)
+                return;
+            auto range = m_free.emplace(offset, size).first;
+            auto next = std::next(range);
+            if (next != m_free.end() && offset + size == next->first)
+            {
+                range->second += next->second;
+                m_free.erase(next);
+            }
+            if (range != m_free.begin())
+            {
+                auto previous = std::prev(range);
+                if (previous->first + previous->second == offset)
+                {
+                    previous->second += range->second;
+                    m_free.erase(range);
+                }
+            }
+            m_freeSize += size;
+        }
+
+        uint64_t capacity() const { return m_capacity; }
+        uint64_t freeSize() const { return m_freeSize; }
+
+        uint64_t largestFree() const
+        {
+            uint64_t largest = 0;
+            for (const auto &range : m_free)
+                largest = std::max(largest, range.second);
+            return largest;
+        }
+
+        // 0 when all free space is one range, approaching 1 as it splinters
+        float fragmentation() const
+        {
+            return m_freeSize == 0 ? 0.0f : 1.0f - float(largestFree()) / float(m_freeSize);
+        }
+
+    private:
+        std::map<uint64_t, uint64_t> m_free; // offset -> size
+        uint64_t m_capacity = 0;
+        uint64_t m_freeSize = 0;
+    };
+
+    // Shared vertex and index buffers for many meshes of one vertex format.
+    // Meshes are sub-allocated ranges drawn with glDrawElementsBaseVertex from
+    // a single VAO, so switching meshes needs no VAO or buffer binds. Indices
+    // stay relative to each mesh's first vertex, so 16-bit index buffers keep
+    // working however large the arena grows.
+    //
+    // When an allocation does not fit, the arena first compacts its live data
+    // if that frees a large enough range, and otherwise grows. Both copy on the
+    // GPU with glCopyBufferSubData and update the GeometryAllocation records in
+    // place; Mesh::allocation pointers stay valid until remove(). Needs GL 3.2.
+    class GeometryArena
+    {
+    public:
+        // Capacities are in vertices and index bytes
+        explicit GeometryArena(VertexFormat format, size_t vertexCapacity = 1 << 18, size_t indexCapacity = 4 << 20)
+            : m_format(format), m_stride(vertexStride(format))
+        {
+            glGenVertexArrays(1, &m_vao);
+            createBuffers(std::max<size_t>(vertexCapacity, 1), std::max<size_t>(indexCapacity, IndexAlignment));
+        }
+
+        ~GeometryArena()
+        {
+            glDeleteVertexArrays(1, &m_vao);
+            glDeleteBuffers(1, &m_vbo);
+            glDeleteBuffers(1, &m_ebo);
+        }
+
+        // Non-copyable
+        GeometryArena(const GeometryArena &) = delete;
+        GeometryArena &operator=(const GeometryArena &) = delete;
+
+        // Copies vertexCount vertices of the arena's format and indexCount
+        // indices into the arena. Indices are relative to the first vertex.
+        const GeometryAllocation *add(const void *vertexData, size_t vertexCount, const void *indexData, size_t indexCount, IndexFormat indexFormat)
+        {
+            const uint64_t indexBytes = uint64_t(indexCount) * indexStride(indexFormat);
+            uint64_t firstVertex = m_vertices.allocate(vertexCount);
+            uint64_t indexOffset = m_indices.allocate(indexBytes, IndexAlignment);
+            if (firstVertex == FreeListAllocator::InvalidOffset || indexOffset == FreeListAllocator::InvalidOffset)
+            {
+                // Undo the half that fit, make room for both, then retry
+                if (firstVertex != FreeListAllocator::InvalidOffset)
+                    m_vertices.free(firstVertex, vertexCount);
+                if (indexOffset != FreeListAllocator::InvalidOffset)
+                    m_indices.free(indexOffset, indexBytes);
+                makeRoom(vertexCount, indexBytes);
+                firstVertex = m_vertices.allocate(vertexCount);
+                indexOffset = m_indices.allocate(indexBytes, IndexAlignment);
+            }
+            if (firstVertex > uint64_t(INT32_MAX))
+                throw std::runtime_error("Geometry arena exceeds the GLint base vertex range");
+
+            uint32_t slot;
+            if (!m_freeSlots.empty())
+            {
+                slot = m_freeSlots.back();
+                m_freeSlots.pop_back();
+            }
+            else
+            {
+                slot = static_cast<uint32_t>(m_allocations.size());
+                m_allocations.emplace_back();
+                m_live.push_back(false);
+            }
+            GeometryAllocation &allocation = m_allocations[slot];
+            allocation.baseVertex = static_cast<GLint>(firstVertex);
+            allocation.vertexCount = static_cast<uint32_t>(vertexCount);
+            allocation.indexOffset = static_cast<size_t>(indexOffset);
+            allocation.indexCount = static_cast<uint32_t>(indexCount);
+            allocation.indexType = indexFormat == IndexFormat::UInt16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+            allocation.slot = slot;
+            m_live[slot] = true;
+
+            glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+            glBufferSubData(GL_ARRAY_BUFFER, GLintptr(firstVertex * m_stride), GLsizeiptr(vertexCount * m_stride), vertexData);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            // The element buffer binding is VAO state, so upload through another target
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_ebo);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, GLintptr(indexOffset), GLsizeiptr(indexBytes), indexData);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            return &allocation;
+        }
+
+        // Frees the allocation's ranges; its record is reused by a later add()
+        void remove(const GeometryAllocation *allocation)
+        {
+            if (!allocation || allocation->slot >= m_allocations.size() || &m_allocations[allocation->slot] != allocation || !m_live[allocation->slot])
+                throw std::runtime_error("Geometry arena: removing an unknown allocation");
+            m_vertices.free(uint64_t(allocation->baseVertex), allocation->vertexCount);
+            m_indices.free(allocation->indexOffset, uint64_t(allocation->indexCount) * (allocation->indexType == GL_UNSIGNED_SHORT ? 2 : 4));
+            m_live[allocation->slot] = false;
+            m_freeSlots.push_back(allocation->slot);
+        }
+
+        // Packs all live allocations to the front of fresh buffers of the same
+        // size, leaving one free range at the end of each
+        void defragment()
+        {
+            relocate(m_vertices.capacity(), m_indices.capacity());
+        }
+
+        // The VAO that draws every mesh of this arena
+        GLuint vertexArray() const { return m_vao; }
+        VertexFormat format() const { return m_format; }
+        const FreeListAllocator &vertices() const { return m_vertices; }
+        const FreeListAllocator &indices() const { return m_indices; }
+
+    private:
+        // 16- and 32-bit index ranges both start on 4 bytes
+        static constexpr uint64_t IndexAlignment = 4;
+
+        VertexFormat m_format;
+        uint64_t m_stride;
+        GLuint m_vao = 0, m_vbo = 0, m_ebo = 0;
+        FreeListAllocator m_vertices; // in vertices
+        FreeListAllocator m_indices;  // in bytes
+        std::deque<GeometryAllocation> m_allocations; // a deque never moves its elements
+        std::vector<bool> m_live;
+        std::vector<uint32_t> m_freeSlots;
+
+        void createBuffers(uint64_t vertexCapacity, uint64_t indexCapacity)
+        {
+            glGenBuffers(1, &m_vbo);
+            glGenBuffers(1, &m_ebo);
+            glBindVertexArray(m_vao);
+            glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+            glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(vertexCapacity * m_stride), nullptr, GL_STATIC_DRAW);
+            setupVertexAttributes(m_format);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(indexCapacity), nullptr, GL_STATIC_DRAW);
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            m_vertices.reset(vertexCapacity);
+            m_indices.reset(indexCapacity);
+        }
+
+        // Compacts if that is enough, grows by at least half otherwise
+        void makeRoom(uint64_t vertexCount, uint64_t indexBytes)
+        {
+            // Alignment padding can cost up to IndexAlignment - 1 bytes
+            const uint64_t indexNeed = indexBytes + IndexAlignment;
+            if (m_vertices.freeSize() >= vertexCount && m_indices.freeSize() >= indexNeed)
+            {
+                Logger::debug("Geometry arena: defragmenting");
+                defragment();
+                return;
+            }
+            uint64_t vertexCapacity = m_vertices.capacity(), indexCapacity = m_indices.capacity();
+            if (m_vertices.freeSize() < vertexCount)
+                vertexCapacity = std::max(vertexCapacity + vertexCapacity / 2, vertexCapacity - m_vertices.freeSize() + vertexCount);
+            if (m_indices.freeSize() < indexNeed)
+                indexCapacity = std::max(indexCapacity + indexCapacity / 2, indexCapacity - m_indices.freeSize() + indexNeed);
+            Logger::debug("Geometry arena: growing to " + std::to_string(vertexCapacity) + " vertices, " + std::to_string(indexCapacity) + " index bytes");
+            relocate(vertexCapacity, indexCapacity);
+        }
+
+        // Copies every live allocation, packed in address order, into new
+        // buffers of the given capacities and points the VAO at them
+        void relocate(uint64_t vertexCapacity, uint64_t indexCapacity)
+        {
+            std::vector<GeometryAllocation *> live;
+            for (size_t slot = 0; slot < m_allocations.size(); ++slot)
+            {
+                if (m_live[slot])
+                    live.push_back(&m_allocations[slot]);
+            }
+
+            const GLuint oldVbo = m_vbo, oldEbo = m_ebo;
+            createBuffers(vertexCapacity, indexCapacity);
+
+            std::sort(live.begin(), live.end(), [](const GeometryAllocation *a, const GeometryAllocation *b)
+                      { return a->baseVertex < b->baseVertex; });
+            glBindBuffer(GL_COPY_READ_BUFFER, oldVbo);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_vbo);
+            uint64_t nextVertex = 0;
+            for (GeometryAllocation *allocation : live)
+            {
+                if (allocation->vertexCount > 0)
+                    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GLintptr(uint64_t(allocation->baseVertex) * m_stride),
+                                        GLintptr(nextVertex * m_stride), GLsizeiptr(uint64_t(allocation->vertexCount) * m_stride));
+                allocation->baseVertex = static_cast<GLint>(nextVertex);
+                nextVertex += allocation->vertexCount;
+            }
+
+            std::sort(live.begin(), live.end(), [](const GeometryAllocation *a, const GeometryAllocation *b)
+                      { return a->indexOffset < b->indexOffset; });
+            glBindBuffer(GL_COPY_READ_BUFFER, oldEbo);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_ebo);
+            uint64_t nextIndex = 0;
+            for (GeometryAllocation *allocation : live)
+            {
+                const uint64_t bytes = uint64_t(allocation->indexCount) * (allocation->indexType == GL_UNSIGNED_SHORT ? 2 : 4);
+                if (bytes > 0)
+                    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GLintptr(allocation->indexOffset), GLintptr(nextIndex), GLsizeiptr(bytes));
+                allocation->indexOffset = static_cast<size_t>(nextIndex);
+                nextIndex += (bytes + IndexAlignment - 1) / IndexAlignment * IndexAlignment;
+            }
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+            glDeleteBuffers(1, &oldVbo);
+            glDeleteBuffers(1, &oldEbo);
+            m_vertices.reset(vertexCapacity, nextVertex);
+            m_indices.reset(indexCapacity, nextIndex);
+        }
+    };
+
+    // Uploads finished MeshData into an arena instead of buffers of its own.
+    // The mesh draws with the arena's VAO and the usual drawLod() and
+    // drawIndexRanges(); release it with removeMesh().
+    static Mesh uploadMesh(GeometryArena &arena, const MeshData &data)
+    {
+        if (data.format != arena.format())
+            throw std::runtime_error("Mesh vertex format does not match the geometry arena");
+        Mesh mesh = describeMesh(data.indexCount(), data.format, data.indexFormat, data.bounds, data.lods, data.meshlets, data.submeshes);
+        mesh.allocation = arena.add(data.vertexData(), data.vertexCount(), data.indexData(), data.indexCount(), data.indexFormat);
+        mesh.VAO = arena.vertexArray();
+        mesh.sphere = data.sphere;
+        mesh.materials = data.materials;
+        return mesh;
+    }
+
+    static void removeMesh(GeometryArena &arena, Mesh &mesh)
+    {
+        arena.remove(mesh.allocation);
+        mesh.allocation = nullptr;
+        mesh.VAO = 0;
+    }
+}
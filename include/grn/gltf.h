@@ -0,0 +1,541 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <grn/matrix.h>
+#include <grn/quaternion.h>
+#include "json.h"
+#include "logger.h"
+#include "mapped_file.h"
+#include "material.h"
+#include "submesh.h"
+#include "vertex.h"
+
+namespace grn
+{
+    // Attribute locations of shader.vert built with GRN_GLTF_VERTEX. Only
+    // POSITION, NORMAL, TEXCOORD_0 and TANGENT are read by the shader; colors
+    // and skinning attributes are bound for shaders that want them.
+    enum class ModelAttribute : uint32_t
+    {
+        Position = 0,
+        Normal = 1,
+        TexCoord = 2,
+        Tangent = 3,
+        Color = 4,
+        Joints = 5,
+        Weights = 6,
+    };
+
+    // A bufferView of the binary chunk; uploaded as one GL buffer, as is
+    struct ModelBufferView
+    {
+        uint64_t byteOffset; // from the start of the binary chunk
+        uint64_t byteLength;
+    };
+
+    // One glVertexAttribPointer (or glVertexAttribIPointer) call. Component
+    // types keep their glTF values, which are the GL enums (GL_BYTE .. GL_FLOAT).
+    struct ModelVertexAttribute
+    {
+        uint32_t location;
+        uint32_t bufferView;
+        uint64_t byteOffset;    // within the buffer view
+        uint32_t byteStride;    // never 0: tightly packed data gets the element size
+        uint32_t componentCount;
+        uint32_t componentType;
+        bool normalized;
+        bool integer; // JOINTS_0, read as integers rather than converted to float
+    };
+
+    struct ModelPrimitive
+    {
+        std::vector<ModelVertexAttribute> attributes;
+        uint32_t mode;        // GL_POINTS .. GL_TRIANGLE_FAN, same values as glTF
+        uint32_t vertexCount;
+        bool indexed;
+        uint32_t indexBufferView;
+        uint64_t indexByteOffset; // within the buffer view
+        uint32_t indexType;       // GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+        uint32_t indexCount;
+        uint32_t material;        // index into ModelData::materials, or NoMaterial
+        Bounds bounds;            // from the POSITION accessor
+    };
+
+    struct ModelMesh
+    {
+        std::string name;
+        std::vector<ModelPrimitive> primitives;
+    };
+
+    struct ModelNode
+    {
+        std::string name;
+        Matrix transform;              // relative to the parent
+        uint32_t mesh = ~0u;           // ~0u if the node has no mesh
+        std::vector<uint32_t> children;
+    };
+
+    // A mesh placed in the scene, with the node hierarchy flattened into its transform
+    struct ModelInstance
+    {
+        Matrix transform;
+        uint32_t mesh;
+    };
+
+    // CPU side of a binary glTF file: the mapped file plus the layout needed to
+    // upload its buffer views and point vertex attributes into them. Nothing is
+    // converted or copied, so loading costs the JSON parse and validation only.
+    // Built without a GL context, like MeshData.
+    struct ModelData
+    {
+        MappedFile file;
+        const char *binary = nullptr; // BIN chunk inside `file`
+        uint64_t binarySize = 0;
+        std::vector<ModelBufferView> bufferViews;
+        std::vector<ModelMesh> meshes;
+        std::vector<ModelNode> nodes;
+        std::vector<uint32_t> roots; // nodes of the default scene
+        std::vector<ModelInstance> instances;
+        std::vector<Material> materials;
+        Bounds bounds = {{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}}; // of all instances, in model space
+    };
+
+    namespace detail
+    {
+        inline uint32_t readUint32(const char *p)
+        {
+            uint32_t value;
+            std::memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        [[noreturn]] inline void throwGltfError(const std::string &filename, const std::string &what)
+        {
+            throw std::runtime_error("glTF error in " + filename + ": " + what);
+        }
+
+        // An array element naming another object by index, which must be an
+        // integer below `count`
+        inline uint32_t gltfElementIndex(const std::string &filename, const JsonValue &value, size_t count, const std::string &what)
+        {
+            const double number = value.number(-1.0);
+            if (!(number >= 0.0 && number < double(count)) || number != static_cast<double>(static_cast<uint64_t>(number)))
+                throwGltfError(filename, what + " out of range");
+            return static_cast<uint32_t>(number);
+        }
+
+        inline uint32_t gltfComponentSize(uint64_t componentType)
+        {
+            switch (componentType)
+            {
+            case 5120: // GL_BYTE
+            case 5121: // GL_UNSIGNED_BYTE
+                return 1;
+            case 5122: // GL_SHORT
+            case 5123: // GL_UNSIGNED_SHORT
+                return 2;
+            case 5125: // GL_UNSIGNED_INT
+            case 5126: // GL_FLOAT
+                return 4;
+            default:
+                return 0;
+            }
+        }
+
+        inline uint32_t gltfComponentCount(const std::string &type)
+        {
+            if (type == "SCALAR")
+                return 1;
+            if (type == "VEC2")
+                return 2;
+            if (type == "VEC3")
+                return 3;
+            if (type == "VEC4")
+                return 4;
+            return 0; // matrices are never vertex attributes here
+        }
+
+        // glTF node transform: a matrix, or translation * rotation * scale
+        inline Matrix gltfNodeTransform(const JsonValue &node)
+        {
+            float m[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+            if (const JsonValue *matrix = node.find("matrix"); matrix && matrix->size() == 16)
+            {
+                for (int i = 0; i < 16; ++i)
+                    m[i] = static_cast<float>((*matrix)[i].number());
+                return Matrix(m);
+            }
+
+            float t[3] = {0, 0, 0}, r[4] = {0, 0, 0, 1}, s[3] = {1, 1, 1};
+            if (const JsonValue *value = node.find("translation"); value && value->size() == 3)
+                for (int i = 0; i < 3; ++i)
+                    t[i] = static_cast<float>((*value)[i].number());
+            if (const JsonValue *value = node.find("rotation"); value && value->size() == 4)
+                for (int i = 0; i < 4; ++i)
+                    r[i] = static_cast<float>((*value)[i].number());
+            if (const JsonValue *value = node.find("scale"); value && value->size() == 3)
+                for (int i = 0; i < 3; ++i)
+                    s[i] = static_cast<float>((*value)[i].number());
+            return Quaternion::getModelMatrix(Vector(t[0], t[1], t[2]), Quaternion(r), Vector(s[0], s[1], s[2]));
+        }
+
+        inline void growBounds(Bounds &bounds, bool &empty, const Matrix &transform, const Bounds &local)
+        {
+            for (int corner = 0; corner < 8; ++corner)
+            {
+                const float p[3] = {corner & 1 ? local.max[0] : local.min[0], corner & 2 ? local.max[1] : local.min[1],
+                                    corner & 4 ? local.max[2] : local.min[2]};
+                for (int row = 0; row < 3; ++row)
+                {
+                    float value = transform[row] * p[0] + transform[4 + row] * p[1] + transform[8 + row] * p[2] + transform[12 + row];
+                    bounds.min[row] = empty ? value : std::min(bounds.min[row], value);
+                    bounds.max[row] = empty ? value : std::max(bounds.max[row], value);
+                }
+                empty = false;
+            }
+        }
+    }
+
+    // Loads a binary glTF 2.0 file without touching GL, so it can run on any
+    // thread. The file stays mapped in the returned ModelData until it is
+    // destroyed; uploadModel() hands its buffer views to GL directly. Every
+    // offset and index is validated against the file, and the node hierarchy
+    // of the default scene is flattened into instances. Not supported, and
+    // reported as std::runtime_error: external or data-URI buffers, sparse
+    // accessors and accessors without a buffer view.
+    inline ModelData loadModelDataGLB(const std::string &filename)
+    {
+        grn::Logger::debug("Loading glTF file: " + filename);
+
+        ModelData data;
+        if (!data.file.open(filename))
+        {
+            grn::Logger::error("Failed to open glTF file: " + filename);
+            throw std::runtime_error("Failed to open glTF file: " + filename);
+        }
+
+        // Header and chunks; all fields are little endian
+        const char *file = data.file.data();
+        const uint64_t fileSize = data.file.size();
+        if (fileSize < 20 || detail::readUint32(file) != 0x46546C67 /* "glTF" */)
+            detail::throwGltfError(filename, "not a binary glTF file");
+        if (detail::readUint32(file + 4) != 2)
+            detail::throwGltfError(filename, "unsupported container version");
+        const uint64_t length = std::min<uint64_t>(detail::readUint32(file + 8), fileSize);
+
+        const char *json = nullptr;
+        uint64_t jsonSize = 0;
+        for (uint64_t offset = 12; offset + 8 <= length;)
+        {
+            const uint64_t chunkSize = detail::readUint32(file + offset);
+            const uint32_t chunkType = detail::readUint32(file + offset + 4);
+            if (chunkSize > length - offset - 8)
+                detail::throwGltfError(filename, "truncated chunk");
+            if (chunkType == 0x4E4F534A && !json) // "JSON"
+            {
+                json = file + offset + 8;
+                jsonSize = chunkSize;
+            }
+            else if (chunkType == 0x004E4942 && !data.binary) // "BIN\0"
+            {
+                data.binary = file + offset + 8;
+                data.binarySize = chunkSize;
+            }
+            offset += 8 + ((chunkSize + 3) & ~uint64_t(3));
+        }
+        if (!json)
+            detail::throwGltfError(filename, "missing JSON chunk");
+
+        const JsonValue document = JsonValue::parse(json, json + jsonSize);
+        const JsonValue empty;
+        auto array = [&](const JsonValue &object, const char *key) -> const JsonValue &
+        {
+            const JsonValue *value = object.find(key);
+            return value && value->isArray() ? *value : empty;
+        };
+
+        const JsonValue *asset = document.find("asset");
+        const JsonValue *version = asset ? asset->find("version") : nullptr;
+        if (!version || version->string().compare(0, 2, "2.") != 0)
+            detail::throwGltfError(filename, "not a glTF 2.0 asset");
+
+        // Only the GLB-stored buffer 0 is supported
+        const JsonValue &buffers = array(document, "buffers");
+        for (size_t i = 0; i < buffers.size(); ++i)
+        {
+            if (i > 0 || buffers[i].find("uri"))
+                detail::throwGltfError(filename, "external buffers are not supported");
+            if (buffers[i].index("byteLength", 0) > data.binarySize)
+                detail::throwGltfError(filename, "buffer larger than the BIN chunk");
+        }
+
+        const JsonValue &views = array(document, "bufferViews");
+        std::vector<uint32_t> viewStrides;
+        for (const JsonValue &view : views.elements())
+        {
+            if (view.index("buffer", 0) != 0)
+                detail::throwGltfError(filename, "buffer view of an unsupported buffer");
+            ModelBufferView bufferView = {view.index("byteOffset", 0), view.index("byteLength", 0)};
+            if (bufferView.byteOffset > data.binarySize || bufferView.byteLength > data.binarySize - bufferView.byteOffset)
+                detail::throwGltfError(filename, "buffer view outside the BIN chunk");
+            data.bufferViews.push_back(bufferView);
+            viewStrides.push_back(static_cast<uint32_t>(std::min<uint64_t>(view.index("byteStride", 0), 256)));
+        }
+
+        const JsonValue &accessors = array(document, "accessors");
+        struct AccessorLayout
+        {
+            uint32_t bufferView;
+            uint64_t byteOffset;
+            uint32_t byteStride;
+            uint32_t count;
+            uint32_t componentCount;
+            uint32_t componentType;
+            bool normalized;
+        };
+        auto accessor = [&](const JsonValue &index, const char *what) -> AccessorLayout
+        {
+            const JsonValue &value = accessors[detail::gltfElementIndex(filename, index, accessors.size(), std::string(what) + " accessor")];
+            if (value.find("sparse"))
+                detail::throwGltfError(filename, "sparse accessors are not supported");
+            if (!value.find("bufferView"))
+                detail::throwGltfError(filename, "accessors without a buffer view are not supported");
+
+            // Range-checked at full width before narrowing
+            const uint64_t bufferView = value.index("bufferView", 0);
+            const uint64_t componentType = value.index("componentType", 0);
+            const uint32_t componentSize = detail::gltfComponentSize(componentType);
+            const JsonValue *type = value.find("type");
+            const uint32_t componentCount = detail::gltfComponentCount(type ? type->string() : std::string());
+            if (bufferView >= data.bufferViews.size() || componentSize == 0 || componentCount == 0)
+                detail::throwGltfError(filename, std::string(what) + " accessor has an unsupported layout");
+
+            AccessorLayout layout;
+            layout.bufferView = static_cast<uint32_t>(bufferView);
+            layout.byteOffset = value.index("byteOffset", 0);
+            layout.count = static_cast<uint32_t>(std::min<uint64_t>(value.index("count", 0), UINT32_MAX));
+            layout.componentType = static_cast<uint32_t>(componentType);
+            layout.componentCount = componentCount;
+            const JsonValue *normalized = value.find("normalized");
+            layout.normalized = normalized && normalized->boolean();
+            const uint32_t elementSize = componentSize * layout.componentCount;
+            layout.byteStride = viewStrides[layout.bufferView] ? viewStrides[layout.bufferView] : elementSize;
+
+            const uint64_t viewLength = data.bufferViews[layout.bufferView].byteLength;
+            const uint64_t span = layout.count == 0 ? 0 : uint64_t(layout.byteStride) * (layout.count - 1) + elementSize;
+            if (layout.byteOffset % componentSize != 0 || layout.byteOffset > viewLength || span > viewLength - layout.byteOffset)
+                detail::throwGltfError(filename, std::string(what) + " accessor outside its buffer view");
+            return layout;
+        };
+
+        const JsonValue &materials = array(document, "materials");
+        const JsonValue &meshes = array(document, "meshes");
+        for (const JsonValue &meshValue : meshes.elements())
+        {
+            ModelMesh mesh;
+            if (const JsonValue *name = meshValue.find("name"))
+                mesh.name = name->string();
+
+            for (const JsonValue &primitiveValue : array(meshValue, "primitives").elements())
+            {
+                ModelPrimitive primitive = {};
+                const uint64_t mode = primitiveValue.index("mode", 4);
+                const uint64_t material = primitiveValue.index("material", NoMaterial);
+                if (mode > 6 || (material != NoMaterial && material >= materials.size()))
+                    detail::throwGltfError(filename, "invalid primitive mode or material");
+                primitive.mode = static_cast<uint32_t>(mode);
+                primitive.material = static_cast<uint32_t>(material);
+
+                const JsonValue *attributes = primitiveValue.find("attributes");
+                const JsonValue *position = attributes ? attributes->find("POSITION") : nullptr;
+                if (!position)
+                {
+                    grn::Logger::warning("Skipping glTF primitive without positions in " + filename);
+                    continue;
+                }
+
+                static const std::pair<const char *, ModelAttribute> semantics[] = {
+                    {"POSITION", ModelAttribute::Position}, {"NORMAL", ModelAttribute::Normal}, {"TEXCOORD_0", ModelAttribute::TexCoord},
+                    {"TANGENT", ModelAttribute::Tangent}, {"COLOR_0", ModelAttribute::Color}, {"JOINTS_0", ModelAttribute::Joints},
+                    {"WEIGHTS_0", ModelAttribute::Weights}};
+                for (const auto &semantic : semantics)
+                {
+                    const JsonValue *index = attributes->find(semantic.first);
+                    if (!index)
+                        continue;
+                    AccessorLayout layout = accessor(*index, semantic.first);
+                    if (semantic.second == ModelAttribute::Position)
+                        primitive.vertexCount = layout.count;
+                    else if (layout.count < primitive.vertexCount)
+                        detail::throwGltfError(filename, std::string(semantic.first) + " has fewer elements than POSITION");
+
+                    ModelVertexAttribute attribute;
+                    attribute.location = static_cast<uint32_t>(semantic.second);
+                    attribute.bufferView = layout.bufferView;
+                    attribute.byteOffset = layout.byteOffset;
+                    attribute.byteStride = layout.byteStride;
+                    attribute.componentCount = layout.componentCount;
+                    attribute.componentType = layout.componentType;
+                    attribute.normalized = layout.normalized;
+                    attribute.integer = semantic.second == ModelAttribute::Joints;
+                    primitive.attributes.push_back(attribute);
+                }
+
+                // POSITION min and max are required by the specification
+                const JsonValue &positionAccessor = accessors[static_cast<size_t>(position->number())];
+                const JsonValue &min = array(positionAccessor, "min"), &max = array(positionAccessor, "max");
+                for (int k = 0; k < 3; ++k)
+                {
+                    primitive.bounds.min[k] = min.size() == 3 ? static_cast<float>(min[k].number()) : 0.0f;
+                    primitive.bounds.max[k] = max.size() == 3 ? static_cast<float>(max[k].number()) : 0.0f;
+                }
+
+                if (const JsonValue *indices = primitiveValue.find("indices"))
+                {
+                    AccessorLayout layout = accessor(*indices, "index");
+                    const uint32_t indexSize = detail::gltfComponentSize(layout.componentType);
+                    if (layout.componentCount != 1 || layout.byteStride != indexSize || layout.normalized ||
+                        (layout.componentType != 5121 && layout.componentType != 5123 && layout.componentType != 5125))
+                        detail::throwGltfError(filename, "indices must be tightly packed unsigned scalars");
+
+                    // A bad index would read outside the vertex buffers on the GPU
+                    const char *first = data.binary + data.bufferViews[layout.bufferView].byteOffset + layout.byteOffset;
+                    uint32_t maxIndex = 0;
+                    for (uint32_t i = 0; i < layout.count; ++i)
+                    {
+                        uint32_t value = 0;
+                        std::memcpy(&value, first + uint64_t(i) * indexSize, indexSize);
+                        maxIndex = std::max(maxIndex, value);
+                    }
+                    if (layout.count > 0 && maxIndex >= primitive.vertexCount)
+                        detail::throwGltfError(filename, "index out of range");
+
+                    primitive.indexed = true;
+                    primitive.indexBufferView = layout.bufferView;
+                    primitive.indexByteOffset = layout.byteOffset;
+                    primitive.indexType = layout.componentType;
+                    primitive.indexCount = layout.count;
+                }
+                mesh.primitives.push_back(std::move(primitive));
+            }
+            data.meshes.push_back(std::move(mesh));
+        }
+
+        // Materials: base color and emission factors, plus external texture files
+        const std::string directory = std::filesystem::path(filename).parent_path().string();
+        const JsonValue &textures = array(document, "textures");
+        const JsonValue &images = array(document, "images");
+        auto texturePath = [&](const JsonValue *textureInfo) -> std::string
+        {
+            if (!textureInfo)
+                return std::string();
+            const uint64_t texture = textureInfo->index("index", ~uint64_t(0));
+            if (texture >= textures.size())
+                return std::string();
+            const uint64_t image = textures[texture].index("source", ~uint64_t(0));
+            if (image >= images.size())
+                return std::string();
+            const JsonValue *uri = images[image].find("uri");
+            if (!uri || uri->string().compare(0, 5, "data:") == 0)
+                return std::string(); // embedded images are not decoded here
+            return (std::filesystem::path(directory) / uri->string()).string();
+        };
+        for (const JsonValue &materialValue : materials.elements())
+        {
+            Material material;
+            if (const JsonValue *name = materialValue.find("name"))
+                material.name = name->string();
+            if (const JsonValue *pbr = materialValue.find("pbrMetallicRoughness"))
+            {
+                const JsonValue &factor = array(*pbr, "baseColorFactor");
+                material.diffuse[0] = material.diffuse[1] = material.diffuse[2] = 1.0f;
+                if (factor.size() == 4)
+                {
+                    for (int k = 0; k < 3; ++k)
+                        material.diffuse[k] = static_cast<float>(factor[k].number());
+                    material.opacity = static_cast<float>(factor[3].number());
+                }
+                material.diffuseMap = texturePath(pbr->find("baseColorTexture"));
+            }
+            const JsonValue &emissive = array(materialValue, "emissiveFactor");
+            if (emissive.size() == 3)
+            {
+                for (int k = 0; k < 3; ++k)
+                    material.emissive[k] = static_cast<float>(emissive[k].number());
+            }
+            material.normalMap = texturePath(materialValue.find("normalTexture"));
+            data.materials.push_back(std::move(material));
+        }
+
+        // Nodes must form trees; a node reached twice would be drawn twice or loop forever
+        const JsonValue &nodes = array(document, "nodes");
+        for (const JsonValue &nodeValue : nodes.elements())
+        {
+            ModelNode node;
+            if (const JsonValue *name = nodeValue.find("name"))
+                node.name = name->string();
+            node.transform = detail::gltfNodeTransform(nodeValue);
+            const uint64_t mesh = nodeValue.index("mesh", ~0u);
+            if (mesh != ~0u && mesh >= data.meshes.size())
+                detail::throwGltfError(filename, "node mesh out of range");
+            node.mesh = static_cast<uint32_t>(mesh);
+            for (const JsonValue &child : array(nodeValue, "children").elements())
+                node.children.push_back(detail::gltfElementIndex(filename, child, nodes.size(), "node child"));
+            data.nodes.push_back(std::move(node));
+        }
+
+        const JsonValue &scenes = array(document, "scenes");
+        const uint64_t scene = document.index("scene", 0);
+        if (scene < scenes.size())
+        {
+            for (const JsonValue &root : array(scenes[scene], "nodes").elements())
+                data.roots.push_back(detail::gltfElementIndex(filename, root, nodes.size(), "scene node"));
+        }
+        else
+        {
+            // No scene: draw every node that is nobody's child
+            std::vector<unsigned char> isChild(data.nodes.size(), 0);
+            for (const ModelNode &node : data.nodes)
+                for (uint32_t child : node.children)
+                    isChild[child] = 1;
+            for (uint32_t i = 0; i < data.nodes.size(); ++i)
+                if (!isChild[i])
+                    data.roots.push_back(i);
+        }
+
+        std::vector<unsigned char> visited(data.nodes.size(), 0);
+        std::vector<std::pair<uint32_t, Matrix>> stack;
+        for (uint32_t root : data.roots)
+            stack.emplace_back(root, Matrix());
+        bool emptyBounds = true;
+        while (!stack.empty())
+        {
+            auto [index, parent] = stack.back();
+            stack.pop_back();
+            if (visited[index])
+                detail::throwGltfError(filename, "node hierarchy is not a tree");
+            visited[index] = 1;
+
+            const ModelNode &node = data.nodes[index];
+            const Matrix transform = parent * node.transform;
+            if (node.mesh != ~0u)
+            {
+                data.instances.push_back({transform, node.mesh});
+                for (const ModelPrimitive &primitive : data.meshes[node.mesh].primitives)
+                    detail::growBounds(data.bounds, emptyBounds, transform, primitive.bounds);
+            }
+            for (uint32_t child : node.children)
+                stack.emplace_back(child, transform);
+        }
+
+        grn::Logger::debug("Loaded glTF file " + filename + ": " + std::to_string(data.meshes.size()) + " meshes, " +
+                           std::to_string(data.instances.size()) + " instances, " + std::to_string(data.bufferViews.size()) + " buffer views");
+        return data;
+    }
+}
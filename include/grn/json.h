@@ -0,0 +1,318 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace grn
+{
+    // Minimal JSON document model, enough for glTF. Numbers are doubles, object
+    // members keep their file order and are looked up linearly (glTF objects
+    // are small).
+    class JsonValue
+    {
+    public:
+        enum Type
+        {
+            Null,
+            Bool,
+            Number,
+            String,
+            Array,
+            Object
+        };
+
+        Type type() const { return m_type; }
+        bool isNumber() const { return m_type == Number; }
+        bool isString() const { return m_type == String; }
+        bool isArray() const { return m_type == Array; }
+        bool isObject() const { return m_type == Object; }
+
+        double number(double fallback = 0.0) const { return m_type == Number ? m_number : fallback; }
+        bool boolean(bool fallback = false) const { return m_type == Bool ? m_bool : fallback; }
+        const std::string &string() const { return m_string; }
+
+        // Array elements; empty for other types
+        size_t size() const { return m_elements.size(); }
+        const JsonValue &operator[](size_t index) const { return m_elements[index]; }
+        const std::vector<JsonValue> &elements() const { return m_elements; }
+
+        // Object member, nullptr if absent or not an object
+        const JsonValue *find(const std::string &key) const
+        {
+            for (const auto &member : m_members)
+            {
+                if (member.first == key)
+                    return &member.second;
+            }
+            return nullptr;
+        }
+
+        // Number member as an unsigned integer, `fallback` if absent. Throws if
+        // present but not a non-negative integer.
+        uint64_t index(const std::string &key, uint64_t fallback) const
+        {
+            const JsonValue *value = find(key);
+            if (!value)
+                return fallback;
+            const double number = value->number(-1.0);
+            if (!(number >= 0.0 && number <= 9007199254740992.0) || number != static_cast<double>(static_cast<uint64_t>(number)))
+                throw std::runtime_error("JSON member '" + key + "' is not a valid index");
+            return static_cast<uint64_t>(number);
+        }
+
+        // Parses a complete document. Throws std::runtime_error on malformed input.
+        static JsonValue parse(const char *begin, const char *end)
+        {
+            Parser parser{begin, end};
+            JsonValue value = parser.value(0);
+            parser.skipWhitespace();
+            if (parser.p != end)
+                parser.fail("trailing characters");
+            return value;
+        }
+
+    private:
+        Type m_type = Null;
+        bool m_bool = false;
+        double m_number = 0.0;
+        std::string m_string;
+        std::vector<JsonValue> m_elements;
+        std::vector<std::pair<std::string, JsonValue>> m_members;
+
+        struct Parser
+        {
+            const char *p;
+            const char *end;
+
+            // Deeper documents are rejected instead of overflowing the stack
+            static constexpr int maxDepth = 128;
+
+            [[noreturn]] void fail(const char *what)
+            {
+                throw std::runtime_error(std::string("JSON parse error: ") + what);
+            }
+
+            void skipWhitespace()
+            {
+                while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+                    ++p;
+            }
+
+            void expect(const char *literal)
+            {
+                for (; *literal; ++literal, ++p)
+                {
+                    if (p == end || *p != *literal)
+                        fail("unexpected literal");
+                }
+            }
+
+            unsigned int hex4()
+            {
+                if (end - p < 4)
+                    fail("truncated \\u escape");
+                unsigned int code = 0;
+                for (int i = 0; i < 4; ++i, ++p)
+                {
+                    char c = *p;
+                    code <<= 4;
+                    if (c >= '0' && c <= '9')
+                        code |= c - '0';
+                    else if (c >= 'a' && c <= 'f')
+                        code |= c - 'a' + 10;
+                    else if (c >= 'A' && c <= 'F')
+                        code |= c - 'A' + 10;
+                    else
+                        fail("bad \\u escape");
+                }
+                return code;
+            }
+
+            static void appendUtf8(std::string &out, unsigned int code)
+            {
+                if (code < 0x80)
+                {
+                    out += static_cast<char>(code);
+                }
+                else if (code < 0x800)
+                {
+                    out += static_cast<char>(0xC0 | (code >> 6));
+                    out += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                else if (code < 0x10000)
+                {
+                    out += static_cast<char>(0xE0 | (code >> 12));
+                    out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                    out += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                else
+                {
+                    out += static_cast<char>(0xF0 | (code >> 18));
+                    out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+                    out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                    out += static_cast<char>(0x80 | (code & 0x3F));
+                }
+            }
+
+            std::string string()
+            {
+                ++p; // opening quote
+                std::string out;
+                while (true)
+                {
+                    if (p == end)
+                        fail("unterminated string");
+                    char c = *p++;
+                    if (c == '"')
+                        return out;
+                    if (static_cast<unsigned char>(c) < 0x20)
+                        fail("control character in string");
+                    if (c != '\\')
+                    {
+                        out += c;
+                        continue;
+                    }
+                    if (p == end)
+                        fail("unterminated escape");
+                    switch (*p++)
+                    {
+                    case '"': out += '"'; break;
+                    case '\\': out += '\\'; break;
+                    case '/': out += '/'; break;
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'n': out += '\n'; break;
+                    case 'r': out += '\r'; break;
+                    case 't': out += '\t'; break;
+                    case 'u':
+                    {
+                        unsigned int code = hex4();
+                        // Surrogate pair for code points beyond the BMP
+                        if (code >= 0xD800 && code < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u')
+                        {
+                            p += 2;
+                            unsigned int low = hex4();
+                            if (low < 0xDC00 || low >= 0xE000)
+                                fail("bad surrogate pair");
+                            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        }
+                        appendUtf8(out, code);
+                        break;
+                    }
+                    default:
+                        fail("bad escape");
+                    }
+                }
+            }
+
+            double number()
+            {
+                // from_chars does not take a leading '+', neither does JSON; it is also locale independent.
+                // It does take "nan" and "inf", which JSON does not.
+                double value = 0.0;
+                auto result = std::from_chars(p, end, value);
+                if (result.ec != std::errc() || !std::isfinite(value))
+                    fail("malformed number");
+                p = result.ptr;
+                return value;
+            }
+
+            JsonValue value(int depth)
+            {
+                if (depth > maxDepth)
+                    fail("nesting too deep");
+                skipWhitespace();
+                if (p == end)
+                    fail("unexpected end of input");
+
+                JsonValue result;
+                switch (*p)
+                {
+                case '{':
+                    result.m_type = Object;
+                    ++p;
+                    skipWhitespace();
+                    if (p < end && *p == '}')
+                    {
+                        ++p;
+                        return result;
+                    }
+                    while (true)
+                    {
+                        skipWhitespace();
+                        if (p == end || *p != '"')
+                            fail("expected member name");
+                        std::string key = string();
+                        skipWhitespace();
+                        if (p == end || *p != ':')
+                            fail("expected ':'");
+                        ++p;
+                        result.m_members.emplace_back(std::move(key), value(depth + 1));
+                        skipWhitespace();
+                        if (p < end && *p == ',')
+                        {
+                            ++p;
+                            continue;
+                        }
+                        if (p < end && *p == '}')
+                        {
+                            ++p;
+                            return result;
+                        }
+                        fail("expected ',' or '}'");
+                    }
+                case '[':
+                    result.m_type = Array;
+                    ++p;
+                    skipWhitespace();
+                    if (p < end && *p == ']')
+                    {
+                        ++p;
+                        return result;
+                    }
+                    while (true)
+                    {
+                        result.m_elements.push_back(value(depth + 1));
+                        skipWhitespace();
+                        if (p < end && *p == ',')
+                        {
+                            ++p;
+                            continue;
+                        }
+                        if (p < end && *p == ']')
+                        {
+                            ++p;
+                            return result;
+                        }
+                        fail("expected ',' or ']'");
+                    }
+                case '"':
+                    result.m_type = String;
+                    result.m_string = string();
+                    return result;
+                case 't':
+                    expect("true");
+                    result.m_type = Bool;
+                    result.m_bool = true;
+                    return result;
+                case 'f':
+                    expect("false");
+                    result.m_type = Bool;
+                    return result;
+                case 'n':
+                    expect("null");
+                    return result;
+                default:
+                    result.m_type = Number;
+                    result.m_number = number();
+                    return result;
+                }
+            }
+        };
+    };
+}
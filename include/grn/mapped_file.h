@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace grn
+{
+    // Read-only memory mapping of a whole file. The OS pages the file in on
+    // demand, so parsers can tokenize it in place without copying it into a
+    // std::string first. Empty files open successfully with size() == 0.
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+
+        ~MappedFile()
+        {
+            close();
+        }
+
+        // Non-copyable, movable
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        MappedFile(MappedFile &&other) noexcept
+            : m_data(std::exchange(other.m_data, nullptr)), m_size(std::exchange(other.m_size, 0))
+        {
+        }
+
+        MappedFile &operator=(MappedFile &&other) noexcept
+        {
+            if (this != &other)
+            {
+                close();
+                m_data = std::exchange(other.m_data, nullptr);
+                m_size = std::exchange(other.m_size, 0);
+            }
+            return *this;
+        }
+
+        bool open(const std::string &path)
+        {
+            close();
+#ifdef _WIN32
+            HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+                return false;
+
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(file, &size))
+            {
+                CloseHandle(file);
+                return false;
+            }
+            if (size.QuadPart == 0)
+            {
+                CloseHandle(file);
+                return true;
+            }
+
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            CloseHandle(file);
+            if (!mapping)
+                return false;
+
+            // The view keeps the mapping alive, so both handles can be closed right away
+            void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+            if (!view)
+                return false;
+
+            m_data = static_cast<const char *>(view);
+            m_size = static_cast<size_t>(size.QuadPart);
+#else
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+
+            struct stat info;
+            if (fstat(fd, &info) != 0)
+            {
+                ::close(fd);
+                return false;
+            }
+            if (info.st_size == 0)
+            {
+                ::close(fd);
+                return true;
+            }
+
+            void *view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (view == MAP_FAILED)
+                return false;
+
+            madvise(view, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+
+            m_data = static_cast<const char *>(view);
+            m_size = static_cast<size_t>(info.st_size);
+#endif
+            return true;
+        }
+
+        void close()
+        {
+            if (!m_data)
+                return;
+#ifdef _WIN32
+            UnmapViewOfFile(m_data);
+#else
+            munmap(const_cast<char *>(m_data), m_size);
+#endif
+            m_data = nullptr;
+            m_size = 0;
+        }
+
+        const char *data() const { return m_data; }
+        size_t size() const { return m_size; }
+
+        const char *begin() const { return m_data; }
+        const char *end() const { return m_data + m_size; }
+
+    private:
+        const char *m_data = nullptr;
+        size_t m_size = 0;
+    };
+
+    // Name for a temporary file that is renamed over `path` once complete.
+    // Unique per process and thread, so concurrent writers of the same file,
+    // in this process or another, never write into each other's copy.
+    inline std::string temporaryPathFor(const std::string &path)
+    {
+#ifdef _WIN32
+        const unsigned long processId = GetCurrentProcessId();
+#else
+        const unsigned long processId = static_cast<unsigned long>(getpid());
+#endif
+        return path + "." + std::to_string(processId) + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    }
+}
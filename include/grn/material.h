@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "logger.h"
+#include "mapped_file.h"
+#include "obj_parser.h"
+
+namespace grn
+{
+    // A Wavefront MTL material. Texture paths are resolved against the
+    // directory of the library that defined them; empty means no map.
+    struct Material
+    {
+        std::string name;
+        float ambient[3] = {0.0f, 0.0f, 0.0f};  // Ka
+        float diffuse[3] = {0.8f, 0.8f, 0.8f};  // Kd
+        float specular[3] = {0.0f, 0.0f, 0.0f}; // Ks
+        float emissive[3] = {0.0f, 0.0f, 0.0f}; // Ke
+        float shininess = 0.0f;                 // Ns
+        float opacity = 1.0f;                   // d, or 1 - Tr
+        std::string diffuseMap;                 // map_Kd
+        std::string specularMap;                // map_Ks
+        std::string normalMap;                  // norm, map_Bump or bump
+        std::string opacityMap;                 // map_d
+    };
+
+    // Parses MTL text in [begin, end) and appends its materials to `out`.
+    // Statements outside a newmtl block and unknown statements are skipped;
+    // malformed values are logged and ignored, so a broken library never keeps
+    // its mesh from loading.
+    inline void parseMTL(const char *begin, const char *end, const std::string &directory, std::vector<Material> &out)
+    {
+        Material *material = nullptr;
+
+        const char *p = begin;
+        while (p < end)
+        {
+            const char *lineEnd = static_cast<const char *>(std::memchr(p, '\n', end - p));
+            if (!lineEnd)
+                lineEnd = end;
+
+            const char *lineBegin = p;
+            p = detail::skipBlanks(p, lineEnd);
+            const char *keywordEnd = p;
+            while (keywordEnd < lineEnd && !detail::isBlank(*keywordEnd))
+                ++keywordEnd;
+            const std::string_view keyword(p, keywordEnd - p);
+
+            // "r [g b]", missing components repeat r
+            auto color = [&](float *rgb)
+            {
+                float values[3];
+                int count = 0;
+                for (const char *q = keywordEnd; count < 3; ++count)
+                {
+                    q = detail::parseFloat(detail::skipBlanks(q, lineEnd), lineEnd, values[count]);
+                    if (!q)
+                        break;
+                }
+                if (count == 0)
+                {
+                    Logger::warning("Malformed MTL color: " + std::string(lineBegin, lineEnd));
+                    return;
+                }
+                for (int k = 0; k < 3; ++k)
+                    rgb[k] = k < count ? values[k] : values[0];
+            };
+            auto scalar = [&](float &value)
+            {
+                if (!detail::parseFloats(keywordEnd, lineEnd, &value, 1, 1))
+                    Logger::warning("Malformed MTL value: " + std::string(lineBegin, lineEnd));
+            };
+            // Map statements may carry options ("-bm 0.5 normal.png"); the file is the last token
+            auto map = [&](std::string &path)
+            {
+                const char *nameEnd = lineEnd;
+                while (nameEnd > keywordEnd && detail::isBlank(nameEnd[-1]))
+                    --nameEnd;
+                const char *name = nameEnd;
+                while (name > keywordEnd && !detail::isBlank(name[-1]))
+                    --name;
+                if (name == nameEnd)
+                    Logger::warning("MTL map without a file: " + std::string(lineBegin, lineEnd));
+                else
+                    path = (std::filesystem::path(directory) / std::string(name, nameEnd)).string();
+            };
+
+            if (keyword == "newmtl")
+            {
+                out.emplace_back();
+                material = &out.back();
+                material->name = detail::parseName(keywordEnd, lineEnd);
+            }
+            else if (material)
+            {
+                if (keyword == "Ka")
+                    color(material->ambient);
+                else if (keyword == "Kd")
+                    color(material->diffuse);
+                else if (keyword == "Ks")
+                    color(material->specular);
+                else if (keyword == "Ke")
+                    color(material->emissive);
+                else if (keyword == "Ns")
+                    scalar(material->shininess);
+                else if (keyword == "d")
+                    scalar(material->opacity);
+                else if (keyword == "Tr")
+                {
+                    float transparency = 1.0f - material->opacity;
+                    scalar(transparency);
+                    material->opacity = 1.0f - transparency;
+                }
+                else if (keyword == "map_Kd")
+                    map(material->diffuseMap);
+                else if (keyword == "map_Ks")
+                    map(material->specularMap);
+                else if (keyword == "norm" || keyword == "map_Bump" || keyword == "map_bump" || keyword == "bump")
+                    map(material->normalMap);
+                else if (keyword == "map_d")
+                    map(material->opacityMap);
+            }
+
+            p = lineEnd < end ? lineEnd + 1 : end;
+        }
+    }
+
+    // Appends the materials of an MTL file to `out`. Returns false if the file
+    // cannot be opened.
+    inline bool loadMaterialLibrary(const std::string &path, std::vector<Material> &out)
+    {
+        MappedFile file;
+        if (!file.open(path))
+            return false;
+        parseMTL(file.begin(), file.end(), std::filesystem::path(path).parent_path().string(), out);
+        return true;
+    }
+
+    // Builds the material table of a mesh: material i is names[i] as defined by
+    // the first of `libraries` (relative to `directory`) that has it. Missing
+    // libraries and names are logged, and such materials keep default values.
+    inline std::vector<Material> resolveMaterials(const std::string &directory, const std::vector<std::string> &libraries, const std::vector<std::string> &names)
+    {
+        std::vector<Material> defined;
+        for (const std::string &library : libraries)
+        {
+            const std::string path = (std::filesystem::path(directory) / library).string();
+            if (!loadMaterialLibrary(path, defined))
+                Logger::warning("Could not open material library: " + path);
+        }
+
+        std::vector<Material> materials(names.size());
+        for (size_t i = 0; i < names.size(); ++i)
+        {
+            auto found = std::find_if(defined.begin(), defined.end(), [&](const Material &material)
+                                      { return material.name == names[i]; });
+            if (found != defined.end())
+            {
+                materials[i] = *found;
+                continue;
+            }
+            Logger::warning("Undefined material: " + names[i]);
+            materials[i].name = names[i];
+        }
+        return materials;
+    }
+}
@@ -1,24 +1,180 @@
 #pragma once
 
 #include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <grn/simd.h>
 #include <grn/vector.h>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
 
 namespace grn
 {
 
-    struct Matrix
+    namespace detail
     {
-        float m_data[16];
+        // True while the compiler evaluates a constant expression. Where that
+        // can't be told, everything takes the portable scalar path, which
+        // rounds exactly like the SIMD one.
+        constexpr bool constantEvaluated()
+        {
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 9
+            return __builtin_is_constant_evaluated();
+#elif defined(__clang__) && defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+            return __builtin_is_constant_evaluated();
+#else
+            return true;
+#endif
+#elif defined(_MSC_VER) && _MSC_VER >= 1925
+            return __builtin_is_constant_evaluated();
+#else
+            return true;
+#endif
+        }
+
+        // float4 kernels behind the runtime Mat4<float> operations; all of them
+        // take and return column-major arrays of 16 floats
 
-        Matrix()
+        inline void multiplyColumns(const float *a, const float *b, float *out)
         {
-            for (int i = 0; i < 16; ++i)
+            using namespace simd;
+            const float4 a0 = load(a), a1 = load(a + 4), a2 = load(a + 8), a3 = load(a + 12);
+            for (int column = 0; column < 4; ++column)
+            {
+                const float *c = b + column * 4;
+                store(out + column * 4, a0 * splat(c[0]) + a1 * splat(c[1]) + a2 * splat(c[2]) + a3 * splat(c[3]));
+            }
+        }
+
+        inline void transposeColumns(const float *m, float *out)
+        {
+            using namespace simd;
+            float4 c0 = load(m), c1 = load(m + 4), c2 = load(m + 8), c3 = load(m + 12);
+            transpose(c0, c1, c2, c3);
+            store(out, c0);
+            store(out + 4, c1);
+            store(out + 8, c2);
+            store(out + 12, c3);
+        }
+
+        // Returns false, leaving `out` untouched, if `m` is singular
+        inline bool inverseColumns(const float *m, float *out)
+        {
+            using namespace simd;
+            const float4 c0 = load(m), c1 = load(m + 4), c2 = load(m + 8), c3 = load(m + 12);
+
+            // 2x2 blocks stored row by row: {m00, m01, m10, m11}
+            auto multiply = [](float4 a, float4 b) // a * b
+            { return a * shuffle<0, 3, 0, 3>(b, b) + shuffle<1, 0, 3, 2>(a, a) * shuffle<2, 1, 2, 1>(b, b); };
+            auto adjugateMultiply = [](float4 a, float4 b) // adj(a) * b
+            { return shuffle<3, 3, 0, 0>(a, a) * b - shuffle<1, 1, 2, 2>(a, a) * shuffle<2, 3, 0, 1>(b, b); };
+            auto multiplyAdjugate = [](float4 a, float4 b) // a * adj(b)
+            { return a * shuffle<3, 0, 3, 0>(b, b) - shuffle<1, 0, 3, 2>(a, a) * shuffle<2, 1, 2, 1>(b, b); };
+
+            // The blocks of the transpose; inverting it yields the inverse's columns
+            const float4 A = shuffle<0, 1, 0, 1>(c0, c1), B = shuffle<2, 3, 2, 3>(c0, c1);
+            const float4 C = shuffle<0, 1, 0, 1>(c2, c3), D = shuffle<2, 3, 2, 3>(c2, c3);
+
+            // Determinants of A, B, C and D
+            const float4 blockDet = shuffle<0, 2, 0, 2>(c0, c2) * shuffle<1, 3, 1, 3>(c1, c3) -
+                                    shuffle<1, 3, 1, 3>(c0, c2) * shuffle<0, 2, 0, 2>(c1, c3);
+            const float4 detA = broadcast<0>(blockDet), detB = broadcast<1>(blockDet);
+            const float4 detC = broadcast<2>(blockDet), detD = broadcast<3>(blockDet);
+
+            const float4 DC = adjugateMultiply(D, C), AB = adjugateMultiply(A, B);
+            float4 X = detD * A - multiply(B, DC);
+            float4 W = detA * D - multiply(C, AB);
+            float4 Y = detB * C - multiplyAdjugate(D, AB);
+            float4 Z = detC * B - multiplyAdjugate(A, DC);
+
+            const float4 det = detA * detD + detB * detC - horizontalSum(AB * shuffle<0, 2, 1, 3>(DC, DC));
+            float lanes[4];
+            store(lanes, det);
+            if (lanes[0] == 0.0f)
+                return false;
+
+            const float sign[4] = {1.0f, -1.0f, -1.0f, 1.0f};
+            const float4 scale = load(sign) / det;
+            X = X * scale;
+            Y = Y * scale;
+            Z = Z * scale;
+            W = W * scale;
+
+            store(out, shuffle<3, 1, 3, 1>(X, Y));
+            store(out + 4, shuffle<2, 0, 2, 0>(X, Y));
+            store(out + 8, shuffle<3, 1, 3, 1>(Z, W));
+            store(out + 12, shuffle<2, 0, 2, 0>(Z, W));
+            return true;
+        }
+
+        // Returns false, leaving `out` untouched, if the 3x3 part of `m` is singular
+        inline bool affineInverseColumns(const float *m, float *out)
+        {
+            using namespace simd;
+            const float4 c0 = load(m), c1 = load(m + 4), c2 = load(m + 8);
+            auto cross = [](float4 a, float4 b)
+            { return shuffle<1, 2, 0, 3>(a, a) * shuffle<2, 0, 1, 3>(b, b) - shuffle<2, 0, 1, 3>(a, a) * shuffle<1, 2, 0, 3>(b, b); };
+
+            // Rows of the inverse 3x3 part, times the determinant
+            float4 r0 = cross(c1, c2), r1 = cross(c2, c0), r2 = cross(c0, c1), r3 = splat(0.0f);
+            const float4 det = horizontalSum(c0 * r0);
+            float lanes[4];
+            store(lanes, det);
+            if (lanes[0] == 0.0f)
+                return false;
+
+            const float4 scale = splat(1.0f) / det;
+            r0 = r0 * scale;
+            r1 = r1 * scale;
+            r2 = r2 * scale;
+            transpose(r0, r1, r2, r3);
+
+            store(out, r0);
+            store(out + 4, r1);
+            store(out + 8, r2);
+            store(out + 12, -(r0 * splat(m[12]) + r1 * splat(m[13]) + r2 * splat(m[14])));
+            out[15] = 1.0f;
+            return true;
+        }
+
+        // m * (x y z w); w == 0 leaves out the translation column
+        inline void transformColumns(const float *m, float x, float y, float z, bool point, float *out)
+        {
+            using namespace simd;
+            float4 result = load(m) * splat(x) + load(m + 4) * splat(y) + load(m + 8) * splat(z);
+            if (point)
+                result = result + load(m + 12);
+            store(out, result);
+        }
+    }
+
+    template <typename T>
+    struct Mat3;
+
+    // Column-major 4x4 matrix over a floating-point scalar type, aligned so
+    // columns load as whole SIMD registers. Everything but the factories that
+    // need trigonometry is constexpr. At run time, Mat4<float> goes through
+    // float4 kernels; the scalar code used otherwise (and in constant
+    // expressions) performs the same operations in the same order, so both
+    // give bit-identical results.
+    template <typename T>
+    struct alignas(4 * sizeof(T)) Mat4
+    {
+        T m_data[16];
+
+        // Identity
+        constexpr Mat4() : m_data{}
+        {
+            for (int i = 0; i < 16; i += 5)
             {
-                m_data[i] = (i % 5 == 0) ? 1.0f : 0.0f; // Identity matrix
+                m_data[i] = T(1);
             }
         }
 
-        Matrix(const float *data)
+        constexpr Mat4(const T *data) : m_data{}
         {
             for (int i = 0; i < 16; ++i)
             {
@@ -26,111 +182,510 @@ namespace grn
             }
         }
 
-        float &operator[](int index)
+        constexpr Mat4(const Vec4<T> &c0, const Vec4<T> &c1, const Vec4<T> &c2, const Vec4<T> &c3)
+            : m_data{c0.x, c0.y, c0.z, c0.w, c1.x, c1.y, c1.z, c1.w, c2.x, c2.y, c2.z, c2.w, c3.x, c3.y, c3.z, c3.w}
+        {
+        }
+
+        constexpr T &operator[](int index)
         {
             return m_data[index];
         }
 
-        const float &operator[](int index) const
+        constexpr const T &operator[](int index) const
         {
             return m_data[index];
         }
 
-        operator const float *() const
+        operator const T *() const
         {
             return &m_data[0];
         }
 
-        static Matrix getPerspectiveMatrix(float fov, float aspectRatio, float nearPlane, float farPlane)
+        const T *data() const
+        {
+            return &m_data[0];
+        }
+
+        // Column-major product; the result applies `other` first, then this.
+        // Each column is a weighted sum of this matrix's columns.
+        constexpr Mat4 operator*(const Mat4 &other) const
+        {
+            Mat4 result;
+            if constexpr (std::is_same<T, float>::value)
+            {
+                if (!detail::constantEvaluated())
+                {
+                    detail::multiplyColumns(m_data, other.m_data, result.m_data);
+                    return result;
+                }
+            }
+            for (int column = 0; column < 4; ++column)
+            {
+                const T *b = other.m_data + column * 4;
+                for (int row = 0; row < 4; ++row)
+                {
+                    result.m_data[column * 4 + row] = m_data[row] * b[0] + m_data[4 + row] * b[1] + m_data[8 + row] * b[2] + m_data[12 + row] * b[3];
+                }
+            }
+            return result;
+        }
+
+        constexpr Mat4 transpose() const
+        {
+            Mat4 result;
+            if constexpr (std::is_same<T, float>::value)
+            {
+                if (!detail::constantEvaluated())
+                {
+                    detail::transposeColumns(m_data, result.m_data);
+                    return result;
+                }
+            }
+            for (int column = 0; column < 4; ++column)
+            {
+                for (int row = 0; row < 4; ++row)
+                {
+                    result.m_data[column * 4 + row] = m_data[row * 4 + column];
+                }
+            }
+            return result;
+        }
+
+        // General inverse from the 2x2 blocks of the matrix (A B / C D), using
+        // adjugates in place of 2x2 inverses. A singular matrix yields identity.
+        constexpr Mat4 inverse() const
+        {
+            Mat4 result;
+            if constexpr (std::is_same<T, float>::value)
+            {
+                if (!detail::constantEvaluated())
+                {
+                    detail::inverseColumns(m_data, result.m_data);
+                    return result;
+                }
+            }
+
+            // Scalar form of inverseColumns(): blocks of the transpose, row by row
+            const T *m = m_data;
+            const T A[4] = {m[0], m[1], m[4], m[5]}, B[4] = {m[2], m[3], m[6], m[7]};
+            const T C[4] = {m[8], m[9], m[12], m[13]}, D[4] = {m[10], m[11], m[14], m[15]};
+            const T detA = m[0] * m[5] - m[1] * m[4], detB = m[2] * m[7] - m[3] * m[6];
+            const T detC = m[8] * m[13] - m[9] * m[12], detD = m[10] * m[15] - m[11] * m[14];
+
+            // adj(D) * C and adj(A) * B
+            const T DC[4] = {D[3] * C[0] - D[1] * C[2], D[3] * C[1] - D[1] * C[3], D[0] * C[2] - D[2] * C[0], D[0] * C[3] - D[2] * C[1]};
+            const T AB[4] = {A[3] * B[0] - A[1] * B[2], A[3] * B[1] - A[1] * B[3], A[0] * B[2] - A[2] * B[0], A[0] * B[3] - A[2] * B[1]};
+
+            // detD * A - B * DC, detA * D - C * AB, detB * C - D * adj(AB), detC * B - A * adj(DC)
+            T X[4] = {detD * A[0] - (B[0] * DC[0] + B[1] * DC[2]), detD * A[1] - (B[1] * DC[3] + B[0] * DC[1]),
+                      detD * A[2] - (B[2] * DC[0] + B[3] * DC[2]), detD * A[3] - (B[3] * DC[3] + B[2] * DC[1])};
+            T W[4] = {detA * D[0] - (C[0] * AB[0] + C[1] * AB[2]), detA * D[1] - (C[1] * AB[3] + C[0] * AB[1]),
+                      detA * D[2] - (C[2] * AB[0] + C[3] * AB[2]), detA * D[3] - (C[3] * AB[3] + C[2] * AB[1])};
+            T Y[4] = {detB * C[0] - (D[0] * AB[3] - D[1] * AB[2]), detB * C[1] - (D[1] * AB[0] - D[0] * AB[1]),
+                      detB * C[2] - (D[2] * AB[3] - D[3] * AB[2]), detB * C[3] - (D[3] * AB[0] - D[2] * AB[1])};
+            T Z[4] = {detC * B[0] - (A[0] * DC[3] - A[1] * DC[2]), detC * B[1] - (A[1] * DC[0] - A[0] * DC[1]),
+                      detC * B[2] - (A[2] * DC[3] - A[3] * DC[2]), detC * B[3] - (A[3] * DC[0] - A[2] * DC[1])};
+
+            const T det = detA * detD + detB * detC - ((AB[0] * DC[0] + AB[1] * DC[2]) + (AB[2] * DC[1] + AB[3] * DC[3]));
+            if (det == T(0))
+                return result;
+
+            const T scale[4] = {T(1) / det, T(-1) / det, T(-1) / det, T(1) / det};
+            for (int i = 0; i < 4; ++i)
+            {
+                X[i] *= scale[i];
+                Y[i] *= scale[i];
+                Z[i] *= scale[i];
+                W[i] *= scale[i];
+            }
+
+            const T columns[16] = {X[3], X[1], Y[3], Y[1], X[2], X[0], Y[2], Y[0],
+                                   Z[3], Z[1], W[3], W[1], Z[2], Z[0], W[2], W[0]};
+            return Mat4(columns);
+        }
+
+        // Inverse of a matrix whose last row is (0 0 0 1): rotation, scale,
+        // shear and translation. Cheaper than inverse(); a singular 3x3 part
+        // yields identity.
+        constexpr Mat4 affineInverse() const
+        {
+            Mat4 result;
+            if constexpr (std::is_same<T, float>::value)
+            {
+                if (!detail::constantEvaluated())
+                {
+                    detail::affineInverseColumns(m_data, result.m_data);
+                    return result;
+                }
+            }
+
+            // Rows of the inverse 3x3 part, times the determinant: the cross
+            // products of affineInverseColumns() on whole columns, lane by lane
+            // through its shuffles <1, 2, 0, 3> and <2, 0, 1, 3>. Their fourth
+            // lane is zero for finite matrices but carries infinities and NaNs
+            // of m[3], m[7] and m[11] into the determinant as the kernel does.
+            const T *m = m_data;
+            constexpr int left[4] = {1, 2, 0, 3}, right[4] = {2, 0, 1, 3};
+            T r[3][4] = {};
+            const T *crossed[3][2] = {{m + 4, m + 8}, {m + 8, m}, {m, m + 4}};
+            for (int row = 0; row < 3; ++row)
+            {
+                const T *a = crossed[row][0], *b = crossed[row][1];
+                for (int lane = 0; lane < 4; ++lane)
+                {
+                    r[row][lane] = a[left[lane]] * b[right[lane]] - a[right[lane]] * b[left[lane]];
+                }
+            }
+            const T det = (m[0] * r[0][0] + m[1] * r[0][1]) + (m[2] * r[0][2] + m[3] * r[0][3]);
+            if (det == T(0))
+                return result;
+
+            const T scale = T(1) / det;
+            for (int row = 0; row < 3; ++row)
+            {
+                result.m_data[row] = r[row][0] * scale;
+                result.m_data[4 + row] = r[row][1] * scale;
+                result.m_data[8 + row] = r[row][2] * scale;
+            }
+            result.m_data[3] = result.m_data[7] = result.m_data[11] = T(0);
+            for (int row = 0; row < 3; ++row)
+            {
+                result.m_data[12 + row] = -(result.m_data[row] * m[12] + result.m_data[4 + row] * m[13] + result.m_data[8 + row] * m[14]);
+            }
+            result.m_data[15] = T(1);
+            return result;
+        }
+
+        // (x y z 1) through the matrix, without the perspective divide
+        constexpr Vec3<T> transformPoint(const Vec3<T> &point) const
+        {
+            if constexpr (std::is_same<T, float>::value)
+            {
+                if (!detail::constantEvaluated())
+                {
+                    float out[4] = {};
+                    detail::transformColumns(m_data, point.x, point.y, point.z, true, out);
+                    return Vec3<T>(out[0], out[1], out[2]);
+                }
+            }
+            const T *m = m_data;
+            return Vec3<T>(m[0] * point.x + m[4] * point.y + m[8] * point.z + m[12],
+                           m[1] * point.x + m[5] * point.y + m[9] * point.z + m[13],
+                           m[2] * point.x + m[6] * point.y + m[10] * point.z + m[14]);
+        }
+
+        // (x y z 0) through the matrix: directions, no translation
+        constexpr Vec3<T> transformVector(const Vec3<T> &vector) const
         {
-            Matrix projection;
-            float tanHalfFov = tanf(fov / 2.0f);
+            if constexpr (std::is_same<T, float>::value)
+            {
+                if (!detail::constantEvaluated())
+                {
+                    float out[4] = {};
+                    detail::transformColumns(m_data, vector.x, vector.y, vector.z, false, out);
+                    return Vec3<T>(out[0], out[1], out[2]);
+                }
+            }
+            const T *m = m_data;
+            return Vec3<T>(m[0] * vector.x + m[4] * vector.y + m[8] * vector.z,
+                           m[1] * vector.x + m[5] * vector.y + m[9] * vector.z,
+                           m[2] * vector.x + m[6] * vector.y + m[10] * vector.z);
+        }
 
-            projection[0] = 1.0f / (aspectRatio * tanHalfFov);
-            projection[5] = 1.0f / tanHalfFov;
+        static Mat4 getPerspectiveMatrix(T fov, T aspectRatio, T nearPlane, T farPlane)
+        {
+            return getPerspectiveMatrixFromTangent(std::tan(fov / T(2)), aspectRatio, nearPlane, farPlane);
+        }
+
+        // getPerspectiveMatrix() from tan(fov / 2), so projections with a fixed
+        // field of view can be constant expressions
+        static constexpr Mat4 getPerspectiveMatrixFromTangent(T tanHalfFov, T aspectRatio, T nearPlane, T farPlane)
+        {
+            Mat4 projection;
+            projection[0] = T(1) / (aspectRatio * tanHalfFov);
+            projection[5] = T(1) / tanHalfFov;
             projection[10] = -(farPlane + nearPlane) / (farPlane - nearPlane);
-            projection[11] = -1.0f;
-            projection[14] = -(2.0f * farPlane * nearPlane) / (farPlane - nearPlane);
+            projection[11] = T(-1);
+            projection[14] = -(T(2) * farPlane * nearPlane) / (farPlane - nearPlane);
 
             return projection;
         }
 
-        static Matrix getViewMatrix(const Vector &position, const Vector &target, const Vector &up)
+        template <typename Math = StdMath>
+        static Mat4 getViewMatrix(const Vec3<T> &position, const Vec3<T> &target, const Vec3<T> &up)
         {
-            Matrix view;
-            Vector zAxis = (position - target).normalize();
-            Vector xAxis = up.cross(zAxis).normalize();
-            Vector yAxis = zAxis.cross(xAxis);
+            Vec3<T> zAxis = (position - target).template normalize<Math>();
+            Vec3<T> xAxis = up.cross(zAxis).template normalize<Math>();
+            Vec3<T> yAxis = zAxis.cross(xAxis);
 
-            float data[16];
+            T data[16];
 
             data[0] = xAxis.x;
             data[4] = yAxis.x;
             data[8] = zAxis.x;
-            data[12] = 0.0f;
+            data[12] = T(0);
             data[1] = xAxis.y;
             data[5] = yAxis.y;
             data[9] = zAxis.y;
-            data[13] = 0.0f;
+            data[13] = T(0);
             data[2] = xAxis.z;
             data[6] = yAxis.z;
             data[10] = zAxis.z;
-            data[14] = 0.0f;
+            data[14] = T(0);
             data[3] = -xAxis.dot(position);
             data[7] = -yAxis.dot(position);
             data[11] = -zAxis.dot(position);
-            data[15] = 1.0f;
+            data[15] = T(1);
 
-            view = Matrix(data);
-
-            return view;
+            return Mat4(data);
         }
 
-        static Matrix getModelMatrix(const Vector &position, const Vector &rotation, const Vector &scale)
+        // Euler angles in radians, applied about x, then y, then z. Passing
+        // FastMath replaces the six libm calls with polynomial sincos.
+        template <typename Math = StdMath>
+        static Mat4 getModelMatrix(const Vec3<T> &position, const Vec3<T> &rotation, const Vec3<T> &scale)
         {
-            Matrix model;
-            float cosX = cosf(rotation.x);
-            float sinX = sinf(rotation.x);
-            float cosY = cosf(rotation.y);
-            float sinY = sinf(rotation.y);
-            float cosZ = cosf(rotation.z);
-            float sinZ = sinf(rotation.z);
+            Mat4 model;
+            Vec3<T> sines, cosines;
+            Math::sincos(rotation, sines, cosines);
+            const T cosX = cosines.x, sinX = sines.x;
+            const T cosY = cosines.y, sinY = sines.y;
+            const T cosZ = cosines.z, sinZ = sines.z;
 
             model[0] = scale.x * (cosY * cosZ);
             model[1] = scale.x * (cosY * sinZ);
             model[2] = -scale.x * sinY;
-            model[3] = 0.0f;
+            model[3] = T(0);
 
             model[4] = scale.y * (sinX * sinY * cosZ - cosX * sinZ);
             model[5] = scale.y * (sinX * sinY * sinZ + cosX * cosZ);
             model[6] = scale.y * (sinX * cosY);
-            model[7] = 0.0f;
+            model[7] = T(0);
 
             model[8] = scale.z * (cosX * sinY * cosZ + sinX * sinZ);
             model[9] = scale.z * (cosX * sinY * sinZ - sinX * cosZ);
             model[10] = scale.z * (cosX * cosY);
-            model[11] = 0.0f;
+            model[11] = T(0);
 
             model[12] = position.x;
             model[13] = position.y;
             model[14] = position.z;
-            model[15] = 1.0f;
+            model[15] = T(1);
 
             return model;
         }
 
-        static Matrix getOrthographicMatrix(float left, float right, float bottom, float top, float nearPlane, float farPlane)
+        // Inverse transpose of the upper-left 3x3 part, which takes normals to
+        // world space under non-uniform scale. Its columns are the cross
+        // products of the model's columns over the determinant; once per
+        // object here instead of a 3x3 inverse per vertex in the shader. A
+        // singular 3x3 part yields identity.
+        static constexpr Mat3<T> getNormalMatrix(const Mat4 &model)
         {
-            Matrix ortho;
-            ortho[0] = 2.0f / (right - left);
-            ortho[5] = 2.0f / (top - bottom);
-            ortho[10] = -2.0f / (farPlane - nearPlane);
+            const T *m = model.m_data;
+            const Vec3<T> c0(m[0], m[1], m[2]), c1(m[4], m[5], m[6]), c2(m[8], m[9], m[10]);
+            const Vec3<T> n0 = c1.cross(c2), n1 = c2.cross(c0), n2 = c0.cross(c1);
+            const T det = c0.dot(n0);
+            if (det == T(0))
+                return Mat3<T>();
+
+            const T scale = T(1) / det;
+            const T normal[9] = {n0.x * scale, n0.y * scale, n0.z * scale,
+                                 n1.x * scale, n1.y * scale, n1.z * scale,
+                                 n2.x * scale, n2.y * scale, n2.z * scale};
+            return Mat3<T>(normal);
+        }
+
+        static constexpr Mat4 getOrthographicMatrix(T left, T right, T bottom, T top, T nearPlane, T farPlane)
+        {
+            Mat4 ortho;
+            ortho[0] = T(2) / (right - left);
+            ortho[5] = T(2) / (top - bottom);
+            ortho[10] = T(-2) / (farPlane - nearPlane);
             ortho[12] = -(right + left) / (right - left);
             ortho[13] = -(top + bottom) / (top - bottom);
             ortho[14] = -(farPlane + nearPlane) / (farPlane - nearPlane);
-            ortho[15] = 1.0f;
+            ortho[15] = T(1);
 
             return ortho;
         }
     };
+
+    // Column-major 3x3 matrix, tightly packed as glUniformMatrix3fv() expects
+    template <typename T>
+    struct Mat3
+    {
+        T m_data[9];
+
+        // Identity
+        constexpr Mat3() : m_data{}
+        {
+            for (int i = 0; i < 9; i += 4)
+            {
+                m_data[i] = T(1);
+            }
+        }
+
+        constexpr Mat3(const T *data) : m_data{}
+        {
+            for (int i = 0; i < 9; ++i)
+            {
+                m_data[i] = data[i];
+            }
+        }
+
+        // Upper-left 3x3 part
+        constexpr explicit Mat3(const Mat4<T> &matrix) : m_data{}
+        {
+            for (int column = 0; column < 3; ++column)
+            {
+                for (int row = 0; row < 3; ++row)
+                {
+                    m_data[column * 3 + row] = matrix.m_data[column * 4 + row];
+                }
+            }
+        }
+
+        constexpr T &operator[](int index)
+        {
+            return m_data[index];
+        }
+
+        constexpr const T &operator[](int index) const
+        {
+            return m_data[index];
+        }
+
+        operator const T *() const
+        {
+            return &m_data[0];
+        }
+
+        const T *data() const
+        {
+            return &m_data[0];
+        }
+
+        constexpr Mat3 operator*(const Mat3 &other) const
+        {
+            Mat3 result;
+            for (int column = 0; column < 3; ++column)
+            {
+                const T *b = other.m_data + column * 3;
+                for (int row = 0; row < 3; ++row)
+                {
+                    result.m_data[column * 3 + row] = m_data[row] * b[0] + m_data[3 + row] * b[1] + m_data[6 + row] * b[2];
+                }
+            }
+            return result;
+        }
+
+        constexpr Vec3<T> operator*(const Vec3<T> &vector) const
+        {
+            const T *m = m_data;
+            return Vec3<T>(m[0] * vector.x + m[3] * vector.y + m[6] * vector.z,
+                           m[1] * vector.x + m[4] * vector.y + m[7] * vector.z,
+                           m[2] * vector.x + m[5] * vector.y + m[8] * vector.z);
+        }
+
+        constexpr Mat3 transpose() const
+        {
+            Mat3 result;
+            for (int column = 0; column < 3; ++column)
+            {
+                for (int row = 0; row < 3; ++row)
+                {
+                    result.m_data[column * 3 + row] = m_data[row * 3 + column];
+                }
+            }
+            return result;
+        }
+
+        // Adjugate over determinant; a singular matrix yields identity
+        constexpr Mat3 inverse() const
+        {
+            const Vec3<T> c0(m_data[0], m_data[1], m_data[2]), c1(m_data[3], m_data[4], m_data[5]), c2(m_data[6], m_data[7], m_data[8]);
+            const Vec3<T> r0 = c1.cross(c2), r1 = c2.cross(c0), r2 = c0.cross(c1);
+            const T det = c0.dot(r0);
+            if (det == T(0))
+                return Mat3();
+
+            const T scale = T(1) / det;
+            const T inv[9] = {r0.x * scale, r1.x * scale, r2.x * scale,
+                              r0.y * scale, r1.y * scale, r2.y * scale,
+                              r0.z * scale, r1.z * scale, r2.z * scale};
+            return Mat3(inv);
+        }
+    };
+
+    using Matrix = Mat4<float>;
+    using Matrix3 = Mat3<float>;
+
+    static_assert(std::is_trivially_copyable<Matrix>::value && alignof(Matrix) == 16 && sizeof(Matrix) == 16 * sizeof(float),
+                  "Matrix columns must be plain, aligned float4s");
+    static_assert(std::is_trivially_copyable<Matrix3>::value && sizeof(Matrix3) == 9 * sizeof(float), "Matrix3 must stay tightly packed");
+    static_assert((Matrix() * Matrix::getOrthographicMatrix(-1.0f, 1.0f, -1.0f, 1.0f, 1.0f, -1.0f))[15] == 1.0f,
+                  "Matrix must be usable in constant expressions");
+
+    // Transforms `count` points stored as consecutive xyz triples, as
+    // transformPoint() does. `in` and `out` may be the same array.
+    inline void transformPoints(const Matrix &matrix, const float *in, float *out, size_t count)
+    {
+        using namespace simd;
+        const float4 c0 = load(matrix.m_data), c1 = load(matrix.m_data + 4), c2 = load(matrix.m_data + 8), c3 = load(matrix.m_data + 12);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const float *p = in + i * 3;
+            float result[4];
+            store(result, c0 * splat(p[0]) + c1 * splat(p[1]) + c2 * splat(p[2]) + c3);
+            std::memcpy(out + i * 3, result, 3 * sizeof(float));
+        }
+    }
+
+    // Transforms `count` points stored as separate x, y and z arrays (see
+    // SphereArray), eight (AVX) or four (SSE/NEON) per step. The outputs may
+    // alias the inputs. Every path evaluates m0 * x + m4 * y + m8 * z + m12 in
+    // that order, so results match transformPoint() exactly.
+    inline void transformPoints(const Matrix &matrix, const float *x, const float *y, const float *z, float *outX, float *outY, float *outZ, size_t count)
+    {
+        const float *m = matrix.m_data;
+        size_t i = 0;
+#if defined(__AVX__)
+        {
+            const __m256 m0 = _mm256_set1_ps(m[0]), m1 = _mm256_set1_ps(m[1]), m2 = _mm256_set1_ps(m[2]);
+            const __m256 m4 = _mm256_set1_ps(m[4]), m5 = _mm256_set1_ps(m[5]), m6 = _mm256_set1_ps(m[6]);
+            const __m256 m8 = _mm256_set1_ps(m[8]), m9 = _mm256_set1_ps(m[9]), m10 = _mm256_set1_ps(m[10]);
+            const __m256 m12 = _mm256_set1_ps(m[12]), m13 = _mm256_set1_ps(m[13]), m14 = _mm256_set1_ps(m[14]);
+            for (; i + 8 <= count; i += 8)
+            {
+                const __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+                _mm256_storeu_ps(outX + i, _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m0, px), _mm256_mul_ps(m4, py)), _mm256_mul_ps(m8, pz)), m12));
+                _mm256_storeu_ps(outY + i, _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m1, px), _mm256_mul_ps(m5, py)), _mm256_mul_ps(m9, pz)), m13));
+                _mm256_storeu_ps(outZ + i, _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m2, px), _mm256_mul_ps(m6, py)), _mm256_mul_ps(m10, pz)), m14));
+            }
+        }
+#endif
+        {
+            using namespace simd;
+            const float4 m0 = splat(m[0]), m1 = splat(m[1]), m2 = splat(m[2]);
+            const float4 m4 = splat(m[4]), m5 = splat(m[5]), m6 = splat(m[6]);
+            const float4 m8 = splat(m[8]), m9 = splat(m[9]), m10 = splat(m[10]);
+            const float4 m12 = splat(m[12]), m13 = splat(m[13]), m14 = splat(m[14]);
+            for (; i + 4 <= count; i += 4)
+            {
+                const float4 px = load(x + i), py = load(y + i), pz = load(z + i);
+                store(outX + i, m0 * px + m4 * py + m8 * pz + m12);
+                store(outY + i, m1 * px + m5 * py + m9 * pz + m13);
+                store(outZ + i, m2 * px + m6 * py + m10 * pz + m14);
+            }
+        }
+        for (; i < count; ++i)
+        {
+            const float px = x[i], py = y[i], pz = z[i];
+            outX[i] = m[0] * px + m[4] * py + m[8] * pz + m[12];
+            outY[i] = m[1] * px + m[5] * py + m[9] * pz + m[13];
+            outZ[i] = m[2] * px + m[6] * py + m[10] * pz + m[14];
+        }
+    }
 }
@@ -1,263 +1,69 @@
+#pragma once
+
 #include <GL/glew.h>
+#include <cmath>
 #include <string>
-#include <fstream>
-#include <sstream>
 #include <vector>
-#include <array>
 #include "logger.h"
+#include "material.h"
+#include "mesh_data.h"
+#include "mesh_lod.h"
+#include "meshlet.h"
+#include "submesh.h"
+#include "vertex.h"
 
 namespace grn
 {
 
-    struct Vertex
+    // Where a mesh's geometry lives inside a GeometryArena. The arena updates
+    // it in place when it moves data, so meshes keep a pointer to it.
+    struct GeometryAllocation
     {
-        float position[3];
-        float normal[3];
-        float texCoord[2];
-        float tangent[3];
-        float bitangent[3];
+        GLint baseVertex;   // added to every index by glDrawElementsBaseVertex
+        uint32_t vertexCount;
+        size_t indexOffset; // bytes into the arena's index buffer
+        uint32_t indexCount;
+        GLenum indexType;
+        uint32_t slot;      // position in the arena's allocation table
     };
 
-    // Type alias to ensure cross-platform compatibility
-    using float3 = std::array<float, 3>;
-
     struct Mesh
     {
         GLuint VBO, VAO, EBO;
-        uint size;
+        uint size; // index count of level 0 of all submeshes
+        Bounds bounds;
+        BoundingSphere sphere;
+        VertexFormat format;
+        GLenum indexType;  // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+        GLsizei indexSize; // bytes per index in EBO
+        std::vector<Submesh> submeshes; // parts drawn with one material each
+        std::vector<MeshLod> lods;      // index ranges in EBO, see Submesh and selectLod()
+        std::vector<Meshlet> meshlets;  // clusters of level 0, see Submesh and cullMeshlets()
+        std::vector<Material> materials;
+        const GeometryAllocation *allocation = nullptr; // set if the buffers belong to a GeometryArena
     };
 
-    static Mesh loadFromFileOBJ(const std::string &filename)
+    // Points the attribute locations of shader.vert at the bound vertex buffer
+    static void setupVertexAttributes(VertexFormat format)
     {
-        grn::Logger::debug("Loading OBJ file: " + filename);
-        Mesh mesh;
-        glGenVertexArrays(1, &mesh.VAO);
-        glGenBuffers(1, &mesh.VBO);
-        glGenBuffers(1, &mesh.EBO);
-
-        glBindVertexArray(mesh.VAO);
-
-        // read line by line using std::ifstream DO NOT ADD ANY COMMENTS AFTER THIS
-
-        std::ifstream file(filename);
-        if (!file.is_open())
+        if (format == VertexFormat::Compact)
         {
-            grn::Logger::error("Failed to open OBJ file: " + filename);
-            throw std::runtime_error("Failed to open OBJ file: " + filename);
+            constexpr GLsizei stride = sizeof(CompactVertex);
+            // Position (xyz) and handedness (w)
+            glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void *)offsetof(CompactVertex, position));
+            glEnableVertexAttribArray(0);
+            // Normal, octahedral
+            glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (void *)offsetof(CompactVertex, normal));
+            glEnableVertexAttribArray(1);
+            // TexCoords
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void *)offsetof(CompactVertex, texCoord));
+            glEnableVertexAttribArray(2);
+            // Tangent, octahedral
+            glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, stride, (void *)offsetof(CompactVertex, tangent));
+            glEnableVertexAttribArray(3);
+            return;
         }
 
-        std::vector<float> positions;
-        std::vector<float> normals;
-        std::vector<float> texCoords;
-        std::vector<Vertex> vertices;
-        std::vector<unsigned int> indices;
-
-        std::string line;
-        while (std::getline(file, line))
-        {
-            if (line.empty() || line[0] == '#')
-                continue; // skip empty lines and comments
-            std::istringstream iss(line);
-            std::string prefix;
-            iss >> prefix;
-            if (prefix == "v")
-            {
-                float x, y, z;
-                iss >> x >> y >> z;
-                positions.push_back(x);
-                positions.push_back(y);
-                positions.push_back(z);
-            }
-            else if (prefix == "vn")
-            {
-                float x, y, z;
-                iss >> x >> y >> z;
-                normals.push_back(x);
-                normals.push_back(y);
-                normals.push_back(z);
-            }
-            else if (prefix == "vt")
-            {
-                float u, v;
-                iss >> u >> v;
-                texCoords.push_back(u);
-                texCoords.push_back(v);
-            }
-            else if (prefix == "f")
-            {
-                auto processVertex = [&](unsigned int v, unsigned int vt, unsigned int vn)
-                {
-                    // OBJ indices are 1-based, convert to 0-based
-                    Vertex vertex;
-                    vertex.position[0] = positions[(v - 1) * 3];
-                    vertex.position[1] = positions[(v - 1) * 3 + 1];
-                    vertex.position[2] = positions[(v - 1) * 3 + 2];
-
-                    if (!normals.empty())
-                    {
-                        vertex.normal[0] = normals[(vn - 1) * 3];
-                        vertex.normal[1] = normals[(vn - 1) * 3 + 1];
-                        vertex.normal[2] = normals[(vn - 1) * 3 + 2];
-                    }
-                    else
-                    {
-                        vertex.normal[0] = 0.0f;
-                        vertex.normal[1] = 0.0f;
-                        vertex.normal[2] = 0.0f;
-                    }
-
-                    if (!texCoords.empty())
-                    {
-                        vertex.texCoord[0] = texCoords[(vt - 1) * 2];
-                        vertex.texCoord[1] = texCoords[(vt - 1) * 2 + 1];
-                    }
-                    else
-                    {
-                        vertex.texCoord[0] = 0.0f;
-                        vertex.texCoord[1] = 0.0f;
-                    }
-
-                    // Add vertex to the vertices vector
-                    vertices.push_back(vertex);
-                    indices.push_back(indices.size());
-                };
-
-                // Parse face vertices - handle different OBJ formats: v, v/vt, v/vt/vn, v//vn
-                std::vector<std::array<unsigned int, 3>> faceVertices; // [vertex_idx, texcoord_idx, normal_idx]
-                
-                std::string vertexStr;
-                while (iss >> vertexStr)
-                {
-                    std::array<unsigned int, 3> vertex = {0, 0, 0}; // default to 0 for missing components
-                    
-                    size_t firstSlash = vertexStr.find('/');
-                    if (firstSlash == std::string::npos)
-                    {
-                        // Format: v
-                        vertex[0] = std::stoi(vertexStr);
-                    }
-                    else
-                    {
-                        // Extract vertex index
-                        vertex[0] = std::stoi(vertexStr.substr(0, firstSlash));
-                        
-                        size_t secondSlash = vertexStr.find('/', firstSlash + 1);
-                        if (secondSlash == std::string::npos)
-                        {
-                            // Format: v/vt
-                            if (firstSlash + 1 < vertexStr.length())
-                                vertex[1] = std::stoi(vertexStr.substr(firstSlash + 1));
-                        }
-                        else
-                        {
-                            // Format: v/vt/vn or v//vn
-                            if (secondSlash > firstSlash + 1)
-                            {
-                                // has texture coordinate
-                                vertex[1] = std::stoi(vertexStr.substr(firstSlash + 1, secondSlash - firstSlash - 1));
-                            }
-                            if (secondSlash + 1 < vertexStr.length())
-                            {
-                                // has normal
-                                vertex[2] = std::stoi(vertexStr.substr(secondSlash + 1));
-                            }
-                        }
-                    }
-                    faceVertices.push_back(vertex);
-                }
-
-                if (faceVertices.size() < 3)
-                {
-                    Logger::error("Face has less than 3 vertices, skipping");
-                    continue;
-                }
-
-                // Process triangle
-                processVertex(faceVertices[0][0], faceVertices[0][1], faceVertices[0][2]);
-                processVertex(faceVertices[1][0], faceVertices[1][1], faceVertices[1][2]);
-                processVertex(faceVertices[2][0], faceVertices[2][1], faceVertices[2][2]);
-
-                // Handle quads by triangulating (create second triangle)
-                if (faceVertices.size() == 4)
-                {
-                    processVertex(faceVertices[0][0], faceVertices[0][1], faceVertices[0][2]);
-                    processVertex(faceVertices[2][0], faceVertices[2][1], faceVertices[2][2]);
-                    processVertex(faceVertices[3][0], faceVertices[3][1], faceVertices[3][2]);
-                }
-            }
-        }
-
-        // Calculate tangents and bitangents for each vertex
-        std::vector<float3> temp_tangents(vertices.size());
-        std::vector<float3> temp_bitangents(vertices.size());
-
-        for(size_t i = 0; i < indices.size(); i+=3)
-        {
-            Vertex &v0 = vertices[indices[i]];
-            Vertex &v1 = vertices[indices[i+1]];
-            Vertex &v2 = vertices[indices[i+2]];
-
-            float deltaPos1[3] = { v1.position[0] - v0.position[0], v1.position[1] - v0.position[1], v1.position[2] - v0.position[2] };
-            float deltaPos2[3] = { v2.position[0] - v0.position[0], v2.position[1] - v0.position[1], v2.position[2] - v0.position[2] };
-            float deltaUV1[2] = { v1.texCoord[0] - v0.texCoord[0], v1.texCoord[1] - v0.texCoord[1] };
-            float deltaUV2[2] = { v2.texCoord[0] - v0.texCoord[0], v2.texCoord[1] - v0.texCoord[1] };
-
-            float f = 1.0f / (deltaUV1[0] * deltaUV2[1] - deltaUV2[0] * deltaUV1[1]);
-
-            float tangent[3], bitangent[3];
-
-            tangent[0] = f * (deltaUV2[1] * deltaPos1[0] - deltaUV1[1] * deltaPos2[0]);
-            tangent[1] = f * (deltaUV2[1] * deltaPos1[1] - deltaUV1[1] * deltaPos2[1]);
-            tangent[2] = f * (deltaUV2[1] * deltaPos1[2] - deltaUV1[1] * deltaPos2[2]);
-
-            bitangent[0] = f * (-deltaUV2[0] * deltaPos1[0] + deltaUV1[0] * deltaPos2[0]);
-            bitangent[1] = f * (-deltaUV2[0] * deltaPos1[1] + deltaUV1[0] * deltaPos2[1]);
-            bitangent[2] = f * (-deltaUV2[0] * deltaPos1[2] + deltaUV1[0] * deltaPos2[2]);
-
-            for(int j=0; j<3; ++j) {
-                temp_tangents[indices[i]][j] += tangent[j];
-                temp_tangents[indices[i+1]][j] += tangent[j];
-                temp_tangents[indices[i+2]][j] += tangent[j];
-                temp_bitangents[indices[i]][j] += bitangent[j];
-                temp_bitangents[indices[i+1]][j] += bitangent[j];
-                temp_bitangents[indices[i+2]][j] += bitangent[j];
-            }
-        }
-
-        for(size_t i = 0; i < vertices.size(); ++i) {
-            Vertex& v = vertices[i];
-            
-            // Gram-Schmidt orthogonalize
-            float n_dot_t = v.normal[0] * temp_tangents[i][0] + v.normal[1] * temp_tangents[i][1] + v.normal[2] * temp_tangents[i][2];
-            
-            float t_res[3];
-            t_res[0] = temp_tangents[i][0] - n_dot_t * v.normal[0];
-            t_res[1] = temp_tangents[i][1] - n_dot_t * v.normal[1];
-            t_res[2] = temp_tangents[i][2] - n_dot_t * v.normal[2];
-
-            float t_len = sqrt(t_res[0]*t_res[0] + t_res[1]*t_res[1] + t_res[2]*t_res[2]);
-            v.tangent[0] = t_res[0] / t_len;
-            v.tangent[1] = t_res[1] / t_len;
-            v.tangent[2] = t_res[2] / t_len;
-
-            // Bitangent can be recalculated from N and T
-            v.bitangent[0] = v.normal[1] * v.tangent[2] - v.normal[2] * v.tangent[1];
-            v.bitangent[1] = v.normal[2] * v.tangent[0] - v.normal[0] * v.tangent[2];
-            v.bitangent[2] = v.normal[0] * v.tangent[1] - v.normal[1] * v.tangent[0];
-
-            // Logger::debug("Vertex " + std::to_string(i) +
-            //     " Tangent: [" + std::to_string(v.tangent[0]) + ", " + std::to_string(v.tangent[1]) + ", " + std::to_string(v.tangent[2]) + "]" +
-            //     " Bitangent: [" + std::to_string(v.bitangent[0]) + ", " + std::to_string(v.bitangent[1]) + ", " + std::to_string(v.bitangent[2]) + "]");
-        }
-
-        mesh.size = indices.size();
-
-        glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
-
         constexpr GLsizei stride = sizeof(Vertex);
         // Position
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(Vertex, position));
@@ -274,10 +80,136 @@ namespace grn
         // Bitangent
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, stride, (void *)offsetof(Vertex, bitangent));
         glEnableVertexAttribArray(4);
+    }
+
+    // Fills in everything of a Mesh except its GL objects. Without `lods` the
+    // whole index buffer is a single level, and without `submeshes` everything
+    // is one part without a material.
+    static Mesh describeMesh(size_t indexCount, VertexFormat format, IndexFormat indexFormat, const Bounds &bounds,
+                             const std::vector<MeshLod> &lods = {}, const std::vector<Meshlet> &meshlets = {},
+                             const std::vector<Submesh> &submeshes = {})
+    {
+        Mesh mesh;
+        mesh.VBO = mesh.VAO = mesh.EBO = 0;
+        mesh.lods = lods;
+        mesh.meshlets = meshlets;
+        mesh.submeshes = submeshes;
+        if (mesh.lods.empty())
+            mesh.lods.push_back({0, static_cast<uint32_t>(indexCount), 0.0f});
+        if (mesh.submeshes.empty())
+        {
+            mesh.submeshes.push_back({mesh.lods[0].firstIndex, mesh.lods[0].indexCount, 0, static_cast<uint32_t>(mesh.lods.size()),
+                                      0, static_cast<uint32_t>(mesh.meshlets.size()), NoMaterial});
+        }
+        mesh.size = 0;
+        for (const Submesh &submesh : mesh.submeshes)
+            mesh.size += submesh.indexCount;
+        mesh.bounds = bounds;
+        // Sphere around the box until the caller sets a tighter one, see uploadMesh()
+        float halfDiagonal = 0.0f;
+        for (int k = 0; k < 3; ++k)
+        {
+            mesh.sphere.center[k] = (bounds.min[k] + bounds.max[k]) * 0.5f;
+            halfDiagonal += (bounds.max[k] - mesh.sphere.center[k]) * (bounds.max[k] - mesh.sphere.center[k]);
+        }
+        mesh.sphere.radius = std::sqrt(halfDiagonal);
+        mesh.format = format;
+        mesh.indexType = indexFormat == IndexFormat::UInt16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        mesh.indexSize = static_cast<GLsizei>(indexStride(indexFormat));
+        return mesh;
+    }
+
+    // Uploads vertex and index data into a new VAO. `vertexData` holds vertexCount
+    // vertices laid out as `format` and `indexData` indexCount indices laid out as
+    // `indexFormat`. The data is only read during the call, so it may point into a
+    // memory-mapped file. See describeMesh() for `lods` and `submeshes`.
+    static Mesh createMesh(const void *vertexData, size_t vertexCount, VertexFormat format, const void *indexData, size_t indexCount, IndexFormat indexFormat,
+                           const Bounds &bounds, const std::vector<MeshLod> &lods = {}, const std::vector<Meshlet> &meshlets = {},
+                           const std::vector<Submesh> &submeshes = {})
+    {
+        Mesh mesh = describeMesh(indexCount, format, indexFormat, bounds, lods, meshlets, submeshes);
+
+        glGenVertexArrays(1, &mesh.VAO);
+        glGenBuffers(1, &mesh.VBO);
+        glGenBuffers(1, &mesh.EBO);
+
+        glBindVertexArray(mesh.VAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * vertexStride(format), vertexData, GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * mesh.indexSize, indexData, GL_STATIC_DRAW);
+
+        setupVertexAttributes(format);
 
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         glBindVertexArray(0);
 
+        return mesh;
+    }
+
+    // Uploads finished MeshData. Must run on the thread that owns the GL context;
+    // everything before it can run on workers (see AsyncMeshLoader).
+    static Mesh uploadMesh(const MeshData &data)
+    {
+        Mesh mesh = createMesh(data.vertexData(), data.vertexCount(), data.format, data.indexData(), data.indexCount(), data.indexFormat,
+                               data.bounds, data.lods, data.meshlets, data.submeshes);
+        mesh.sphere = data.sphere;
+        mesh.materials = data.materials;
+        return mesh;
+    }
+
+    // Byte offset of an index in the bound element buffer, for the glDraw*Elements calls
+    static const void *indexOffset(const Mesh &mesh, uint32_t firstIndex)
+    {
+        size_t base = mesh.allocation ? mesh.allocation->indexOffset : 0;
+        return (const void *)(base + size_t(firstIndex) * mesh.indexSize);
+    }
+
+    // Vertex the mesh's indices are relative to in the bound vertex buffer
+    static GLint baseVertex(const Mesh &mesh)
+    {
+        return mesh.allocation ? mesh.allocation->baseVertex : 0;
+    }
+
+    // Draws one level of detail. The mesh's VAO must be bound.
+    static void drawLod(const Mesh &mesh, size_t lod)
+    {
+        glDrawElementsBaseVertex(GL_TRIANGLES, mesh.lods[lod].indexCount, mesh.indexType, indexOffset(mesh, mesh.lods[lod].firstIndex),
+                                 baseVertex(mesh));
+    }
+
+    // Per-range arguments of glMultiDrawElementsBaseVertex(). Keep one across
+    // frames and pass it to drawIndexRanges(), which reuses its capacity, so
+    // steady-state frames draw without allocating.
+    struct MultiDrawBuffers
+    {
+        std::vector<GLsizei> counts;
+        std::vector<const void *> offsets;
+        std::vector<GLint> baseVertices;
+    };
+
+    // Draws ranges of the mesh's index buffer, e.g. the visible meshlets from
+    // cullMeshlets(), in a single call. The mesh's VAO must be bound.
+    static void drawIndexRanges(const Mesh &mesh, const std::vector<IndexRange> &ranges, MultiDrawBuffers &buffers)
+    {
+        buffers.counts.resize(ranges.size());
+        buffers.offsets.resize(ranges.size());
+        buffers.baseVertices.assign(ranges.size(), baseVertex(mesh));
+        for (size_t i = 0; i < ranges.size(); ++i)
+        {
+            buffers.counts[i] = static_cast<GLsizei>(ranges[i].indexCount);
+            buffers.offsets[i] = indexOffset(mesh, ranges[i].firstIndex);
+        }
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, buffers.counts.data(), mesh.indexType, buffers.offsets.data(), static_cast<GLsizei>(ranges.size()),
+                                      buffers.baseVertices.data());
+    }
+
+    // Loads and uploads an OBJ file on the calling thread
+    static Mesh loadFromFileOBJ(const std::string &filename, const MeshLoadOptions &options = MeshLoadOptions())
+    {
+        Mesh mesh = uploadMesh(loadMeshDataOBJ(filename, options));
         grn::Logger::debug("Finished creating mesh from OBJ file: " + filename);
         return mesh;
     }
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+#include "mapped_file.h"
+#include "mesh_lod.h"
+#include "meshlet.h"
+#include "submesh.h"
+#include "vertex.h"
+
+namespace grn
+{
+    // Identifies the exact source file a cooked mesh was built from
+    struct SourceStamp
+    {
+        uint64_t size = 0;
+        int64_t modifiedTime = 0;
+
+        bool operator==(const SourceStamp &other) const
+        {
+            return size == other.size && modifiedTime == other.modifiedTime;
+        }
+    };
+
+    // On-disk layout: CookedMeshHeader, then the vertex blob at vertexOffset, the
+    // 16- or 32-bit index blob at indexOffset, the MeshLod table at lodOffset, the
+    // Meshlet table at meshletOffset, the Submesh table at submeshOffset and the
+    // string table at stringOffset, all 16-byte aligned. The string table holds
+    // materialCount material names followed by libraryCount material library
+    // paths, each NUL-terminated. Everything is in
+    // native byte order, so a file from a different architecture fails the magic check.
+    struct CookedMeshHeader
+    {
+        static constexpr uint32_t Magic = 0x4D4E5247; // "GRNM"
+        // Bump whenever the cooking pipeline changes what ends up in the blobs
+        static constexpr uint32_t Version = 7;
+
+        uint32_t magic;
+        uint32_t version;
+        uint32_t vertexStride; // bytes per vertex, must match the loader's vertex layout
+        uint32_t flags;        // load options the blobs were cooked with
+        uint32_t indexStride;  // 2 or 4 bytes per index, see chooseIndexFormat()
+        uint32_t reserved;
+        uint64_t vertexCount;
+        uint64_t indexCount;
+        uint64_t vertexOffset;
+        uint64_t indexOffset;
+        uint64_t lodCount;
+        uint64_t lodOffset;
+        uint64_t meshletCount;
+        uint64_t meshletOffset;
+        uint64_t submeshCount;
+        uint64_t submeshOffset;
+        uint64_t materialCount;
+        uint64_t libraryCount;
+        uint64_t stringOffset;
+        uint64_t stringSize;
+        float boundsMin[3];
+        float boundsMax[3];
+        float sphereCenter[3];
+        float sphereRadius;
+        SourceStamp source;
+    };
+
+    inline std::string cookedMeshPath(const std::string &sourcePath)
+    {
+        return sourcePath + ".grnmesh";
+    }
+
+    inline bool getSourceStamp(const std::string &path, SourceStamp &stamp)
+    {
+        std::error_code error;
+        auto size = std::filesystem::file_size(path, error);
+        if (error)
+            return false;
+        auto time = std::filesystem::last_write_time(path, error);
+        if (error)
+            return false;
+
+        stamp.size = size;
+        stamp.modifiedTime = static_cast<int64_t>(time.time_since_epoch().count());
+        return true;
+    }
+
+    // Memory-mapped view of a cooked mesh. The blobs point straight into the
+    // mapping and stay valid for as long as the CookedMesh is alive.
+    class CookedMesh
+    {
+    public:
+        // Maps `path` and checks it against the expected layout and source stamp.
+        // Returns false if the file is missing, corrupt or stale.
+        bool open(const std::string &path, uint32_t vertexStride, uint32_t flags, const SourceStamp &source)
+        {
+            if (!m_file.open(path) || m_file.size() < sizeof(CookedMeshHeader))
+                return false;
+
+            std::memcpy(&m_header, m_file.data(), sizeof(CookedMeshHeader));
+            const uint64_t fileSize = m_file.size();
+
+            // Counts are bounded by the file size first so the byte sizes below cannot overflow
+            bool valid = m_header.magic == CookedMeshHeader::Magic &&
+                         m_header.version == CookedMeshHeader::Version &&
+                         m_header.vertexStride == vertexStride && vertexStride != 0 &&
+                         m_header.flags == flags &&
+                         m_header.source == source &&
+                         m_header.vertexCount <= fileSize / vertexStride &&
+                         (m_header.indexStride == sizeof(uint32_t) ||
+                          (m_header.indexStride == sizeof(uint16_t) && m_header.vertexCount <= 65536)) &&
+                         m_header.indexCount <= fileSize / m_header.indexStride &&
+                         m_header.vertexOffset % 16 == 0 && m_header.indexOffset % 16 == 0 &&
+                         m_header.vertexOffset >= sizeof(CookedMeshHeader) && m_header.vertexOffset <= fileSize &&
+                         m_header.indexOffset <= fileSize &&
+                         m_header.vertexCount * vertexStride <= fileSize - m_header.vertexOffset &&
+                         m_header.indexCount * m_header.indexStride <= fileSize - m_header.indexOffset &&
+                         m_header.lodOffset % 16 == 0 && m_header.lodOffset <= fileSize &&
+                         m_header.lodCount <= (fileSize - m_header.lodOffset) / sizeof(MeshLod) &&
+                         m_header.meshletOffset % 16 == 0 && m_header.meshletOffset <= fileSize &&
+                         m_header.meshletCount <= (fileSize - m_header.meshletOffset) / sizeof(Meshlet) &&
+                         m_header.submeshCount >= 1 &&
+                         m_header.submeshOffset % 16 == 0 && m_header.submeshOffset <= fileSize &&
+                         m_header.submeshCount <= (fileSize - m_header.submeshOffset) / sizeof(Submesh) &&
+                         m_header.stringOffset % 16 == 0 && m_header.stringOffset <= fileSize &&
+                         m_header.stringSize <= fileSize - m_header.stringOffset &&
+                         m_header.materialCount + m_header.libraryCount <= m_header.stringSize;
+            for (uint64_t i = 0; valid && i < m_header.lodCount; ++i)
+            {
+                const MeshLod &lod = lods()[i];
+                valid = lod.firstIndex <= m_header.indexCount && lod.indexCount <= m_header.indexCount - lod.firstIndex;
+            }
+            for (uint64_t i = 0; valid && i < m_header.meshletCount; ++i)
+            {
+                const Meshlet &meshlet = meshlets()[i];
+                valid = meshlet.firstIndex <= m_header.indexCount && meshlet.indexCount <= m_header.indexCount - meshlet.firstIndex;
+            }
+            for (uint64_t i = 0; valid && i < m_header.submeshCount; ++i)
+            {
+                const Submesh &submesh = submeshes()[i];
+                valid = submesh.firstIndex <= m_header.indexCount && submesh.indexCount <= m_header.indexCount - submesh.firstIndex &&
+                        submesh.lodCount >= 1 && submesh.lodCount <= MaxLodCount &&
+                        submesh.firstLod <= m_header.lodCount && submesh.lodCount <= m_header.lodCount - submesh.firstLod &&
+                        submesh.firstMeshlet <= m_header.meshletCount && submesh.meshletCount <= m_header.meshletCount - submesh.firstMeshlet &&
+                        (submesh.material == NoMaterial || submesh.material < m_header.materialCount);
+            }
+            if (valid)
+            {
+                // An index past the vertices would make the GPU read out of bounds
+                valid = m_header.indexCount == 0 ||
+                        (m_header.indexStride == sizeof(uint16_t)
+                             ? maxIndex(static_cast<const uint16_t *>(indices())) < m_header.vertexCount
+                             : maxIndex(static_cast<const uint32_t *>(indices())) < m_header.vertexCount);
+            }
+            if (valid)
+            {
+                const char *strings = m_file.data() + m_header.stringOffset;
+                valid = static_cast<uint64_t>(std::count(strings, strings + m_header.stringSize, '\0')) == m_header.materialCount + m_header.libraryCount &&
+                        (m_header.stringSize == 0 || strings[m_header.stringSize - 1] == '\0');
+            }
+            if (!valid)
+                m_file.close();
+            return valid;
+        }
+
+        const CookedMeshHeader &header() const { return m_header; }
+        const void *vertices() const { return m_file.data() + m_header.vertexOffset; }
+        IndexFormat indexFormat() const { return m_header.indexStride == sizeof(uint16_t) ? IndexFormat::UInt16 : IndexFormat::UInt32; }
+        const void *indices() const { return m_file.data() + m_header.indexOffset; }
+        const MeshLod *lods() const { return reinterpret_cast<const MeshLod *>(m_file.data() + m_header.lodOffset); }
+        const Meshlet *meshlets() const { return reinterpret_cast<const Meshlet *>(m_file.data() + m_header.meshletOffset); }
+        const Submesh *submeshes() const { return reinterpret_cast<const Submesh *>(m_file.data() + m_header.submeshOffset); }
+
+        // Material names and library paths, see CookedMeshHeader
+        void strings(std::vector<std::string> &materialNames, std::vector<std::string> &libraries) const
+        {
+            const char *p = m_file.data() + m_header.stringOffset;
+            for (uint64_t i = 0; i < m_header.materialCount + m_header.libraryCount; ++i)
+            {
+                std::string &target = i < m_header.materialCount ? materialNames.emplace_back() : libraries.emplace_back();
+                target = p;
+                p += target.size() + 1;
+            }
+        }
+
+    private:
+        MappedFile m_file;
+        CookedMeshHeader m_header = {};
+
+        // Largest index in the mapped index block
+        template <typename Index>
+        uint64_t maxIndex(const Index *indices) const
+        {
+            Index largest = 0;
+            for (uint64_t i = 0; i < m_header.indexCount; ++i)
+                largest = std::max(largest, indices[i]);
+            return largest;
+        }
+    };
+
+    // Writes a cooked mesh next to its source. The data goes to a temporary file
+    // that is renamed over `path` when complete, so a crash or a concurrent
+    // reader never sees a half-written cache. The offsets in `header` are filled
+    // in here; `indices` holds header.indexStride bytes per index and `strings`
+    // header.stringSize bytes.
+    inline bool writeCookedMesh(const std::string &path, CookedMeshHeader header, const void *vertices, const void *indices, const MeshLod *lods,
+                                const Meshlet *meshlets, const Submesh *submeshes, const char *strings)
+    {
+        auto alignUp = [](uint64_t value)
+        { return (value + 15) & ~uint64_t(15); };
+
+        header.magic = CookedMeshHeader::Magic;
+        header.version = CookedMeshHeader::Version;
+        header.vertexOffset = alignUp(sizeof(CookedMeshHeader));
+        header.indexOffset = alignUp(header.vertexOffset + header.vertexCount * header.vertexStride);
+        header.lodOffset = alignUp(header.indexOffset + header.indexCount * header.indexStride);
+        header.meshletOffset = alignUp(header.lodOffset + header.lodCount * sizeof(MeshLod));
+        header.submeshOffset = alignUp(header.meshletOffset + header.meshletCount * sizeof(Meshlet));
+        header.stringOffset = alignUp(header.submeshOffset + header.submeshCount * sizeof(Submesh));
+
+        // Two loaders, or two engine processes, may cook the same source at once
+        const std::string tempPath = temporaryPathFor(path);
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            if (!file.is_open())
+                return false;
+
+            const char padding[16] = {};
+            file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            file.write(padding, header.vertexOffset - sizeof(header));
+            file.write(static_cast<const char *>(vertices), header.vertexCount * header.vertexStride);
+            file.write(padding, header.indexOffset - (header.vertexOffset + header.vertexCount * header.vertexStride));
+            file.write(static_cast<const char *>(indices), header.indexCount * header.indexStride);
+            file.write(padding, header.lodOffset - (header.indexOffset + header.indexCount * header.indexStride));
+            file.write(reinterpret_cast<const char *>(lods), header.lodCount * sizeof(MeshLod));
+            file.write(padding, header.meshletOffset - (header.lodOffset + header.lodCount * sizeof(MeshLod)));
+            file.write(reinterpret_cast<const char *>(meshlets), header.meshletCount * sizeof(Meshlet));
+            file.write(padding, header.submeshOffset - (header.meshletOffset + header.meshletCount * sizeof(Meshlet)));
+            file.write(reinterpret_cast<const char *>(submeshes), header.submeshCount * sizeof(Submesh));
+            file.write(padding, header.stringOffset - (header.submeshOffset + header.submeshCount * sizeof(Submesh)));
+            file.write(strings, header.stringSize);
+            if (!file)
+            {
+                file.close();
+                std::remove(tempPath.c_str());
+                return false;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(tempPath, path, error);
+        if (error)
+        {
+            std::filesystem::remove(tempPath, error);
+            return false;
+        }
+        return true;
+    }
+}
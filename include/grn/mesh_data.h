@@ -0,0 +1,492 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "logger.h"
+#include "mapped_file.h"
+#include "material.h"
+#include "mesh_cache.h"
+#include "mesh_lod.h"
+#include "mesh_optimizer.h"
+#include "meshlet.h"
+#include "obj_parser.h"
+#include "submesh.h"
+#include "tangents.h"
+#include "vertex.h"
+
+namespace grn
+{
+
+    // Type alias to ensure cross-platform compatibility
+    using float3 = std::array<float, 3>;
+
+    // Optional processing applied when a mesh is built from its source file
+    struct MeshLoadOptions
+    {
+        // Reorder triangles for the post-transform vertex cache, then cluster them
+        // against overdraw, then renumber vertices for fetch locality
+        bool optimize = false;
+
+        // Layout of the uploaded vertex buffer; Compact needs shader.vert built with GRN_COMPACT_VERTEX
+        VertexFormat vertexFormat = VertexFormat::Full;
+
+        // Threads used to parse the source and build tangents, 0 = all hardware
+        // threads. Lower it when several meshes are loaded concurrently.
+        unsigned int threadCount = 0;
+
+        // Levels of detail including the full mesh, at most MaxLodCount; 1 disables
+        // simplification. Each level aims for half the triangles of the previous one.
+        unsigned int lodCount = 1;
+
+        // Split level 0 of every submesh into meshlets (64 vertices, 124 triangles) for cluster culling
+        bool meshlets = false;
+
+        // Cooked caches are only reused if they were built with the same options
+        uint32_t cookFlags() const
+        {
+            return (optimize ? 1u : 0u) | (static_cast<uint32_t>(vertexFormat) << 1) |
+                   (std::min(std::max(lodCount, 1u), MaxLodCount) << 8) | (meshlets ? 1u << 16 : 0u);
+        }
+    };
+
+    // CPU side of a mesh: everything the GL upload needs, built without a GL
+    // context so it can be produced on worker threads. Meshes served from the
+    // cooked cache keep the mapping in `cooked` and leave the vertex and index
+    // vectors empty. Indices are uploaded as 16-bit whenever the vertex count
+    // allows it.
+    struct MeshData
+    {
+        VertexFormat format = VertexFormat::Full;
+        std::vector<Vertex> vertices;
+        std::vector<CompactVertex> compactVertices; // packed copy of `vertices` when format is Compact
+        IndexFormat indexFormat = IndexFormat::UInt32;
+        std::vector<unsigned int> indices; // all levels of detail back to back
+        std::vector<uint16_t> shortIndices; // narrowed copy of `indices` when indexFormat is UInt16
+        std::vector<Submesh> submeshes;     // parts in file order, their level 0 ranges back to back
+        std::vector<MeshLod> lods;          // ranges of `indices`, see Submesh
+        std::vector<Meshlet> meshlets;      // clusters of the submeshes' level 0, if requested
+        std::vector<Material> materials;    // indexed by Submesh::material
+        std::vector<std::string> materialLibraries; // where `materials` came from, relative to the source
+        Bounds bounds = {{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}};
+        BoundingSphere sphere = {{0.0f, 0.0f, 0.0f}, 0.0f};
+        std::unique_ptr<CookedMesh> cooked;
+
+        // Vertex blob in `format`, ready to be handed to glBufferData
+        const void *vertexData() const
+        {
+            if (cooked)
+                return cooked->vertices();
+            if (format == VertexFormat::Compact)
+                return compactVertices.data();
+            return vertices.data();
+        }
+
+        size_t vertexCount() const
+        {
+            return cooked ? static_cast<size_t>(cooked->header().vertexCount) : vertices.size();
+        }
+
+        // Index blob in `indexFormat`, ready to be handed to glBufferData
+        const void *indexData() const
+        {
+            if (cooked)
+                return cooked->indices();
+            if (indexFormat == IndexFormat::UInt16)
+                return shortIndices.data();
+            return indices.data();
+        }
+
+        size_t indexCount() const
+        {
+            return cooked ? static_cast<size_t>(cooked->header().indexCount) : indices.size();
+        }
+    };
+
+    namespace detail
+    {
+        // A submesh renumbered to the vertices it uses, so per-vertex passes
+        // cost time and memory in the size of the part rather than the mesh
+        struct LocalMesh
+        {
+            std::vector<unsigned int> indices;
+            std::vector<unsigned int> vertices; // mesh vertex of every local vertex
+            std::vector<float> positions;       // x, y, z of every local vertex
+        };
+
+        // `remap` must hold ~0u for every mesh vertex and is left that way
+        inline void extractLocalMesh(const unsigned int *indices, size_t indexCount, const std::vector<Vertex> &vertices,
+                                     std::vector<unsigned int> &remap, LocalMesh &local)
+        {
+            local.indices.resize(indexCount);
+            local.vertices.clear();
+            local.positions.clear();
+            for (size_t i = 0; i < indexCount; ++i)
+            {
+                unsigned int &target = remap[indices[i]];
+                if (target == ~0u)
+                {
+                    target = static_cast<unsigned int>(local.vertices.size());
+                    local.vertices.push_back(indices[i]);
+                    local.positions.insert(local.positions.end(), vertices[indices[i]].position, vertices[indices[i]].position + 3);
+                }
+                local.indices[i] = target;
+            }
+            for (unsigned int v : local.vertices)
+                remap[v] = ~0u;
+        }
+
+        // Splits the face corners of an OBJ into parts at every o, g and usemtl
+        // record that changes the current object, group or material. Materials
+        // are numbered in order of first use; empty parts are dropped, but there
+        // is always at least one part.
+        inline std::vector<Submesh> splitObjParts(const ObjData &obj, std::vector<std::string> &materialNames)
+        {
+            std::vector<Submesh> parts;
+            std::string names[3]; // current object, group and material
+            size_t partBegin = 0;
+
+            auto finishPart = [&](size_t partEnd)
+            {
+                if (partEnd == partBegin)
+                    return;
+                uint32_t material = NoMaterial;
+                if (!names[ObjMarker::Material].empty())
+                {
+                    auto found = std::find(materialNames.begin(), materialNames.end(), names[ObjMarker::Material]);
+                    material = static_cast<uint32_t>(found - materialNames.begin());
+                    if (found == materialNames.end())
+                        materialNames.push_back(names[ObjMarker::Material]);
+                }
+                parts.push_back({static_cast<uint32_t>(partBegin), static_cast<uint32_t>(partEnd - partBegin), 0, 0, 0, 0, material});
+                partBegin = partEnd;
+            };
+
+            for (const ObjMarker &marker : obj.markers)
+            {
+                if (names[marker.kind] == marker.name)
+                    continue;
+                finishPart(marker.corner);
+                names[marker.kind] = marker.name;
+            }
+            finishPart(obj.corners.size());
+
+            if (parts.empty())
+                parts.push_back({0, 0, 0, 0, 0, 0, NoMaterial});
+            return parts;
+        }
+
+        inline float extent(const float *positions, size_t count, size_t stride)
+        {
+            if (count == 0)
+                return 0.0f;
+            auto position = [&](size_t v)
+            {
+                return reinterpret_cast<const float *>(reinterpret_cast<const char *>(positions) + v * stride);
+            };
+            float lo[3] = {position(0)[0], position(0)[1], position(0)[2]};
+            float hi[3] = {lo[0], lo[1], lo[2]};
+            for (size_t v = 1; v < count; ++v)
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    lo[k] = std::min(lo[k], position(v)[k]);
+                    hi[k] = std::max(hi[k], position(v)[k]);
+                }
+            }
+            return std::max({hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]});
+        }
+    }
+
+    // Applies the per-part options to every submesh of `data`, whose submeshes
+    // must hold their level 0 ranges and materials: optimization for the vertex
+    // cache and overdraw, meshlets and the LOD chain, appending the simplified
+    // levels to data.indices. Triangles never move between parts, and because
+    // the simplifier locks open borders, parts that share vertices do not
+    // crack apart. Vertices are renumbered for fetch locality last.
+    inline void buildSubmeshes(MeshData &data, const MeshLoadOptions &options)
+    {
+        auto describe = [](const VertexCacheStatistics &stats)
+        {
+            return "ACMR " + std::to_string(stats.acmr) + ", ATVR " + std::to_string(stats.atvr);
+        };
+
+        const size_t levelZeroCount = data.indices.size();
+        VertexCacheStatistics before = {};
+        if (options.optimize)
+            before = analyzeVertexCache(data.indices.data(), levelZeroCount, data.vertices.size());
+
+        const float meshExtent = data.vertices.empty() ? 0.0f : detail::extent(data.vertices.data()->position, data.vertices.size(), sizeof(Vertex));
+        std::vector<unsigned int> remap(data.vertices.size(), ~0u);
+        detail::LocalMesh local;
+
+        data.lods.clear();
+        data.meshlets.clear();
+        for (Submesh &submesh : data.submeshes)
+        {
+            detail::extractLocalMesh(data.indices.data() + submesh.firstIndex, submesh.indexCount, data.vertices, remap, local);
+            const size_t localCount = local.vertices.size();
+            constexpr size_t localStride = sizeof(float) * 3;
+
+            if (options.optimize && submesh.indexCount > 0)
+            {
+                optimizeVertexCache(local.indices.data(), submesh.indexCount, localCount);
+                optimizeOverdraw(local.indices.data(), submesh.indexCount, local.positions.data(), localCount, localStride);
+            }
+
+            // Meshlets grow from the optimized triangle order and only reorder level 0
+            submesh.firstMeshlet = static_cast<uint32_t>(data.meshlets.size());
+            if (options.meshlets && submesh.indexCount > 0)
+            {
+                for (Meshlet meshlet : buildMeshlets(local.indices.data(), submesh.indexCount, local.positions.data(), localCount, localStride))
+                {
+                    meshlet.firstIndex += submesh.firstIndex;
+                    data.meshlets.push_back(meshlet);
+                }
+            }
+            submesh.meshletCount = static_cast<uint32_t>(data.meshlets.size()) - submesh.firstMeshlet;
+
+            std::vector<MeshLod> chain = {{0, submesh.indexCount, 0.0f}};
+            if (options.lodCount > 1 && submesh.indexCount > 0)
+                chain = buildLodChain(local.indices, local.positions.data(), localCount, localStride, options.lodCount);
+
+            // Back to mesh vertices: level 0 in place, simplified levels appended.
+            // Chain errors are relative to the part, MeshLod errors to the whole mesh.
+            for (size_t i = 0; i < submesh.indexCount; ++i)
+                data.indices[submesh.firstIndex + i] = local.vertices[local.indices[i]];
+
+            const float errorScale = meshExtent > 0.0f ? detail::extent(local.positions.data(), localCount, localStride) / meshExtent : 0.0f;
+            submesh.firstLod = static_cast<uint32_t>(data.lods.size());
+            submesh.lodCount = static_cast<uint32_t>(chain.size());
+            data.lods.push_back({submesh.firstIndex, submesh.indexCount, 0.0f});
+            for (size_t level = 1; level < chain.size(); ++level)
+            {
+                MeshLod lod = chain[level];
+                const uint32_t first = lod.firstIndex;
+                lod.firstIndex = static_cast<uint32_t>(data.indices.size());
+                lod.error *= errorScale;
+                for (uint32_t i = 0; i < lod.indexCount; ++i)
+                    data.indices.push_back(local.vertices[local.indices[first + i]]);
+                data.lods.push_back(lod);
+            }
+        }
+
+        if (options.optimize && !data.indices.empty())
+        {
+            optimizeVertexFetch(data.vertices, data.indices.data(), data.indices.size());
+            VertexCacheStatistics after = analyzeVertexCache(data.indices.data(), levelZeroCount, data.vertices.size());
+            grn::Logger::log("Optimized mesh: " + describe(before) + " -> " + describe(after));
+        }
+    }
+
+    inline Bounds computeBounds(const Vertex *vertices, size_t vertexCount)
+    {
+        Bounds bounds = {{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}};
+        if (vertexCount == 0)
+            return bounds;
+
+        for (int j = 0; j < 3; ++j)
+            bounds.min[j] = bounds.max[j] = vertices[0].position[j];
+        for (size_t i = 1; i < vertexCount; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                bounds.min[j] = std::min(bounds.min[j], vertices[i].position[j]);
+                bounds.max[j] = std::max(bounds.max[j], vertices[i].position[j]);
+            }
+        }
+        return bounds;
+    }
+
+    // Loads an OBJ file into MeshData without touching GL, so it can run on any
+    // thread. Goes through a cooked binary copy next to the source
+    // (<file>.grnmesh): if the cache matches the source's size and modification
+    // time and was cooked with the same options, it is memory-mapped and
+    // referenced as is; otherwise the OBJ is parsed and the cache is (re)written.
+    // Objects, groups and material runs become submeshes of the one mesh, and
+    // the materials they use are read from the file's mtllib libraries.
+    inline MeshData loadMeshDataOBJ(const std::string &filename, const MeshLoadOptions &options = MeshLoadOptions())
+    {
+        static_assert(sizeof(unsigned int) == sizeof(uint32_t), "32-bit index blobs are written straight from `indices`");
+
+        grn::Logger::debug("Loading OBJ file: " + filename);
+
+        const std::string cachePath = cookedMeshPath(filename);
+        SourceStamp stamp;
+        const bool hasStamp = getSourceStamp(filename, stamp);
+        if (hasStamp)
+        {
+            auto cooked = std::make_unique<CookedMesh>();
+            if (cooked->open(cachePath, vertexStride(options.vertexFormat), options.cookFlags(), stamp))
+            {
+                const CookedMeshHeader &header = cooked->header();
+                MeshData data;
+                data.format = options.vertexFormat;
+                data.indexFormat = cooked->indexFormat();
+                std::copy(header.boundsMin, header.boundsMin + 3, data.bounds.min);
+                std::copy(header.boundsMax, header.boundsMax + 3, data.bounds.max);
+                std::copy(header.sphereCenter, header.sphereCenter + 3, data.sphere.center);
+                data.sphere.radius = header.sphereRadius;
+                data.lods.assign(cooked->lods(), cooked->lods() + header.lodCount);
+                data.meshlets.assign(cooked->meshlets(), cooked->meshlets() + header.meshletCount);
+                data.submeshes.assign(cooked->submeshes(), cooked->submeshes() + header.submeshCount);
+                // Libraries are read again, so edits to them apply without recooking
+                std::vector<std::string> materialNames;
+                cooked->strings(materialNames, data.materialLibraries);
+                data.materials = resolveMaterials(std::filesystem::path(filename).parent_path().string(), data.materialLibraries, materialNames);
+                data.cooked = std::move(cooked);
+                grn::Logger::debug("Using cooked mesh: " + cachePath);
+                return data;
+            }
+        }
+
+        MappedFile file;
+        if (!file.open(filename))
+        {
+            grn::Logger::error("Failed to open OBJ file: " + filename);
+            throw std::runtime_error("Failed to open OBJ file: " + filename);
+        }
+
+        ObjData obj;
+        parseOBJParallel(file.begin(), file.end(), obj, options.threadCount);
+
+        const std::vector<float> &positions = obj.positions;
+        const std::vector<float> &normals = obj.normals;
+        const std::vector<float> &texCoords = obj.texCoords;
+        const size_t positionCount = positions.size() / 3;
+        const size_t normalCount = normals.size() / 3;
+        const size_t texCoordCount = texCoords.size() / 2;
+
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        vertices.reserve(positionCount);
+        indices.reserve(obj.corners.size());
+
+        // Weld identical (v, vt, vn) corners into one shared vertex. The lookup is
+        // a hash map with the position index as a perfect hash: every position
+        // heads a chain of the unique vertices built from it, and a chain rarely
+        // holds more than the few UV/normal seams meeting at that position.
+        constexpr unsigned int endOfChain = ~0u;
+        std::vector<unsigned int> chainHeads(positionCount, endOfChain);
+        std::vector<unsigned int> chainNext;
+        std::vector<ObjIndex> vertexKeys;
+        chainNext.reserve(positionCount);
+        vertexKeys.reserve(positionCount);
+
+        for (ObjIndex corner : obj.corners)
+        {
+            if (corner.v == 0 || corner.v > positionCount)
+                throw std::runtime_error("OBJ face references missing vertex " + std::to_string(corner.v) + " in " + filename);
+
+            // Missing or out of range normals and texture coordinates fall back to zero
+            if (corner.vn > normalCount)
+                corner.vn = 0;
+            if (corner.vt > texCoordCount)
+                corner.vt = 0;
+
+            unsigned int index = chainHeads[corner.v - 1];
+            while (index != endOfChain && (vertexKeys[index].vt != corner.vt || vertexKeys[index].vn != corner.vn))
+                index = chainNext[index];
+
+            if (index == endOfChain)
+            {
+                // OBJ indices are 1-based, convert to 0-based
+                Vertex vertex = {};
+                vertex.position[0] = positions[(corner.v - 1) * 3];
+                vertex.position[1] = positions[(corner.v - 1) * 3 + 1];
+                vertex.position[2] = positions[(corner.v - 1) * 3 + 2];
+
+                if (corner.vn != 0)
+                {
+                    vertex.normal[0] = normals[(corner.vn - 1) * 3];
+                    vertex.normal[1] = normals[(corner.vn - 1) * 3 + 1];
+                    vertex.normal[2] = normals[(corner.vn - 1) * 3 + 2];
+                }
+
+                if (corner.vt != 0)
+                {
+                    vertex.texCoord[0] = texCoords[(corner.vt - 1) * 2];
+                    vertex.texCoord[1] = texCoords[(corner.vt - 1) * 2 + 1];
+                }
+
+                index = static_cast<unsigned int>(vertices.size());
+                vertices.push_back(vertex);
+                vertexKeys.push_back(corner);
+                chainNext.push_back(chainHeads[corner.v - 1]);
+                chainHeads[corner.v - 1] = index;
+            }
+
+            indices.push_back(index);
+        }
+
+        grn::Logger::debug("Welded " + std::to_string(indices.size()) + " face corners into " +
+                           std::to_string(vertices.size()) + " unique vertices");
+
+        generateTangents(vertices.data(), vertices.size(), indices.data(), indices.size(), options.threadCount);
+
+        // Corners became indices one to one, so the parts are index ranges already
+        std::vector<std::string> materialNames;
+        MeshData data;
+        data.format = options.vertexFormat;
+        data.submeshes = detail::splitObjParts(obj, materialNames);
+        data.materialLibraries = obj.materialLibraries;
+        data.materials = resolveMaterials(std::filesystem::path(filename).parent_path().string(), data.materialLibraries, materialNames);
+        data.vertices = std::move(vertices);
+        data.indices = std::move(indices);
+        obj = ObjData();
+
+        buildSubmeshes(data, options);
+        if (data.submeshes.size() > 1)
+            grn::Logger::debug("Split mesh into " + std::to_string(data.submeshes.size()) + " submeshes, " +
+                               std::to_string(data.materials.size()) + " materials");
+        if (options.meshlets)
+            grn::Logger::debug("Built " + std::to_string(data.meshlets.size()) + " meshlets");
+
+        data.bounds = computeBounds(data.vertices.data(), data.vertices.size());
+        data.sphere = data.vertices.empty() ? BoundingSphere{} : computeBoundingSphere(data.vertices.data()->position, data.vertices.size(), sizeof(Vertex));
+        if (options.vertexFormat == VertexFormat::Compact)
+            data.compactVertices = packVertices(data.vertices, data.bounds);
+        data.indexFormat = chooseIndexFormat(data.vertices.size());
+        if (data.indexFormat == IndexFormat::UInt16)
+            data.shortIndices = packIndices(data.indices);
+
+        if (hasStamp)
+        {
+            CookedMeshHeader header = {};
+            header.vertexStride = vertexStride(data.format);
+            header.flags = options.cookFlags();
+            header.indexStride = indexStride(data.indexFormat);
+            header.vertexCount = data.vertexCount();
+            header.indexCount = data.indexCount();
+            header.lodCount = data.lods.size();
+            header.meshletCount = data.meshlets.size();
+            header.submeshCount = data.submeshes.size();
+            header.materialCount = data.materials.size();
+            header.libraryCount = data.materialLibraries.size();
+            std::copy(data.bounds.min, data.bounds.min + 3, header.boundsMin);
+            std::copy(data.bounds.max, data.bounds.max + 3, header.boundsMax);
+            std::copy(data.sphere.center, data.sphere.center + 3, header.sphereCenter);
+            header.sphereRadius = data.sphere.radius;
+            header.source = stamp;
+
+            std::string strings;
+            for (const Material &material : data.materials)
+                strings.append(material.name).push_back('\0');
+            for (const std::string &library : data.materialLibraries)
+                strings.append(library).push_back('\0');
+            header.stringSize = strings.size();
+
+            if (!writeCookedMesh(cachePath, header, data.vertexData(), data.indexData(), data.lods.data(), data.meshlets.data(),
+                                 data.submeshes.data(), strings.data()))
+                grn::Logger::warning("Could not write mesh cache: " + cachePath);
+        }
+
+        grn::Logger::debug("Finished loading mesh data from OBJ file: " + filename);
+        return data;
+    }
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mesh_data.h"
+#include "parallel.h"
+
+namespace grn
+{
+    // A finished background load. Exactly one of `data` and `error` is meaningful.
+    struct LoadedMesh
+    {
+        size_t id;
+        std::string filename;
+        MeshData data;
+        std::exception_ptr error;
+    };
+
+    // Builds MeshData on a pool of worker threads. The render thread queues
+    // files with request() and picks up finished ones with takeFinished() once
+    // per frame, then uploads them with uploadMesh(). Nothing here touches GL.
+    class AsyncMeshLoader
+    {
+    public:
+        // threadCount 0 = all hardware threads
+        explicit AsyncMeshLoader(unsigned int threadCount = 0)
+        {
+            if (threadCount == 0)
+                threadCount = hardwareThreads();
+            for (unsigned int i = 0; i < threadCount; ++i)
+                m_workers.emplace_back([this]()
+                                       { workerLoop(); });
+        }
+
+        // Waits for the loads that are already running; queued ones are dropped
+        ~AsyncMeshLoader()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stopping = true;
+                m_queue.clear();
+            }
+            m_wakeUp.notify_all();
+            for (std::thread &worker : m_workers)
+                worker.join();
+        }
+
+        // Non-copyable
+        AsyncMeshLoader(const AsyncMeshLoader &) = delete;
+        AsyncMeshLoader &operator=(const AsyncMeshLoader &) = delete;
+
+        // Queues an OBJ file and returns the id its LoadedMesh will carry. With
+        // several workers each load parses single-threaded unless options says
+        // otherwise, which keeps the pool from oversubscribing the machine.
+        size_t request(const std::string &filename, MeshLoadOptions options = MeshLoadOptions())
+        {
+            if (options.threadCount == 0 && m_workers.size() > 1)
+                options.threadCount = 1;
+
+            size_t id;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                id = m_nextId++;
+                m_queue.push_back({id, filename, options});
+                ++m_pending;
+            }
+            m_wakeUp.notify_one();
+            return id;
+        }
+
+        // Moves out up to maxCount finished loads without blocking
+        std::vector<LoadedMesh> takeFinished(size_t maxCount = ~size_t(0))
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::vector<LoadedMesh> result;
+            while (!m_finished.empty() && result.size() < maxCount)
+            {
+                result.push_back(std::move(m_finished.front()));
+                m_finished.pop_front();
+            }
+            m_pending -= result.size();
+            return result;
+        }
+
+        // Number of requests that have not been taken out yet
+        size_t pending() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_pending;
+        }
+
+    private:
+        struct Job
+        {
+            size_t id;
+            std::string filename;
+            MeshLoadOptions options;
+        };
+
+        void workerLoop()
+        {
+            for (;;)
+            {
+                Job job;
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_wakeUp.wait(lock, [this]()
+                                  { return m_stopping || !m_queue.empty(); });
+                    if (m_stopping)
+                        return;
+                    job = std::move(m_queue.front());
+                    m_queue.pop_front();
+                }
+
+                LoadedMesh loaded{job.id, job.filename, MeshData(), nullptr};
+                try
+                {
+                    loaded.data = loadMeshDataOBJ(job.filename, job.options);
+                }
+                catch (...)
+                {
+                    loaded.error = std::current_exception();
+                }
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_finished.push_back(std::move(loaded));
+            }
+        }
+
+        std::vector<std::thread> m_workers;
+        mutable std::mutex m_mutex;
+        std::condition_variable m_wakeUp;
+        std::deque<Job> m_queue;
+        std::deque<LoadedMesh> m_finished;
+        size_t m_nextId = 0;
+        size_t m_pending = 0;
+        bool m_stopping = false;
+    };
+}
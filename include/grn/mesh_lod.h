@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "logger.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+
+namespace grn
+{
+    // One level of detail: a range of the mesh's index buffer. All levels index
+    // the same vertex buffer, level 0 is the full mesh.
+    struct MeshLod
+    {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        float error; // simplification error relative to the mesh extent
+    };
+
+    // Upper bound on levels per mesh, also used to validate cooked files
+    constexpr unsigned int MaxLodCount = 8;
+
+    // Appends up to lodCount - 1 simplified copies of the triangle list to
+    // `indices`, each aiming for half the triangles of the one before, and
+    // returns the ranges of all levels including the original. Every level is
+    // simplified from the previous one, so the whole chain costs about twice
+    // the first level, and its error is bounded by the sum of the steps. The
+    // chain stops early when a level would no longer save enough to be worth a
+    // draw, e.g. once the unlocked parts of a mesh are exhausted.
+    inline std::vector<MeshLod> buildLodChain(std::vector<unsigned int> &indices, const float *positions, size_t vertexCount, size_t positionStride, unsigned int lodCount)
+    {
+        // Beyond this a level would visibly change the silhouette
+        constexpr float maxError = 0.05f;
+        // A level must drop at least this share of the previous level's triangles
+        constexpr float minReduction = 0.2f;
+
+        std::vector<MeshLod> lods = {{0, static_cast<uint32_t>(indices.size()), 0.0f}};
+        lodCount = std::min(lodCount, MaxLodCount);
+
+        std::vector<unsigned int> previous = indices;
+        for (unsigned int level = 1; level < lodCount; ++level)
+        {
+            const float errorBudget = maxError - lods.back().error;
+            float error = 0.0f;
+            std::vector<unsigned int> simplified = simplifyMesh(previous.data(), previous.size(), positions, vertexCount, positionStride,
+                                                                previous.size() / 6 * 3, errorBudget, &error);
+            if (simplified.empty() || float(simplified.size()) > float(previous.size()) * (1.0f - minReduction))
+                break;
+
+            optimizeVertexCache(simplified.data(), simplified.size(), vertexCount);
+
+            MeshLod lod;
+            lod.firstIndex = static_cast<uint32_t>(indices.size());
+            lod.indexCount = static_cast<uint32_t>(simplified.size());
+            lod.error = lods.back().error + error;
+            indices.insert(indices.end(), simplified.begin(), simplified.end());
+            lods.push_back(lod);
+            previous = std::move(simplified);
+
+            grn::Logger::debug("LOD " + std::to_string(level) + ": " + std::to_string(lod.indexCount / 3) +
+                               " triangles, error " + std::to_string(lod.error));
+        }
+        return lods;
+    }
+
+    // Screen pixels covered by one world unit at distance 1, for a perspective
+    // projection built with the same fov as Matrix::getPerspectiveMatrix
+    inline float lodProjectionScale(float fov, float viewportHeight)
+    {
+        return viewportHeight / (2.0f * std::tan(fov / 2.0f));
+    }
+
+    // Picks the coarsest level whose error, projected to the screen, stays within
+    // maxPixelError pixels. `meshSize` is the world-space extent the errors are
+    // relative to (the bounds extent times the object's scale). Switching to a
+    // coarser level than `currentLod` needs the error to be `hysteresis` below
+    // the limit, so an object resting near a switching distance does not flicker.
+    inline size_t selectLod(const MeshLod *lods, size_t lodCount, float meshSize, float distance, float projectionScale,
+                            size_t currentLod, float maxPixelError = 1.0f, float hysteresis = 0.25f)
+    {
+        const float pixelsPerError = meshSize * projectionScale / std::max(distance, 1e-6f);
+
+        size_t selected = 0;
+        for (size_t i = 1; i < lodCount; ++i)
+        {
+            float limit = i > currentLod ? maxPixelError * (1.0f - hysteresis) : maxPixelError;
+            if (lods[i].error * pixelsPerError > limit)
+                break;
+            selected = i;
+        }
+        return selected;
+    }
+}
@@ -0,0 +1,339 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+namespace grn
+{
+    // Results of a FIFO post-transform cache simulation
+    struct VertexCacheStatistics
+    {
+        size_t vertexTransforms; // cache misses, i.e. vertex shader invocations
+        float acmr;              // average cache miss ratio: transforms per triangle (0.5 is ideal for large grids, 3 is worst)
+        float atvr;              // average transform to vertex ratio: transforms per vertex (1 is ideal)
+    };
+
+    // Simulates a FIFO post-transform cache of `cacheSize` entries over a triangle list
+    inline VertexCacheStatistics analyzeVertexCache(const unsigned int *indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = 16)
+    {
+        // A vertex is cached if fewer than cacheSize others entered the FIFO after it
+        std::vector<size_t> enteredAt(vertexCount, 0);
+        size_t misses = 0;
+
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            unsigned int v = indices[i];
+            if (enteredAt[v] == 0 || misses - enteredAt[v] >= cacheSize)
+            {
+                ++misses;
+                enteredAt[v] = misses;
+            }
+        }
+
+        VertexCacheStatistics stats;
+        stats.vertexTransforms = misses;
+        stats.acmr = indexCount ? float(misses) / float(indexCount / 3) : 0.0f;
+        stats.atvr = vertexCount ? float(misses) / float(vertexCount) : 0.0f;
+        return stats;
+    }
+
+    namespace detail
+    {
+        // Triangles around each vertex in compressed sparse row form
+        struct TriangleAdjacency
+        {
+            std::vector<unsigned int> offsets; // vertexCount + 1
+            std::vector<unsigned int> triangles;
+
+            TriangleAdjacency(const unsigned int *indices, size_t indexCount, size_t vertexCount)
+                : offsets(vertexCount + 1, 0), triangles(indexCount)
+            {
+                for (size_t i = 0; i < indexCount; ++i)
+                    ++offsets[indices[i] + 1];
+                for (size_t v = 0; v < vertexCount; ++v)
+                    offsets[v + 1] += offsets[v];
+
+                std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+                for (size_t i = 0; i < indexCount; ++i)
+                    triangles[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+            }
+        };
+
+        // Splits a triangle list into clusters at the points where a FIFO cache
+        // simulation reports a full flush (all three vertices missing). Within those
+        // hard clusters it adds soft boundaries wherever the running cache miss ratio
+        // has come down to `threshold` times the cluster's own ratio, so reordering
+        // the clusters later costs at most that factor in vertex cache efficiency.
+        inline std::vector<size_t> findClusters(const unsigned int *indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize, float threshold)
+        {
+            const size_t triangleCount = indexCount / 3;
+            std::vector<size_t> enteredAt(vertexCount, 0);
+            size_t misses = 0;
+
+            // Advancing the clock by a full cache length evicts everything in O(1)
+            auto flush = [&]()
+            { misses += cacheSize; };
+
+            auto simulate = [&](size_t triangle)
+            {
+                unsigned int count = 0;
+                for (int k = 0; k < 3; ++k)
+                {
+                    unsigned int v = indices[triangle * 3 + k];
+                    if (enteredAt[v] == 0 || misses - enteredAt[v] >= cacheSize)
+                    {
+                        ++misses;
+                        enteredAt[v] = misses;
+                        ++count;
+                    }
+                }
+                return count;
+            };
+
+            std::vector<size_t> hard;
+            for (size_t t = 0; t < triangleCount; ++t)
+            {
+                if (simulate(t) == 3 || t == 0)
+                    hard.push_back(t);
+            }
+            hard.push_back(triangleCount);
+
+            std::vector<size_t> clusters;
+            for (size_t h = 0; h + 1 < hard.size(); ++h)
+            {
+                const size_t start = hard[h];
+                const size_t end = hard[h + 1];
+
+                flush();
+                size_t clusterMisses = 0;
+                for (size_t t = start; t < end; ++t)
+                    clusterMisses += simulate(t);
+                const float clusterThreshold = threshold * float(clusterMisses) / float(end - start);
+
+                flush();
+                clusters.push_back(start);
+                size_t runningMisses = 0;
+                size_t runningStart = start;
+                for (size_t t = start; t < end; ++t)
+                {
+                    runningMisses += simulate(t);
+                    if (t + 1 < end && float(runningMisses) <= float(t + 1 - runningStart) * clusterThreshold)
+                    {
+                        clusters.push_back(t + 1);
+                        flush();
+                        runningMisses = 0;
+                        runningStart = t + 1;
+                    }
+                }
+            }
+            clusters.push_back(triangleCount);
+            return clusters;
+        }
+    }
+
+    // Reorders triangles for the post-transform vertex cache with Tipsify (Sander,
+    // Nehab, Barczak: "Fast Triangle Reordering for Vertex Locality and Reduced
+    // Overdraw", 2007). Runs in linear time; the triangles themselves and their
+    // winding are unchanged, only their order.
+    inline void optimizeVertexCache(unsigned int *indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = 16)
+    {
+        const size_t triangleCount = indexCount / 3;
+        if (triangleCount == 0)
+            return;
+
+        detail::TriangleAdjacency adjacency(indices, indexCount, vertexCount);
+
+        std::vector<unsigned int> liveTriangles(vertexCount);
+        for (size_t v = 0; v < vertexCount; ++v)
+            liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+
+        std::vector<size_t> cacheTime(vertexCount, 0);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<unsigned int> deadEnd;
+        std::vector<unsigned int> candidates;
+        std::vector<unsigned int> result;
+        result.reserve(indexCount);
+
+        size_t time = cacheSize + 1;
+        size_t cursor = 0;
+
+        auto skipDeadEnd = [&]() -> long long
+        {
+            while (!deadEnd.empty())
+            {
+                unsigned int v = deadEnd.back();
+                deadEnd.pop_back();
+                if (liveTriangles[v] > 0)
+                    return v;
+            }
+            for (; cursor < vertexCount; ++cursor)
+            {
+                if (liveTriangles[cursor] > 0)
+                    return static_cast<long long>(cursor);
+            }
+            return -1;
+        };
+
+        long long fan = skipDeadEnd();
+        while (fan >= 0)
+        {
+            candidates.clear();
+
+            for (unsigned int a = adjacency.offsets[fan]; a < adjacency.offsets[fan + 1]; ++a)
+            {
+                unsigned int triangle = adjacency.triangles[a];
+                if (emitted[triangle])
+                    continue;
+
+                for (int k = 0; k < 3; ++k)
+                {
+                    unsigned int v = indices[triangle * 3 + k];
+                    result.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    --liveTriangles[v];
+                    if (time - cacheTime[v] > cacheSize)
+                        cacheTime[v] = time++;
+                }
+                emitted[triangle] = true;
+            }
+
+            // Next fanning vertex: the candidate that will still be in the cache after
+            // its remaining triangles are emitted and that entered it the earliest.
+            // If there is none, fall back to recently used vertices (dead-end stack).
+            long long best = -1;
+            size_t bestPriority = 0;
+            for (unsigned int v : candidates)
+            {
+                if (liveTriangles[v] == 0)
+                    continue;
+
+                size_t priority = 0;
+                if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                    priority = time - cacheTime[v];
+                if (priority > bestPriority)
+                {
+                    bestPriority = priority;
+                    best = v;
+                }
+            }
+
+            fan = best >= 0 ? best : skipDeadEnd();
+        }
+
+        std::copy(result.begin(), result.end(), indices);
+    }
+
+    // Reorders the clusters of a cache-optimized triangle list so that triangles
+    // facing outwards from the mesh centre come first. Those are the likely
+    // occluders, so drawing them early lets the depth test reject the expensive
+    // fragments behind them. `threshold` (>= 1) bounds how much vertex cache
+    // efficiency may be traded for it. Positions are read as three floats at
+    // `positionStride` bytes apart.
+    inline void optimizeOverdraw(unsigned int *indices, size_t indexCount, const float *positions, size_t vertexCount, size_t positionStride, float threshold = 1.05f, unsigned int cacheSize = 16)
+    {
+        const size_t triangleCount = indexCount / 3;
+        if (triangleCount == 0)
+            return;
+
+        auto position = [&](unsigned int v)
+        {
+            return reinterpret_cast<const float *>(reinterpret_cast<const char *>(positions) + v * positionStride);
+        };
+
+        std::vector<size_t> clusters = detail::findClusters(indices, indexCount, vertexCount, cacheSize, threshold);
+        const size_t clusterCount = clusters.size() - 1;
+
+        // Area-weighted centroid and normal of every cluster and of the whole mesh
+        std::vector<float> clusterData(clusterCount * 6, 0.0f);
+        float meshCentroid[3] = {0.0f, 0.0f, 0.0f};
+        float meshArea = 0.0f;
+
+        for (size_t c = 0; c < clusterCount; ++c)
+        {
+            float *centroid = &clusterData[c * 6];
+            float *normal = &clusterData[c * 6 + 3];
+            float clusterArea = 0.0f;
+
+            for (size_t t = clusters[c]; t < clusters[c + 1]; ++t)
+            {
+                const float *p0 = position(indices[t * 3]);
+                const float *p1 = position(indices[t * 3 + 1]);
+                const float *p2 = position(indices[t * 3 + 2]);
+
+                float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+                float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+                float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+                float area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+                for (int k = 0; k < 3; ++k)
+                {
+                    float center = (p0[k] + p1[k] + p2[k]) / 3.0f;
+                    centroid[k] += center * area;
+                    meshCentroid[k] += center * area;
+                    normal[k] += n[k];
+                }
+                clusterArea += area;
+            }
+
+            for (int k = 0; k < 3; ++k)
+                centroid[k] = clusterArea > 0.0f ? centroid[k] / clusterArea : 0.0f;
+            meshArea += clusterArea;
+        }
+        for (int k = 0; k < 3; ++k)
+            meshCentroid[k] = meshArea > 0.0f ? meshCentroid[k] / meshArea : 0.0f;
+
+        std::vector<float> sortKey(clusterCount);
+        for (size_t c = 0; c < clusterCount; ++c)
+        {
+            const float *centroid = &clusterData[c * 6];
+            const float *normal = &clusterData[c * 6 + 3];
+            float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            float dot = (centroid[0] - meshCentroid[0]) * normal[0] +
+                        (centroid[1] - meshCentroid[1]) * normal[1] +
+                        (centroid[2] - meshCentroid[2]) * normal[2];
+            sortKey[c] = length > 0.0f ? dot / length : 0.0f;
+        }
+
+        std::vector<size_t> order(clusterCount);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+                         { return sortKey[a] > sortKey[b]; });
+
+        std::vector<unsigned int> result;
+        result.reserve(indexCount);
+        for (size_t c : order)
+            result.insert(result.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+        std::copy(result.begin(), result.end(), indices);
+    }
+
+    // Renumbers vertices in the order the index buffer first references them, so
+    // vertex fetch walks memory roughly linearly. Vertices no index refers to are
+    // dropped. Returns the new vertex count.
+    template <typename VertexType>
+    size_t optimizeVertexFetch(std::vector<VertexType> &vertices, unsigned int *indices, size_t indexCount)
+    {
+        constexpr unsigned int unused = ~0u;
+        std::vector<unsigned int> remap(vertices.size(), unused);
+        std::vector<VertexType> reordered;
+        reordered.reserve(vertices.size());
+
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            unsigned int &target = remap[indices[i]];
+            if (target == unused)
+            {
+                target = static_cast<unsigned int>(reordered.size());
+                reordered.push_back(vertices[indices[i]]);
+            }
+            indices[i] = target;
+        }
+
+        vertices.swap(reordered);
+        return vertices.size();
+    }
+}
@@ -0,0 +1,297 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace grn
+{
+    namespace detail
+    {
+        // Symmetric 4x4 error quadric (Garland & Heckbert 1997), upper triangle,
+        // plus the total plane weight so errors can be reported as distances
+        struct Quadric
+        {
+            double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33, w;
+
+            static Quadric fromPlane(double a, double b, double c, double d, double weight)
+            {
+                return {a * a * weight, a * b * weight, a * c * weight, a * d * weight,
+                        b * b * weight, b * c * weight, b * d * weight,
+                        c * c * weight, c * d * weight,
+                        d * d * weight, weight};
+            }
+
+            void add(const Quadric &q)
+            {
+                a00 += q.a00, a01 += q.a01, a02 += q.a02, a03 += q.a03;
+                a11 += q.a11, a12 += q.a12, a13 += q.a13;
+                a22 += q.a22, a23 += q.a23, a33 += q.a33;
+                w += q.w;
+            }
+
+            // Weighted sum of the squared distances from p to the accumulated planes
+            double evaluate(const float *p) const
+            {
+                double x = p[0], y = p[1], z = p[2];
+                double r = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x +
+                           a11 * y * y + 2 * a12 * y * z + 2 * a13 * y +
+                           a22 * z * z + 2 * a23 * z + a33;
+                return r < 0.0 ? 0.0 : r;
+            }
+        };
+
+        // Mean squared distance of `to` from the planes of both endpoints
+        inline double collapseError(const Quadric &from, const Quadric &to, const float *p)
+        {
+            double weight = from.w + to.w;
+            return weight > 0.0 ? (from.evaluate(p) + to.evaluate(p)) / weight : 0.0;
+        }
+
+        inline void triangleNormal(const float *p0, const float *p1, const float *p2, float *normal)
+        {
+            float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+            float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+            normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+            normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+            normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+        }
+    }
+
+    // Reduces a triangle list towards targetIndexCount indices by collapsing edges
+    // in order of quadric error. Vertices are never moved or created: an edge
+    // collapses onto one of its endpoints, so every result indexes the original
+    // vertex buffer and several LODs can share it. Vertices on open borders or on
+    // attribute seams (several vertices at one position) are locked so the
+    // simplified mesh keeps its outline and does not crack along UV seams.
+    //
+    // Stops early once the next collapse would exceed targetError, given relative
+    // to the mesh extent. The error of the result, in the same unit, is written to
+    // resultError if given.
+    inline std::vector<unsigned int> simplifyMesh(const unsigned int *indices, size_t indexCount, const float *positions, size_t vertexCount, size_t positionStride,
+                                                  size_t targetIndexCount, float targetError, float *resultError = nullptr)
+    {
+        auto position = [&](unsigned int v)
+        {
+            return reinterpret_cast<const float *>(reinterpret_cast<const char *>(positions) + v * positionStride);
+        };
+
+        std::vector<unsigned int> result(indices, indices + indexCount);
+        if (resultError)
+            *resultError = 0.0f;
+        if (indexCount <= targetIndexCount || vertexCount == 0)
+            return result;
+
+        // Mesh extent, the unit of targetError
+        float lo[3], hi[3];
+        for (int k = 0; k < 3; ++k)
+            lo[k] = hi[k] = position(indices[0])[k];
+        for (size_t i = 0; i < indexCount; ++i)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                lo[k] = std::min(lo[k], position(indices[i])[k]);
+                hi[k] = std::max(hi[k], position(indices[i])[k]);
+            }
+        }
+        const double extent = std::max({hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2], 1e-12f});
+        const double maxError = double(targetError) * extent;
+        const double maxCost = maxError * maxError;
+
+        // Triangles around every vertex, rebuilt after every pass
+        std::vector<unsigned int> adjacencyOffsets(vertexCount + 1);
+        std::vector<unsigned int> adjacency;
+        auto buildAdjacency = [&]()
+        {
+            std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+            for (unsigned int v : result)
+                ++adjacencyOffsets[v + 1];
+            for (size_t v = 0; v < vertexCount; ++v)
+                adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+            adjacency.resize(result.size());
+            std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (size_t i = 0; i < result.size(); ++i)
+                adjacency[fill[result[i]]++] = static_cast<unsigned int>(i / 3);
+        };
+        buildAdjacency();
+
+        std::vector<unsigned char> locked(vertexCount, 0);
+
+        // Seams: welded vertices that share a position but differ in normal or UV
+        {
+            std::vector<unsigned int> order(vertexCount);
+            for (unsigned int v = 0; v < vertexCount; ++v)
+                order[v] = v;
+            auto less = [&](unsigned int a, unsigned int b)
+            {
+                return std::lexicographical_compare(position(a), position(a) + 3, position(b), position(b) + 3);
+            };
+            std::sort(order.begin(), order.end(), less);
+            for (size_t i = 1; i < vertexCount; ++i)
+            {
+                if (!less(order[i - 1], order[i]))
+                    locked[order[i - 1]] = locked[order[i]] = 1;
+            }
+        }
+
+        // Borders: an edge v -> n in v's fan without the opposite n -> v
+        for (unsigned int v = 0; v < vertexCount; ++v)
+        {
+            for (unsigned int a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1] && !locked[v]; ++a)
+            {
+                const unsigned int *triangle = &result[adjacency[a] * 3];
+                int k = triangle[0] == v ? 0 : (triangle[1] == v ? 1 : 2);
+                unsigned int next = triangle[(k + 1) % 3], previous = triangle[(k + 2) % 3];
+
+                bool nextPaired = false, previousPaired = false;
+                for (unsigned int b = adjacencyOffsets[v]; b < adjacencyOffsets[v + 1]; ++b)
+                {
+                    const unsigned int *other = &result[adjacency[b] * 3];
+                    int j = other[0] == v ? 0 : (other[1] == v ? 1 : 2);
+                    nextPaired |= other[(j + 2) % 3] == next;
+                    previousPaired |= other[(j + 1) % 3] == previous;
+                }
+                if (!nextPaired)
+                    locked[v] = locked[next] = 1;
+                if (!previousPaired)
+                    locked[v] = locked[previous] = 1;
+            }
+        }
+
+        std::vector<detail::Quadric> quadrics(vertexCount, detail::Quadric{});
+        for (size_t i = 0; i < indexCount; i += 3)
+        {
+            const float *p0 = position(indices[i]);
+            float n[3];
+            detail::triangleNormal(p0, position(indices[i + 1]), position(indices[i + 2]), n);
+            double area = std::sqrt(double(n[0]) * n[0] + double(n[1]) * n[1] + double(n[2]) * n[2]);
+            if (area <= 0.0)
+                continue;
+            double a = n[0] / area, b = n[1] / area, c = n[2] / area;
+            double d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+            detail::Quadric q = detail::Quadric::fromPlane(a, b, c, d, area * 0.5);
+            for (int k = 0; k < 3; ++k)
+                quadrics[indices[i + k]].add(q);
+        }
+
+        struct Collapse
+        {
+            unsigned int from, to;
+            double cost;
+        };
+
+        std::vector<unsigned int> remap(vertexCount);
+        std::vector<unsigned char> touched(vertexCount);
+        std::vector<Collapse> collapses;
+        double acceptedCost = 0.0;
+
+        for (bool first = true; result.size() > targetIndexCount; first = false)
+        {
+            if (!first)
+                buildAdjacency();
+
+            // Cheapest collapse for every unlocked vertex. Interior vertices are
+            // manifold, so every neighbour follows v in exactly one triangle of its fan.
+            collapses.clear();
+            for (unsigned int v = 0; v < vertexCount; ++v)
+            {
+                if (locked[v] || adjacencyOffsets[v] == adjacencyOffsets[v + 1])
+                    continue;
+
+                Collapse best = {v, v, 0.0};
+                for (unsigned int a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; ++a)
+                {
+                    const unsigned int *triangle = &result[adjacency[a] * 3];
+                    unsigned int target = triangle[triangle[0] == v ? 1 : (triangle[1] == v ? 2 : 0)];
+                    double cost = detail::collapseError(quadrics[v], quadrics[target], position(target));
+                    if (best.to == v || cost < best.cost)
+                        best = {v, target, cost};
+                }
+                if (best.to != v && best.cost <= maxCost)
+                    collapses.push_back(best);
+            }
+            if (collapses.empty())
+                break;
+
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b)
+                      { return a.cost < b.cost; });
+
+            // Apply collapses greedily; a vertex whose fan changed this pass is not
+            // touched again until the next pass, which keeps the flip test exact
+            for (unsigned int v = 0; v < vertexCount; ++v)
+                remap[v] = v;
+            std::fill(touched.begin(), touched.end(), 0);
+
+            size_t triangleCount = result.size() / 3;
+            const size_t targetTriangles = targetIndexCount / 3;
+            bool collapsedAny = false;
+
+            for (const Collapse &collapse : collapses)
+            {
+                if (triangleCount <= targetTriangles)
+                    break;
+                if (touched[collapse.from] || touched[collapse.to])
+                    continue;
+
+                // Reject collapses that would flip a remaining triangle
+                const float *target = position(collapse.to);
+                bool flips = false;
+                size_t removed = 0;
+                for (unsigned int a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1] && !flips; ++a)
+                {
+                    const unsigned int *triangle = &result[adjacency[a] * 3];
+                    if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                    {
+                        ++removed;
+                        continue;
+                    }
+
+                    const float *before[3], *after[3];
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        before[k] = position(triangle[k]);
+                        after[k] = triangle[k] == collapse.from ? target : before[k];
+                    }
+                    float n0[3], n1[3];
+                    detail::triangleNormal(before[0], before[1], before[2], n0);
+                    detail::triangleNormal(after[0], after[1], after[2], n1);
+                    flips = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0.0f;
+                }
+                if (flips)
+                    continue;
+
+                for (unsigned int a = adjacencyOffsets[collapse.from]; a < adjacencyOffsets[collapse.from + 1]; ++a)
+                {
+                    const unsigned int *triangle = &result[adjacency[a] * 3];
+                    touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+                }
+
+                remap[collapse.from] = collapse.to;
+                quadrics[collapse.to].add(quadrics[collapse.from]);
+                triangleCount -= removed;
+                acceptedCost = std::max(acceptedCost, collapse.cost);
+                collapsedAny = true;
+            }
+            if (!collapsedAny)
+                break;
+
+            // Rewrite through the remap and drop the triangles that degenerated
+            size_t write = 0;
+            for (size_t i = 0; i < result.size(); i += 3)
+            {
+                unsigned int a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+                if (a == b || b == c || a == c)
+                    continue;
+                result[write++] = a;
+                result[write++] = b;
+                result[write++] = c;
+            }
+            result.resize(write);
+        }
+
+        if (resultError)
+            *resultError = static_cast<float>(std::sqrt(acceptedCost) / extent);
+        return result;
+    }
+}
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "frustum.h"
+#include "mesh_optimizer.h"
+
+namespace grn
+{
+    // A small cluster of triangles that is culled as a unit. Its triangles are
+    // a contiguous range of the mesh's index buffer; bounds are in model space.
+    struct Meshlet
+    {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        uint32_t vertexCount; // unique vertices referenced
+
+        // Bounding sphere
+        float center[3];
+        float radius;
+
+        // Normal cone: every triangle faces away from a camera inside the cone
+        // opening behind the apex. coneCutoff > 1 means the cone cannot be used
+        // (the triangles face too many directions).
+        float coneApex[3];
+        float coneAxis[3];
+        float coneCutoff;
+    };
+
+    // A range of an index buffer to draw
+    struct IndexRange
+    {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+    };
+
+    namespace detail
+    {
+        inline Meshlet finishMeshlet(const unsigned int *indices, uint32_t firstIndex, uint32_t indexCount, const std::vector<unsigned int> &vertices,
+                                     const float *positions, size_t positionStride)
+        {
+            auto position = [&](unsigned int v)
+            {
+                return reinterpret_cast<const float *>(reinterpret_cast<const char *>(positions) + v * positionStride);
+            };
+
+            Meshlet meshlet = {};
+            meshlet.firstIndex = firstIndex;
+            meshlet.indexCount = indexCount;
+            meshlet.vertexCount = static_cast<uint32_t>(vertices.size());
+
+            // Sphere around the box centre; not minimal, but cheap and close for compact clusters
+            float lo[3] = {position(vertices[0])[0], position(vertices[0])[1], position(vertices[0])[2]};
+            float hi[3] = {lo[0], lo[1], lo[2]};
+            for (unsigned int v : vertices)
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    lo[k] = std::min(lo[k], position(v)[k]);
+                    hi[k] = std::max(hi[k], position(v)[k]);
+                }
+            }
+            for (int k = 0; k < 3; ++k)
+                meshlet.center[k] = (lo[k] + hi[k]) * 0.5f;
+            float radiusSquared = 0.0f;
+            for (unsigned int v : vertices)
+            {
+                const float *p = position(v);
+                float dx = p[0] - meshlet.center[0], dy = p[1] - meshlet.center[1], dz = p[2] - meshlet.center[2];
+                radiusSquared = std::max(radiusSquared, dx * dx + dy * dy + dz * dz);
+            }
+            meshlet.radius = std::sqrt(radiusSquared);
+
+            // Cone axis is the mean triangle normal, its opening the widest deviation from it
+            const size_t triangleCount = indexCount / 3;
+            std::vector<float> normals(triangleCount * 3, 0.0f);
+            float axis[3] = {0.0f, 0.0f, 0.0f};
+            for (size_t t = 0; t < triangleCount; ++t)
+            {
+                const unsigned int *triangle = indices + firstIndex + t * 3;
+                const float *p0 = position(triangle[0]);
+                const float *p1 = position(triangle[1]);
+                const float *p2 = position(triangle[2]);
+                float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+                float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+                float *n = &normals[t * 3];
+                n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+                n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+                n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+                float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                if (length <= 0.0f)
+                    continue; // zero area, faces nowhere
+                for (int k = 0; k < 3; ++k)
+                {
+                    n[k] /= length;
+                    axis[k] += n[k];
+                }
+            }
+
+            meshlet.coneCutoff = 2.0f;
+            std::copy(meshlet.center, meshlet.center + 3, meshlet.coneApex);
+            float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+            if (axisLength <= 0.0f)
+                return meshlet;
+            for (int k = 0; k < 3; ++k)
+                meshlet.coneAxis[k] = axis[k] / axisLength;
+
+            float minDot = 1.0f;
+            for (size_t t = 0; t < triangleCount; ++t)
+            {
+                const float *n = &normals[t * 3];
+                if (n[0] == 0.0f && n[1] == 0.0f && n[2] == 0.0f)
+                    continue;
+                minDot = std::min(minDot, n[0] * meshlet.coneAxis[0] + n[1] * meshlet.coneAxis[1] + n[2] * meshlet.coneAxis[2]);
+            }
+            // Wider than about 84 degrees the cone would almost never cull anything
+            if (minDot <= 0.1f)
+                return meshlet;
+
+            // Move the apex back along the axis until every triangle plane is in front of it
+            float apexDistance = 0.0f;
+            for (size_t t = 0; t < triangleCount; ++t)
+            {
+                const float *n = &normals[t * 3];
+                float facing = n[0] * meshlet.coneAxis[0] + n[1] * meshlet.coneAxis[1] + n[2] * meshlet.coneAxis[2];
+                if (facing <= 0.0f)
+                    continue;
+                const float *p0 = position(indices[firstIndex + t * 3]);
+                float offset = n[0] * (meshlet.center[0] - p0[0]) + n[1] * (meshlet.center[1] - p0[1]) + n[2] * (meshlet.center[2] - p0[2]);
+                apexDistance = std::max(apexDistance, offset / facing);
+            }
+            for (int k = 0; k < 3; ++k)
+                meshlet.coneApex[k] = meshlet.center[k] - meshlet.coneAxis[k] * apexDistance;
+            meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+            return meshlet;
+        }
+    }
+
+    // Splits a triangle list into meshlets of at most maxVertices unique vertices
+    // and maxTriangles triangles, rewriting `indices` so every meshlet's
+    // triangles are contiguous. Meshlets grow greedily across shared vertices,
+    // preferring triangles that add the fewest new vertices, and are seeded in
+    // the existing triangle order, so a cache-optimized mesh keeps most of its
+    // locality. The defaults match what mesh shading hardware favours.
+    inline std::vector<Meshlet> buildMeshlets(unsigned int *indices, size_t indexCount, const float *positions, size_t vertexCount, size_t positionStride,
+                                              size_t maxVertices = 64, size_t maxTriangles = 124)
+    {
+        std::vector<Meshlet> meshlets;
+        const size_t triangleCount = indexCount / 3;
+        if (triangleCount == 0)
+            return meshlets;
+
+        detail::TriangleAdjacency adjacency(indices, indexCount, vertexCount);
+        std::vector<unsigned char> emitted(triangleCount, 0);
+        std::vector<uint32_t> vertexMeshlet(vertexCount, ~0u); // last meshlet a vertex was added to
+        std::vector<unsigned int> output;
+        output.reserve(indexCount);
+
+        std::vector<unsigned int> meshletVertices;
+        std::vector<unsigned int> candidates;
+        size_t meshletTriangles = 0;
+        size_t seed = 0;
+
+        auto newVertices = [&](size_t triangle)
+        {
+            const uint32_t current = static_cast<uint32_t>(meshlets.size());
+            const unsigned int *corners = indices + triangle * 3;
+            return size_t(vertexMeshlet[corners[0]] != current) + size_t(vertexMeshlet[corners[1]] != current) +
+                   size_t(vertexMeshlet[corners[2]] != current);
+        };
+
+        auto finish = [&]()
+        {
+            const size_t first = output.size() - meshletTriangles * 3;
+            meshlets.push_back(detail::finishMeshlet(output.data(), static_cast<uint32_t>(first), static_cast<uint32_t>(meshletTriangles * 3),
+                                                     meshletVertices, positions, positionStride));
+            meshletVertices.clear();
+            candidates.clear();
+            meshletTriangles = 0;
+        };
+
+        for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+        {
+            // Best connected triangle that still fits
+            size_t best = triangleCount, bestNew = 4;
+            size_t write = 0;
+            for (size_t i = 0; i < candidates.size(); ++i)
+            {
+                unsigned int triangle = candidates[i];
+                if (emitted[triangle])
+                    continue;
+                candidates[write++] = triangle;
+                size_t added = newVertices(triangle);
+                if (added < bestNew && meshletVertices.size() + added <= maxVertices)
+                {
+                    best = triangle;
+                    bestNew = added;
+                }
+            }
+            candidates.resize(write);
+
+            if (best == triangleCount || meshletTriangles == maxTriangles)
+            {
+                if (meshletTriangles > 0)
+                    finish();
+                while (emitted[seed])
+                    ++seed;
+                best = seed;
+            }
+
+            const uint32_t current = static_cast<uint32_t>(meshlets.size());
+            for (int k = 0; k < 3; ++k)
+            {
+                unsigned int v = indices[best * 3 + k];
+                output.push_back(v);
+                if (vertexMeshlet[v] == current)
+                    continue;
+                vertexMeshlet[v] = current;
+                meshletVertices.push_back(v);
+                for (unsigned int a = adjacency.offsets[v]; a < adjacency.offsets[v + 1]; ++a)
+                {
+                    if (!emitted[adjacency.triangles[a]])
+                        candidates.push_back(adjacency.triangles[a]);
+                }
+            }
+            emitted[best] = 1;
+            ++meshletTriangles;
+        }
+        finish();
+
+        std::copy(output.begin(), output.end(), indices);
+        return meshlets;
+    }
+
+    // Appends the index ranges of the meshlets that survive frustum and normal
+    // cone culling to `ranges`, merging neighbours so a mostly visible mesh still
+    // takes few ranges. `frustum` and `cameraPosition` must be in the meshlets'
+    // model space (see Frustum::fromMatrix). Returns the number of culled meshlets.
+    inline size_t cullMeshlets(const Meshlet *meshlets, size_t meshletCount, const Frustum &frustum, const float *cameraPosition, std::vector<IndexRange> &ranges)
+    {
+        size_t culled = 0;
+        for (size_t i = 0; i < meshletCount; ++i)
+        {
+            const Meshlet &meshlet = meshlets[i];
+            if (!frustum.intersectsSphere(meshlet.center, meshlet.radius))
+            {
+                ++culled;
+                continue;
+            }
+
+            float view[3] = {meshlet.coneApex[0] - cameraPosition[0], meshlet.coneApex[1] - cameraPosition[1], meshlet.coneApex[2] - cameraPosition[2]};
+            float distance = std::sqrt(view[0] * view[0] + view[1] * view[1] + view[2] * view[2]);
+            if (meshlet.coneCutoff <= 1.0f &&
+                view[0] * meshlet.coneAxis[0] + view[1] * meshlet.coneAxis[1] + view[2] * meshlet.coneAxis[2] >= meshlet.coneCutoff * distance)
+            {
+                ++culled;
+                continue;
+            }
+
+            if (!ranges.empty() && ranges.back().firstIndex + ranges.back().indexCount == meshlet.firstIndex)
+                ranges.back().indexCount += meshlet.indexCount;
+            else
+                ranges.push_back({meshlet.firstIndex, meshlet.indexCount});
+        }
+        return culled;
+    }
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+#include <grn/matrix.h>
+#include "gltf.h"
+#include "logger.h"
+#include "material.h"
+
+namespace grn
+{
+
+    struct ModelPart
+    {
+        GLuint VAO;
+        GLenum mode;
+        GLsizei count;      // indices, or vertices if not indexed
+        bool indexed;
+        GLenum indexType;
+        const void *indexOffset; // in the element buffer bound to the VAO
+        uint32_t material;       // index into Model::materials, or NoMaterial
+    };
+
+    // A glTF model on the GPU. Each buffer view is one GL buffer holding the
+    // file's bytes unchanged; the VAOs of the parts point into them.
+    struct Model
+    {
+        std::vector<GLuint> buffers;              // per buffer view, 0 if unused
+        std::vector<std::vector<ModelPart>> meshes; // parts per glTF mesh
+        std::vector<ModelInstance> instances;
+        std::vector<Material> materials;
+        Bounds bounds;
+    };
+
+    // Uploads loaded glTF data. Must run on the thread that owns the GL context;
+    // loadModelDataGLB() can run on workers. Buffer views go to GL straight from
+    // the file mapping and accessors become attribute pointers into them, so no
+    // vertex is touched on the CPU.
+    static Model uploadModel(const ModelData &data)
+    {
+        Model model;
+        model.instances = data.instances;
+        model.materials = data.materials;
+        model.bounds = data.bounds;
+
+        // Only views referenced by a primitive are uploaded
+        std::vector<unsigned char> used(data.bufferViews.size(), 0);
+        for (const ModelMesh &mesh : data.meshes)
+        {
+            for (const ModelPrimitive &primitive : mesh.primitives)
+            {
+                for (const ModelVertexAttribute &attribute : primitive.attributes)
+                    used[attribute.bufferView] = 1;
+                if (primitive.indexed)
+                    used[primitive.indexBufferView] = 1;
+            }
+        }
+
+        model.buffers.assign(data.bufferViews.size(), 0);
+        for (size_t i = 0; i < data.bufferViews.size(); ++i)
+        {
+            if (!used[i])
+                continue;
+            const ModelBufferView &view = data.bufferViews[i];
+            glGenBuffers(1, &model.buffers[i]);
+            glBindBuffer(GL_ARRAY_BUFFER, model.buffers[i]);
+            glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(view.byteLength), data.binary + view.byteOffset, GL_STATIC_DRAW);
+        }
+
+        for (const ModelMesh &mesh : data.meshes)
+        {
+            std::vector<ModelPart> parts;
+            for (const ModelPrimitive &primitive : mesh.primitives)
+            {
+                ModelPart part;
+                part.mode = primitive.mode;
+                part.indexed = primitive.indexed;
+                part.count = static_cast<GLsizei>(primitive.indexed ? primitive.indexCount : primitive.vertexCount);
+                part.indexType = primitive.indexType;
+                part.indexOffset = (const void *)size_t(primitive.indexByteOffset);
+                part.material = primitive.material;
+
+                glGenVertexArrays(1, &part.VAO);
+                glBindVertexArray(part.VAO);
+                for (const ModelVertexAttribute &attribute : primitive.attributes)
+                {
+                    glBindBuffer(GL_ARRAY_BUFFER, model.buffers[attribute.bufferView]);
+                    const void *offset = (const void *)size_t(attribute.byteOffset);
+                    if (attribute.integer)
+                        glVertexAttribIPointer(attribute.location, attribute.componentCount, attribute.componentType, attribute.byteStride, offset);
+                    else
+                        glVertexAttribPointer(attribute.location, attribute.componentCount, attribute.componentType,
+                                              attribute.normalized ? GL_TRUE : GL_FALSE, attribute.byteStride, offset);
+                    glEnableVertexAttribArray(attribute.location);
+                }
+                if (primitive.indexed)
+                    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.buffers[primitive.indexBufferView]);
+                glBindVertexArray(0);
+                parts.push_back(part);
+            }
+            model.meshes.push_back(std::move(parts));
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        return model;
+    }
+
+    // Draws every instance, setting the `model` uniform at `modelLoc` to
+    // transform * instance transform and the `normalMatrix` uniform at
+    // `normalMatrixLoc` to its normal matrix. Binds the VAOs it uses.
+    static void drawModel(const Model &model, GLint modelLoc, GLint normalMatrixLoc, const Matrix &transform)
+    {
+        for (const ModelInstance &instance : model.instances)
+        {
+            const Matrix world = transform * instance.transform;
+            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, world);
+            glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, Matrix::getNormalMatrix(world));
+            for (const ModelPart &part : model.meshes[instance.mesh])
+            {
+                glBindVertexArray(part.VAO);
+                if (part.indexed)
+                    glDrawElements(part.mode, part.count, part.indexType, part.indexOffset);
+                else
+                    glDrawArrays(part.mode, 0, part.count);
+            }
+        }
+    }
+
+    static void destroyModel(Model &model)
+    {
+        for (const std::vector<ModelPart> &parts : model.meshes)
+        {
+            for (const ModelPart &part : parts)
+                glDeleteVertexArrays(1, &part.VAO);
+        }
+        for (GLuint buffer : model.buffers)
+        {
+            if (buffer)
+                glDeleteBuffers(1, &buffer);
+        }
+        model.meshes.clear();
+        model.buffers.clear();
+    }
+
+    // Loads and uploads a binary glTF file on the calling thread
+    static Model loadFromFileGLB(const std::string &filename)
+    {
+        Model model = uploadModel(loadModelDataGLB(filename));
+        grn::Logger::debug("Finished creating model from glTF file: " + filename);
+        return model;
+    }
+
+}
@@ -0,0 +1,483 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "logger.h"
+#include "parallel.h"
+
+namespace grn
+{
+    // One face corner as written in the file. Indices are 1-based, 0 means the
+    // component was omitted (e.g. "3//7" has no texture coordinate).
+    struct ObjIndex
+    {
+        unsigned int v, vt, vn;
+    };
+
+    // An o, g or usemtl record: everything from face corner `corner` on belongs
+    // to the named object, group or material until the next record of the same kind
+    struct ObjMarker
+    {
+        enum Kind : uint8_t
+        {
+            Object,
+            Group,
+            Material
+        };
+
+        Kind kind;
+        size_t corner;
+        std::string name;
+    };
+
+    // Raw attribute streams of an OBJ file, before vertices are assembled
+    struct ObjData
+    {
+        std::vector<float> positions;               // x, y, z
+        std::vector<float> normals;                 // x, y, z
+        std::vector<float> texCoords;               // u, v
+        std::vector<ObjIndex> corners;              // three per triangle, polygons are fan-triangulated
+        std::vector<ObjMarker> markers;             // in file order
+        std::vector<std::string> materialLibraries; // mtllib file names, relative to the OBJ
+
+        // Corner components (corner * 3 + 0/1/2 for v/vt/vn) that were written as
+        // relative indices. Those are resolved against the element counts of this
+        // ObjData only, so when a file is parsed in chunks the counts of all
+        // preceding chunks still have to be added. Unsigned wrap-around makes that
+        // addition correct even if the partial result was "negative".
+        std::vector<size_t> relativeRefs;
+    };
+
+    namespace detail
+    {
+        inline bool isBlank(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\r';
+        }
+
+        inline bool isDigit(char c)
+        {
+            return c >= '0' && c <= '9';
+        }
+
+        inline const char *skipBlanks(const char *p, const char *end)
+        {
+            while (p < end && isBlank(*p))
+                ++p;
+            return p;
+        }
+
+        [[noreturn]] inline void throwObjError(const char *what, const char *lineBegin, const char *lineEnd)
+        {
+            std::string line(lineBegin, std::min<size_t>(lineEnd - lineBegin, 80));
+            throw std::runtime_error(std::string("OBJ parse error: ") + what + " in line '" + line + "'");
+        }
+
+        // Parses a decimal float in place. Mantissas of up to 19 significant digits
+        // combined with exponents within +-22 are exact (Clinger's fast path), which
+        // covers everything exporters write; longer inputs fall back to std::pow.
+        // Returns nullptr if no number starts at p.
+        inline const char *parseFloat(const char *p, const char *end, float &out)
+        {
+            static constexpr double powersOf10[] = {
+                1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+            bool negative = false;
+            if (p < end && (*p == '-' || *p == '+'))
+            {
+                negative = *p == '-';
+                ++p;
+            }
+
+            uint64_t mantissa = 0;
+            int digits = 0;
+            int exponent = 0;
+            bool anyDigit = false;
+
+            for (; p < end && isDigit(*p); ++p)
+            {
+                anyDigit = true;
+                if (digits < 19)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    digits += mantissa != 0;
+                }
+                else
+                {
+                    ++exponent;
+                }
+            }
+
+            if (p < end && *p == '.')
+            {
+                for (++p; p < end && isDigit(*p); ++p)
+                {
+                    anyDigit = true;
+                    if (digits < 19)
+                    {
+                        mantissa = mantissa * 10 + (*p - '0');
+                        digits += mantissa != 0;
+                        --exponent;
+                    }
+                }
+            }
+
+            if (!anyDigit)
+                return nullptr;
+
+            if (p < end && (*p == 'e' || *p == 'E'))
+            {
+                const char *q = p + 1;
+                bool negativeExponent = false;
+                if (q < end && (*q == '-' || *q == '+'))
+                {
+                    negativeExponent = *q == '-';
+                    ++q;
+                }
+                if (q < end && isDigit(*q))
+                {
+                    int value = 0;
+                    for (; q < end && isDigit(*q); ++q)
+                    {
+                        if (value < 10000)
+                            value = value * 10 + (*q - '0');
+                    }
+                    exponent += negativeExponent ? -value : value;
+                    p = q;
+                }
+            }
+
+            double value = static_cast<double>(mantissa);
+            if (exponent != 0)
+            {
+                if (mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22)
+                    value = exponent < 0 ? value / powersOf10[-exponent] : value * powersOf10[exponent];
+                else
+                    value *= std::pow(10.0, exponent);
+            }
+
+            out = static_cast<float>(negative ? -value : value);
+            return p;
+        }
+
+        inline unsigned int &component(ObjIndex &index, int which)
+        {
+            return which == 0 ? index.v : (which == 1 ? index.vt : index.vn);
+        }
+
+        // Parses one 1-based index. Relative (negative) indices are resolved
+        // against `count`, the number of elements parsed so far; see
+        // ObjData::relativeRefs for why the result may wrap around.
+        inline const char *parseIndex(const char *p, const char *end, size_t count, unsigned int &index, bool &relative)
+        {
+            relative = p < end && *p == '-';
+            if (relative)
+                ++p;
+
+            auto result = std::from_chars(p, end, index);
+            if (result.ec != std::errc())
+                return nullptr;
+
+            if (relative)
+                index = static_cast<unsigned int>(count) + 1u - index;
+            return result.ptr;
+        }
+
+        inline bool startsIndex(const char *p, const char *end)
+        {
+            return p < end && (isDigit(*p) || *p == '-');
+        }
+
+        struct PolygonCorner
+        {
+            ObjIndex index;
+            unsigned char relative; // bit n set = component n was a relative index
+        };
+
+        // Parses "v", "v/vt", "v//vn" or "v/vt/vn". Returns nullptr on malformed input.
+        inline const char *parseCorner(const char *p, const char *end, const ObjData &data, PolygonCorner &corner)
+        {
+            corner = {{0, 0, 0}, 0};
+            bool relative;
+
+            p = parseIndex(p, end, data.positions.size() / 3, corner.index.v, relative);
+            if (!p)
+                return nullptr;
+            corner.relative |= relative ? 1 : 0;
+
+            if (p < end && *p == '/')
+            {
+                ++p;
+                if (startsIndex(p, end))
+                {
+                    p = parseIndex(p, end, data.texCoords.size() / 2, corner.index.vt, relative);
+                    if (!p)
+                        return nullptr;
+                    corner.relative |= relative ? 2 : 0;
+                }
+                if (p < end && *p == '/')
+                {
+                    ++p;
+                    if (startsIndex(p, end))
+                    {
+                        p = parseIndex(p, end, data.normals.size() / 3, corner.index.vn, relative);
+                        if (!p)
+                            return nullptr;
+                        corner.relative |= relative ? 4 : 0;
+                    }
+                }
+            }
+
+            if (p < end && !isBlank(*p))
+                return nullptr;
+            return p;
+        }
+
+        inline void pushCorner(ObjData &data, const PolygonCorner &corner)
+        {
+            if (corner.relative)
+            {
+                for (int which = 0; which < 3; ++which)
+                {
+                    if (corner.relative & (1 << which))
+                        data.relativeRefs.push_back(data.corners.size() * 3 + which);
+                }
+            }
+            data.corners.push_back(corner.index);
+        }
+
+        // Rest of the line after a keyword, without surrounding blanks
+        inline std::string parseName(const char *p, const char *lineEnd)
+        {
+            p = skipBlanks(p, lineEnd);
+            while (lineEnd > p && isBlank(lineEnd[-1]))
+                --lineEnd;
+            return std::string(p, lineEnd);
+        }
+
+        // True if the line at p starts with `keyword` followed by a blank
+        inline bool startsKeyword(const char *p, const char *lineEnd, const char *keyword, size_t length)
+        {
+            return size_t(lineEnd - p) > length && std::memcmp(p, keyword, length) == 0 && isBlank(p[length]);
+        }
+
+        inline const char *parseFloats(const char *p, const char *end, float *out, int required, int count)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                p = skipBlanks(p, end);
+                const char *next = parseFloat(p, end, out[i]);
+                if (!next)
+                {
+                    if (i < required)
+                        return nullptr;
+                    out[i] = 0.0f;
+                    continue;
+                }
+                p = next;
+            }
+            return p;
+        }
+    }
+
+    // Tokenizes OBJ text in [begin, end) in place and appends its attributes and
+    // triangulated face corners to `out`. Besides v, vt, vn and f records, o, g
+    // and usemtl are kept as markers and mtllib file names are collected;
+    // everything else is skipped. Nothing is allocated per line; the vectors in
+    // `out` grow amortized. Throws std::runtime_error on malformed records.
+    inline void parseOBJ(const char *begin, const char *end, ObjData &out)
+    {
+        std::vector<detail::PolygonCorner> polygon;
+
+        const char *p = begin;
+        while (p < end)
+        {
+            const char *lineEnd = static_cast<const char *>(std::memchr(p, '\n', end - p));
+            if (!lineEnd)
+                lineEnd = end;
+
+            const char *lineBegin = p;
+            p = detail::skipBlanks(p, lineEnd);
+
+            if (lineEnd - p >= 2 && p[0] == 'v')
+            {
+                float values[3];
+                if (detail::isBlank(p[1]))
+                {
+                    if (!detail::parseFloats(p + 1, lineEnd, values, 3, 3))
+                        detail::throwObjError("malformed vertex position", lineBegin, lineEnd);
+                    out.positions.insert(out.positions.end(), values, values + 3);
+                }
+                else if (p[1] == 'n' && lineEnd - p >= 3 && detail::isBlank(p[2]))
+                {
+                    if (!detail::parseFloats(p + 2, lineEnd, values, 3, 3))
+                        detail::throwObjError("malformed vertex normal", lineBegin, lineEnd);
+                    out.normals.insert(out.normals.end(), values, values + 3);
+                }
+                else if (p[1] == 't' && lineEnd - p >= 3 && detail::isBlank(p[2]))
+                {
+                    if (!detail::parseFloats(p + 2, lineEnd, values, 1, 2))
+                        detail::throwObjError("malformed texture coordinate", lineBegin, lineEnd);
+                    out.texCoords.insert(out.texCoords.end(), values, values + 2);
+                }
+            }
+            else if (lineEnd - p >= 2 && p[0] == 'f' && detail::isBlank(p[1]))
+            {
+                polygon.clear();
+                const char *q = detail::skipBlanks(p + 1, lineEnd);
+                while (q < lineEnd)
+                {
+                    detail::PolygonCorner corner;
+                    q = detail::parseCorner(q, lineEnd, out, corner);
+                    if (!q)
+                        detail::throwObjError("malformed face index", lineBegin, lineEnd);
+                    polygon.push_back(corner);
+                    q = detail::skipBlanks(q, lineEnd);
+                }
+
+                if (polygon.size() < 3)
+                {
+                    Logger::error("Face has less than 3 vertices, skipping");
+                }
+                else
+                {
+                    // Triangulate as a fan, which covers triangles and quads exactly like before
+                    for (size_t i = 1; i + 1 < polygon.size(); ++i)
+                    {
+                        detail::pushCorner(out, polygon[0]);
+                        detail::pushCorner(out, polygon[i]);
+                        detail::pushCorner(out, polygon[i + 1]);
+                    }
+                }
+            }
+            else if (detail::startsKeyword(p, lineEnd, "o", 1))
+            {
+                out.markers.push_back({ObjMarker::Object, out.corners.size(), detail::parseName(p + 1, lineEnd)});
+            }
+            else if (detail::startsKeyword(p, lineEnd, "g", 1))
+            {
+                out.markers.push_back({ObjMarker::Group, out.corners.size(), detail::parseName(p + 1, lineEnd)});
+            }
+            else if (detail::startsKeyword(p, lineEnd, "usemtl", 6))
+            {
+                out.markers.push_back({ObjMarker::Material, out.corners.size(), detail::parseName(p + 6, lineEnd)});
+            }
+            else if (detail::startsKeyword(p, lineEnd, "mtllib", 6))
+            {
+                // Several libraries may be listed on one line
+                const char *q = detail::skipBlanks(p + 6, lineEnd);
+                while (q < lineEnd)
+                {
+                    const char *nameEnd = q;
+                    while (nameEnd < lineEnd && !detail::isBlank(*nameEnd))
+                        ++nameEnd;
+                    out.materialLibraries.emplace_back(q, nameEnd);
+                    q = detail::skipBlanks(nameEnd, lineEnd);
+                }
+            }
+
+            p = lineEnd < end ? lineEnd + 1 : end;
+        }
+    }
+
+    // Parses [begin, end) like parseOBJ, but splits the text at line boundaries
+    // into chunks that are tokenized on up to threadCount threads (0 = all
+    // hardware threads). A merge pass then concatenates the chunks in file order
+    // and rebases relative indices, so the result is identical to parseOBJ.
+    inline void parseOBJParallel(const char *begin, const char *end, ObjData &out, unsigned int threadCount = 0)
+    {
+        // Below this a chunk is not worth a thread and the extra merge copy
+        constexpr size_t minChunkSize = size_t(4) << 20;
+        // More chunks than threads let fast threads pick up the slack of slow ones
+        constexpr size_t chunksPerThread = 4;
+
+        if (threadCount == 0)
+            threadCount = hardwareThreads();
+
+        const size_t size = static_cast<size_t>(end - begin);
+        const size_t chunkCount = std::min<size_t>(threadCount * chunksPerThread, size / minChunkSize);
+        if (threadCount == 1 || chunkCount <= 1)
+        {
+            parseOBJ(begin, end, out);
+            return;
+        }
+
+        std::vector<const char *> bounds(chunkCount + 1);
+        bounds[0] = begin;
+        bounds[chunkCount] = end;
+        for (size_t i = 1; i < chunkCount; ++i)
+        {
+            const char *split = std::max(begin + size / chunkCount * i, bounds[i - 1]);
+            const char *newline = static_cast<const char *>(std::memchr(split, '\n', end - split));
+            bounds[i] = newline ? newline + 1 : end;
+        }
+
+        std::vector<ObjData> chunks(chunkCount);
+        parallelFor(chunkCount, threadCount, [&](size_t i)
+                    { parseOBJ(bounds[i], bounds[i + 1], chunks[i]); });
+
+        // Offsets of every chunk in the merged streams, starting after whatever `out` already holds
+        struct ChunkOffsets
+        {
+            size_t positions, normals, texCoords, corners, relativeRefs;
+        };
+        std::vector<ChunkOffsets> offsets(chunkCount + 1);
+        offsets[0] = {out.positions.size(), out.normals.size(), out.texCoords.size(), out.corners.size(), out.relativeRefs.size()};
+        for (size_t i = 0; i < chunkCount; ++i)
+        {
+            offsets[i + 1].positions = offsets[i].positions + chunks[i].positions.size();
+            offsets[i + 1].normals = offsets[i].normals + chunks[i].normals.size();
+            offsets[i + 1].texCoords = offsets[i].texCoords + chunks[i].texCoords.size();
+            offsets[i + 1].corners = offsets[i].corners + chunks[i].corners.size();
+            offsets[i + 1].relativeRefs = offsets[i].relativeRefs + chunks[i].relativeRefs.size();
+        }
+
+        out.positions.resize(offsets[chunkCount].positions);
+        out.normals.resize(offsets[chunkCount].normals);
+        out.texCoords.resize(offsets[chunkCount].texCoords);
+        out.corners.resize(offsets[chunkCount].corners);
+        out.relativeRefs.resize(offsets[chunkCount].relativeRefs);
+
+        // Markers are few; their corners only need the chunk's corner offset
+        for (size_t i = 0; i < chunkCount; ++i)
+        {
+            for (ObjMarker &marker : chunks[i].markers)
+            {
+                marker.corner += offsets[i].corners;
+                out.markers.push_back(std::move(marker));
+            }
+            for (std::string &library : chunks[i].materialLibraries)
+                out.materialLibraries.push_back(std::move(library));
+        }
+
+        parallelFor(chunkCount, threadCount, [&](size_t i)
+                    {
+            ObjData &chunk = chunks[i];
+            const ChunkOffsets &offset = offsets[i];
+
+            std::copy(chunk.positions.begin(), chunk.positions.end(), out.positions.begin() + offset.positions);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), out.normals.begin() + offset.normals);
+            std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), out.texCoords.begin() + offset.texCoords);
+            std::copy(chunk.corners.begin(), chunk.corners.end(), out.corners.begin() + offset.corners);
+
+            const unsigned int bases[3] = {
+                static_cast<unsigned int>(offset.positions / 3),
+                static_cast<unsigned int>(offset.texCoords / 2),
+                static_cast<unsigned int>(offset.normals / 3)};
+            for (size_t j = 0; j < chunk.relativeRefs.size(); ++j)
+            {
+                size_t ref = chunk.relativeRefs[j] + offset.corners * 3;
+                detail::component(out.corners[ref / 3], static_cast<int>(ref % 3)) += bases[ref % 3];
+                out.relativeRefs[offset.relativeRefs + j] = ref;
+            }
+
+            chunk = ObjData(); });
+    }
+}
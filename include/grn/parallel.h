@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace grn
+{
+    // Number of threads used when a caller asks for 0 (= "all of them")
+    inline unsigned int hardwareThreads()
+    {
+        unsigned int count = std::thread::hardware_concurrency();
+        return count == 0 ? 1 : count;
+    }
+
+    // Calls fn(task) for every task in [0, taskCount) on up to threadCount threads,
+    // including the calling one. Tasks are handed out dynamically, so uneven tasks
+    // balance themselves. Blocks until every task has finished and rethrows the
+    // first exception a task threw.
+    template <typename Fn>
+    void parallelFor(size_t taskCount, unsigned int threadCount, Fn &&fn)
+    {
+        if (threadCount == 0)
+            threadCount = hardwareThreads();
+        if (threadCount > taskCount)
+            threadCount = static_cast<unsigned int>(taskCount);
+
+        if (threadCount <= 1)
+        {
+            for (size_t task = 0; task < taskCount; ++task)
+                fn(task);
+            return;
+        }
+
+        std::atomic<size_t> next{0};
+        std::exception_ptr error;
+        std::mutex errorMutex;
+
+        auto worker = [&]()
+        {
+            for (size_t task = next++; task < taskCount; task = next++)
+            {
+                try
+                {
+                    fn(task);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if (!error)
+                        error = std::current_exception();
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount - 1);
+        for (unsigned int i = 1; i < threadCount; ++i)
+            threads.emplace_back(worker);
+        worker();
+        for (std::thread &thread : threads)
+            thread.join();
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
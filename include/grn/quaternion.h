@@ -0,0 +1,232 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+#include <grn/matrix.h>
+#include <grn/simd.h>
+#include <grn/vector.h>
+
+namespace grn
+{
+
+    // Rotation quaternion (x, y, z, w) with w the real part, aligned so a
+    // Quat<float> loads as one float4. Rotations compose like matrices:
+    // (a * b) applies b first, then a. Euler angles follow
+    // Matrix::getModelMatrix(): rotate about x, then y, then z.
+    template <typename T>
+    struct alignas(4 * sizeof(T)) Quat
+    {
+        T x, y, z, w;
+
+        // Identity
+        constexpr Quat() : x(T(0)), y(T(0)), z(T(0)), w(T(1)) {}
+        constexpr Quat(T x, T y, T z, T w) : x(x), y(y), z(z), w(w) {}
+        constexpr explicit Quat(const T *xyzw) : x(xyzw[0]), y(xyzw[1]), z(xyzw[2]), w(xyzw[3]) {}
+
+        // `angle` radians about the unit vector `axis`
+        template <typename Math = StdMath>
+        static Quat fromAxisAngle(const Vec3<T> &axis, T angle)
+        {
+            T s, c;
+            Math::sincos(angle / T(2), s, c);
+            return Quat(axis.x * s, axis.y * s, axis.z * s, c);
+        }
+
+        template <typename Math = StdMath>
+        static Quat fromEuler(const Vec3<T> &angles)
+        {
+            Vec3<T> sines, cosines;
+            Math::sincos(angles / T(2), sines, cosines);
+            const T cx = cosines.x, sx = sines.x, cy = cosines.y, sy = sines.y, cz = cosines.z, sz = sines.z;
+            return Quat(cz * cy * sx - sz * cx * sy,
+                        cz * cx * sy + sz * cy * sx,
+                        cx * cy * sz - cz * sx * sy,
+                        cz * cy * cx + sz * sx * sy);
+        }
+
+        // Angles for fromEuler(), y in [-pi/2, pi/2]. At y = +-pi/2, where x and
+        // z rotate about the same axis, x is reported as zero.
+        Vec3<T> toEuler() const
+        {
+            const T sinY = std::clamp(T(2) * (w * y - x * z), T(-1), T(1));
+            if (std::abs(sinY) > T(0.9999995))
+                return Vec3<T>(T(0), std::asin(sinY), std::atan2(T(2) * (z * w - x * y), T(1) - T(2) * (x * x + z * z)));
+            return Vec3<T>(std::atan2(T(2) * (y * z + x * w), T(1) - T(2) * (x * x + y * y)),
+                           std::asin(sinY),
+                           std::atan2(T(2) * (x * y + z * w), T(1) - T(2) * (y * y + z * z)));
+        }
+
+        constexpr Quat operator*(const Quat &other) const
+        {
+            return Quat(w * other.x + x * other.w + y * other.z - z * other.y,
+                        w * other.y + y * other.w + z * other.x - x * other.z,
+                        w * other.z + z * other.w + x * other.y - y * other.x,
+                        w * other.w - x * other.x - y * other.y - z * other.z);
+        }
+
+        constexpr Quat operator+(const Quat &other) const { return Quat(x + other.x, y + other.y, z + other.z, w + other.w); }
+        constexpr Quat operator-() const { return Quat(-x, -y, -z, -w); }
+        constexpr Quat operator*(T scalar) const { return Quat(x * scalar, y * scalar, z * scalar, w * scalar); }
+
+        const T *data() const { return &x; }
+
+        constexpr T dot(const Quat &other) const
+        {
+            return x * other.x + y * other.y + z * other.z + w * other.w;
+        }
+
+        // The inverse of a unit quaternion
+        constexpr Quat conjugate() const
+        {
+            return Quat(-x, -y, -z, w);
+        }
+
+        template <typename Math = StdMath>
+        Quat normalize() const
+        {
+            T squared = dot(*this);
+            if (squared == 0) return Quat();
+            if constexpr (std::is_same<Math, StdMath>::value)
+            {
+                T len = std::sqrt(squared);
+                return Quat(x / len, y / len, z / len, w / len);
+            }
+            return *this * Math::rsqrt(squared);
+        }
+
+        // The vector rotated by this unit quaternion
+        constexpr Vec3<T> rotate(const Vec3<T> &vector) const
+        {
+            const Vec3<T> axis(x, y, z);
+            const Vec3<T> t = axis.cross(vector) * T(2);
+            return vector + t * w + axis.cross(t);
+        }
+
+        // Rotation matrix of this unit quaternion
+        constexpr Mat4<T> toMatrix() const
+        {
+            return getModelMatrix(Vec3<T>(), *this, Vec3<T>(T(1), T(1), T(1)));
+        }
+
+        // Normalized linear interpolation along the shorter arc. Cheaper than
+        // slerp(), but the angular speed is not constant; fine for blending
+        // nearby key frames.
+        template <typename Math = StdMath>
+        static Quat nlerp(const Quat &from, const Quat &to, T t)
+        {
+            const T weight = from.dot(to) < T(0) ? -t : t;
+            return (from * (T(1) - t) + to * weight).template normalize<Math>();
+        }
+
+        // Spherical linear interpolation along the shorter arc
+        template <typename Math = StdMath>
+        static Quat slerp(const Quat &from, const Quat &to, T t)
+        {
+            T cosAngle = from.dot(to);
+            const T sign = cosAngle < T(0) ? T(-1) : T(1);
+            cosAngle *= sign;
+            if (cosAngle > T(0.9995)) // sin(angle) is too small to divide by
+                return nlerp<Math>(from, to, t);
+
+            const T angle = Math::acos(cosAngle);
+            T sinAngle, sinFrom, sinTo, unused;
+            Math::sincos(angle, sinAngle, unused);
+            Math::sincos((T(1) - t) * angle, sinFrom, unused);
+            Math::sincos(t * angle, sinTo, unused);
+            return from * (sinFrom / sinAngle) + to * (sign * sinTo / sinAngle);
+        }
+
+        // Translation * rotation * scale without any trigonometry. The matrix
+        // matches what buildModelMatrices() computes for quaternion transforms.
+        static constexpr Mat4<T> getModelMatrix(const Vec3<T> &position, const Quat &rotation, const Vec3<T> &scale)
+        {
+            const T x = rotation.x, y = rotation.y, z = rotation.z, w = rotation.w;
+            const T two = T(2), one = T(1);
+            const T r[9] = {
+                one - two * (y * y + z * z), two * (x * y + z * w), two * (x * z - y * w),
+                two * (x * y - z * w), one - two * (x * x + z * z), two * (y * z + x * w),
+                two * (x * z + y * w), two * (y * z - x * w), one - two * (x * x + y * y)};
+            const T s[3] = {scale.x, scale.y, scale.z};
+
+            Mat4<T> model;
+            for (int column = 0; column < 3; ++column)
+            {
+                for (int row = 0; row < 3; ++row)
+                {
+                    model[column * 4 + row] = r[column * 3 + row] * s[column];
+                }
+            }
+            model[12] = position.x;
+            model[13] = position.y;
+            model[14] = position.z;
+            return model;
+        }
+    };
+
+    using Quaternion = Quat<float>;
+
+    static_assert(std::is_trivially_copyable<Quaternion>::value && sizeof(Quaternion) == 16 && alignof(Quaternion) == 16,
+                  "Quaternion must load as one float4");
+
+    namespace detail
+    {
+        // Four quaternions at a time: loaded as float4s, transposed to x, y, z
+        // and w lanes, blended and normalized, and transposed back. Each lane
+        // runs Quaternion::nlerp()'s operations in its order, so results don't
+        // depend on a quaternion's position in the batch.
+        template <typename Weight>
+        inline void nlerpQuaternions(const Quaternion *from, const Quaternion *to, Quaternion *out, size_t count, Weight weight)
+        {
+            using namespace simd;
+            const float4 zero = splat(0.0f), one = splat(1.0f);
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4)
+            {
+                float4 ax = load(from[i].data()), ay = load(from[i + 1].data()), az = load(from[i + 2].data()), aw = load(from[i + 3].data());
+                float4 bx = load(to[i].data()), by = load(to[i + 1].data()), bz = load(to[i + 2].data()), bw = load(to[i + 3].data());
+                transpose(ax, ay, az, aw);
+                transpose(bx, by, bz, bw);
+
+                const float4 t = weight(i);
+                const float4 cosAngle = ax * bx + ay * by + az * bz + aw * bw;
+                const float4 toWeight = select(cosAngle < zero, -t, t), fromWeight = one - t;
+                float4 x = ax * fromWeight + bx * toWeight, y = ay * fromWeight + by * toWeight;
+                float4 z = az * fromWeight + bz * toWeight, w = aw * fromWeight + bw * toWeight;
+
+                const float4 len = sqrt(x * x + y * y + z * z + w * w);
+                x = x / len, y = y / len, z = z / len, w = w / len;
+                transpose(x, y, z, w);
+                store(&out[i].x, x);
+                store(&out[i + 1].x, y);
+                store(&out[i + 2].x, z);
+                store(&out[i + 3].x, w);
+            }
+            for (; i < count; ++i)
+            {
+                float t[4];
+                store(t, weight(i));
+                out[i] = Quaternion::nlerp(from[i], to[i], t[0]);
+            }
+        }
+    }
+
+    // out[i] = Quaternion::nlerp(from[i], to[i], t) for `count` quaternions;
+    // `out` may alias either input. The inputs must not be zero-length after
+    // blending (opposite quaternions at t = 0.5), as for nlerp().
+    inline void nlerp(const Quaternion *from, const Quaternion *to, float t, Quaternion *out, size_t count)
+    {
+        const simd::float4 weight = simd::splat(t);
+        detail::nlerpQuaternions(from, to, out, count, [&](size_t)
+                                 { return weight; });
+    }
+
+    // As above with a blend weight per quaternion
+    inline void nlerp(const Quaternion *from, const Quaternion *to, const float *t, Quaternion *out, size_t count)
+    {
+        detail::nlerpQuaternions(from, to, out, count, [&](size_t i)
+                                 { return i + 4 <= count ? simd::load(t + i) : simd::splat(t[i]); });
+    }
+
+} // namespace grn
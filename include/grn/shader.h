@@ -5,20 +5,26 @@
 #include <fstream>
 #include <stdexcept>
 #include <iterator>
+#include <vector>
 
 namespace grn
 {
     class Shader
     {
     public:
-        Shader(const char *vertexShaderSource, const char *fragmentShaderSource);
+        // With a `cacheDirectory` the linked program is stored there as a driver
+        // binary (see shader_cache.h), and later runs with the same sources and
+        // driver load it without compiling any GLSL
+        Shader(const char *vertexShaderSource, const char *fragmentShaderSource, const std::string &cacheDirectory = "");
 
         ~Shader();
 
         GLuint getProgram() const { return m_program; }
 
-        // Static function to load from file
-        static Shader loadFromFile(const std::string &vertexPath, const std::string &fragmentPath)
+        // Static function to load from file. Every entry of `defines` is inserted as
+        // "#define <entry>" right after the #version line of both stages.
+        static Shader loadFromFile(const std::string &vertexPath, const std::string &fragmentPath, const std::vector<std::string> &defines = {},
+                                   const std::string &cacheDirectory = "")
         {
             std::ifstream vertexFile(vertexPath);
             std::ifstream fragmentFile(fragmentPath);
@@ -29,7 +35,31 @@ namespace grn
 
             std::string vertexShaderSource((std::istreambuf_iterator<char>(vertexFile)), std::istreambuf_iterator<char>());
             std::string fragmentShaderSource((std::istreambuf_iterator<char>(fragmentFile)), std::istreambuf_iterator<char>());
-            return Shader(vertexShaderSource.c_str(), fragmentShaderSource.c_str());
+            vertexShaderSource = addDefines(vertexShaderSource, defines);
+            fragmentShaderSource = addDefines(fragmentShaderSource, defines);
+            return Shader(vertexShaderSource.c_str(), fragmentShaderSource.c_str(), cacheDirectory);
+        }
+
+        static std::string addDefines(const std::string &source, const std::vector<std::string> &defines)
+        {
+            if (defines.empty())
+                return source;
+
+            std::string block;
+            for (const std::string &define : defines)
+                block += "#define " + define + "\n";
+
+            // #version has to stay the first statement
+            size_t insertAt = 0;
+            size_t version = source.find("#version");
+            if (version != std::string::npos)
+            {
+                size_t lineEnd = source.find('\n', version);
+                insertAt = lineEnd == std::string::npos ? source.size() : lineEnd + 1;
+                if (lineEnd == std::string::npos)
+                    block = "\n" + block;
+            }
+            return source.substr(0, insertAt) + block + source.substr(insertAt);
         }
 
     private:
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+#include "logger.h"
+#include "mapped_file.h"
+
+namespace grn
+{
+    // Linked program binaries on disk, one file per program named after its
+    // key. The key hashes everything that decides what the driver produces:
+    // both stage sources (with their defines inserted) and the GL vendor,
+    // renderer and version strings, so a driver update or another GPU misses
+    // instead of loading a foreign binary. Drivers may still reject a binary
+    // they wrote themselves; callers then compile from source and store anew.
+    struct ProgramBinaryHeader
+    {
+        static constexpr uint32_t Magic = 0x504E5247; // "GRNP"
+        static constexpr uint32_t Version = 1;
+
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint32_t format; // GLenum from glGetProgramBinary
+        uint32_t size;   // bytes of binary following the header
+    };
+
+    namespace detail
+    {
+        // 64-bit FNV-1a, with a zero byte after each string so that moving text
+        // from one string to the next changes the hash
+        inline uint64_t hashString(uint64_t hash, const char *text)
+        {
+            if (text)
+            {
+                for (; *text; ++text)
+                    hash = (hash ^ static_cast<unsigned char>(*text)) * 0x100000001b3ull;
+            }
+            return hash * 0x100000001b3ull;
+        }
+    }
+
+    // GL 4.1 or ARB_get_program_binary, and at least one binary format
+    static bool programBinariesSupported()
+    {
+        if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+            return false;
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        return formatCount > 0;
+    }
+
+    static uint64_t programCacheKey(const char *vertexSource, const char *fragmentSource)
+    {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        hash = detail::hashString(hash, std::to_string(ProgramBinaryHeader::Version).c_str());
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION})
+            hash = detail::hashString(hash, reinterpret_cast<const char *>(glGetString(name)));
+        hash = detail::hashString(hash, vertexSource);
+        return detail::hashString(hash, fragmentSource);
+    }
+
+    static std::string programCachePath(const std::string &directory, uint64_t key)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.glprogram", static_cast<unsigned long long>(key));
+        return (std::filesystem::path(directory) / name).string();
+    }
+
+    // Creates a program from the cached binary for `key`. Returns 0 if there
+    // is none, it is corrupt or the driver rejects it; rejected files are deleted.
+    static GLuint loadCachedProgram(const std::string &directory, uint64_t key)
+    {
+        const std::string path = programCachePath(directory, key);
+        std::error_code error;
+        const auto fileSize = std::filesystem::file_size(path, error);
+        std::ifstream file(path, std::ios::binary);
+        if (error || !file.is_open())
+            return 0;
+
+        ProgramBinaryHeader header = {};
+        file.read(reinterpret_cast<char *>(&header), sizeof(header));
+        std::vector<char> binary;
+        if (file && header.magic == ProgramBinaryHeader::Magic && header.version == ProgramBinaryHeader::Version && header.key == key &&
+            header.size == fileSize - sizeof(header))
+        {
+            binary.resize(header.size);
+            if (!file.read(binary.data(), binary.size()))
+                binary.clear();
+        }
+        file.close();
+
+        // Formats the driver doesn't list would only raise GL_INVALID_ENUM
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        std::vector<GLint> formats(formatCount);
+        glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+        const bool knownFormat = std::find(formats.begin(), formats.end(), static_cast<GLint>(header.format)) != formats.end();
+
+        GLuint program = 0;
+        GLint success = GL_FALSE;
+        if (!binary.empty() && knownFormat)
+        {
+            program = glCreateProgram();
+            glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+            glGetProgramiv(program, GL_LINK_STATUS, &success);
+        }
+        if (success == GL_TRUE)
+        {
+            grn::Logger::debug("Loaded cached shader program: " + path);
+            return program;
+        }
+
+        grn::Logger::warning("Discarding cached shader program: " + path);
+        if (program)
+            glDeleteProgram(program);
+        std::filesystem::remove(path, error);
+        return 0;
+    }
+
+    // Writes the binary of a linked `program` under `key`. The program must
+    // have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set. Failures
+    // only cost the next launch a compile, so they are logged and ignored.
+    static void storeCachedProgram(const std::string &directory, uint64_t key, GLuint program)
+    {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+        if (length <= 0)
+            return;
+
+        ProgramBinaryHeader header = {ProgramBinaryHeader::Magic, ProgramBinaryHeader::Version, key, format, static_cast<uint32_t>(length)};
+        const std::string path = programCachePath(directory, key);
+        // Written aside and renamed, so readers never see half a file
+        const std::string tempPath = temporaryPathFor(path);
+
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        {
+            std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            file.write(binary.data(), length);
+            if (!file)
+            {
+                file.close();
+                std::filesystem::remove(tempPath, error);
+                grn::Logger::warning("Could not write shader cache: " + path);
+                return;
+            }
+        }
+        std::filesystem::rename(tempPath, path, error);
+        if (error)
+        {
+            std::filesystem::remove(tempPath, error);
+            grn::Logger::warning("Could not write shader cache: " + path);
+        }
+    }
+}
@@ -0,0 +1,301 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// Four-wide float vectors on SSE2 (every x86-64 target) and AArch64 NEON, with
+// a plain array fallback elsewhere. Only operations that round exactly like
+// their scalar counterparts are provided, so SIMD and scalar code paths give
+// the same results. Define GRN_SIMD_SCALAR to force the fallback, e.g. to
+// compare it against the vector paths.
+#if defined(GRN_SIMD_SCALAR)
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GRN_SIMD_SSE 1
+#include <emmintrin.h>
+#elif (defined(__ARM_NEON) || defined(_M_ARM64)) && (defined(__aarch64__) || defined(_M_ARM64))
+#define GRN_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+// AVX builds also get the eight-wide float8
+#if defined(GRN_SIMD_SSE) && defined(__AVX__)
+#define GRN_SIMD_AVX 1
+#include <immintrin.h>
+#endif
+
+namespace grn
+{
+    namespace simd
+    {
+        struct float4
+        {
+#if defined(GRN_SIMD_SSE)
+            __m128 v;
+#elif defined(GRN_SIMD_NEON)
+            float32x4_t v;
+#else
+            float v[4];
+#endif
+        };
+
+        // Per-lane comparison result
+        struct mask4
+        {
+#if defined(GRN_SIMD_SSE)
+            __m128 v;
+#elif defined(GRN_SIMD_NEON)
+            uint32x4_t v;
+#else
+            bool v[4];
+#endif
+        };
+
+#if defined(GRN_SIMD_SSE)
+        inline float4 load(const float *p) { return {_mm_loadu_ps(p)}; }
+        inline void store(float *p, float4 a) { _mm_storeu_ps(p, a.v); }
+        inline float4 splat(float x) { return {_mm_set1_ps(x)}; }
+        // {a, b, c, d} from registers; cheaper than a store and load() of scalars
+        inline float4 set(float a, float b, float c, float d) { return {_mm_setr_ps(a, b, c, d)}; }
+        template <int I>
+        inline float lane(float4 a) { return _mm_cvtss_f32(_mm_shuffle_ps(a.v, a.v, I)); }
+        inline float4 operator+(float4 a, float4 b) { return {_mm_add_ps(a.v, b.v)}; }
+        inline float4 operator-(float4 a, float4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+        inline float4 operator*(float4 a, float4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+        inline float4 operator/(float4 a, float4 b) { return {_mm_div_ps(a.v, b.v)}; }
+        inline float4 operator-(float4 a) { return {_mm_xor_ps(a.v, _mm_set1_ps(-0.0f))}; }
+        inline float4 sqrt(float4 a) { return {_mm_sqrt_ps(a.v)}; }
+        // 1 / sqrt(a) to within 1.5 * 2^-12 relative error
+        inline float4 rsqrtEstimate(float4 a) { return {_mm_rsqrt_ps(a.v)}; }
+        inline float4 abs(float4 a) { return {_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)}; }
+        inline float4 min(float4 a, float4 b) { return {_mm_min_ps(a.v, b.v)}; }
+        inline float4 max(float4 a, float4 b) { return {_mm_max_ps(a.v, b.v)}; }
+        inline mask4 operator<(float4 a, float4 b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+        inline mask4 operator>=(float4 a, float4 b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+        inline mask4 operator&(mask4 a, mask4 b) { return {_mm_and_ps(a.v, b.v)}; }
+        inline float4 select(mask4 m, float4 a, float4 b) { return {_mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v))}; }
+        // Bit i set if lane i is true
+        inline int bits(mask4 m) { return _mm_movemask_ps(m.v); }
+        // {a[A], a[B], b[C], b[D]}
+        template <int A, int B, int C, int D>
+        inline float4 shuffle(float4 a, float4 b) { return {_mm_shuffle_ps(a.v, b.v, _MM_SHUFFLE(D, C, B, A))}; }
+        // Nearest integer, ties to even; |a| < 2^31
+        inline float4 roundNearest(float4 a) { return {_mm_cvtepi32_ps(_mm_cvtps_epi32(a.v))}; }
+#elif defined(GRN_SIMD_NEON)
+        inline float4 load(const float *p) { return {vld1q_f32(p)}; }
+        inline void store(float *p, float4 a) { vst1q_f32(p, a.v); }
+        inline float4 splat(float x) { return {vdupq_n_f32(x)}; }
+        inline float4 set(float a, float b, float c, float d)
+        {
+            const float32x2_t low = vset_lane_f32(b, vdup_n_f32(a), 1), high = vset_lane_f32(d, vdup_n_f32(c), 1);
+            return {vcombine_f32(low, high)};
+        }
+        template <int I>
+        inline float lane(float4 a) { return vgetq_lane_f32(a.v, I); }
+        inline float4 operator+(float4 a, float4 b) { return {vaddq_f32(a.v, b.v)}; }
+        inline float4 operator-(float4 a, float4 b) { return {vsubq_f32(a.v, b.v)}; }
+        inline float4 operator*(float4 a, float4 b) { return {vmulq_f32(a.v, b.v)}; }
+        inline float4 operator/(float4 a, float4 b) { return {vdivq_f32(a.v, b.v)}; }
+        inline float4 operator-(float4 a) { return {vnegq_f32(a.v)}; }
+        inline float4 sqrt(float4 a) { return {vsqrtq_f32(a.v)}; }
+        // vrsqrte alone gives 8 bits; one step brings it to the SSE estimate's accuracy
+        inline float4 rsqrtEstimate(float4 a)
+        {
+            const float32x4_t e = vrsqrteq_f32(a.v);
+            return {vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(a.v, e), e))};
+        }
+        inline float4 abs(float4 a) { return {vabsq_f32(a.v)}; }
+        inline float4 min(float4 a, float4 b) { return {vminq_f32(a.v, b.v)}; }
+        inline float4 max(float4 a, float4 b) { return {vmaxq_f32(a.v, b.v)}; }
+        inline mask4 operator<(float4 a, float4 b) { return {vcltq_f32(a.v, b.v)}; }
+        inline mask4 operator>=(float4 a, float4 b) { return {vcgeq_f32(a.v, b.v)}; }
+        inline mask4 operator&(mask4 a, mask4 b) { return {vandq_u32(a.v, b.v)}; }
+        inline float4 select(mask4 m, float4 a, float4 b) { return {vbslq_f32(m.v, a.v, b.v)}; }
+        inline int bits(mask4 m)
+        {
+            const int32_t shifts[4] = {0, 1, 2, 3};
+            return static_cast<int>(vaddvq_u32(vshlq_u32(vshrq_n_u32(m.v, 31), vld1q_s32(shifts))));
+        }
+        template <int A, int B, int C, int D>
+        inline float4 shuffle(float4 a, float4 b)
+        {
+            float32x4_t r = vdupq_n_f32(vgetq_lane_f32(a.v, A));
+            r = vsetq_lane_f32(vgetq_lane_f32(a.v, B), r, 1);
+            r = vsetq_lane_f32(vgetq_lane_f32(b.v, C), r, 2);
+            r = vsetq_lane_f32(vgetq_lane_f32(b.v, D), r, 3);
+            return {r};
+        }
+        inline float4 roundNearest(float4 a) { return {vrndnq_f32(a.v)}; }
+#else
+        template <typename Op>
+        inline float4 lanes(Op op)
+        {
+            float4 r;
+            for (int i = 0; i < 4; ++i)
+                r.v[i] = op(i);
+            return r;
+        }
+
+        inline float4 load(const float *p) { return lanes([&](int i) { return p[i]; }); }
+        inline void store(float *p, float4 a)
+        {
+            for (int i = 0; i < 4; ++i)
+                p[i] = a.v[i];
+        }
+        inline float4 splat(float x) { return lanes([&](int) { return x; }); }
+        inline float4 set(float a, float b, float c, float d) { return {{a, b, c, d}}; }
+        template <int I>
+        inline float lane(float4 a) { return a.v[I]; }
+        inline float4 operator+(float4 a, float4 b) { return lanes([&](int i) { return a.v[i] + b.v[i]; }); }
+        inline float4 operator-(float4 a, float4 b) { return lanes([&](int i) { return a.v[i] - b.v[i]; }); }
+        inline float4 operator*(float4 a, float4 b) { return lanes([&](int i) { return a.v[i] * b.v[i]; }); }
+        inline float4 operator/(float4 a, float4 b) { return lanes([&](int i) { return a.v[i] / b.v[i]; }); }
+        inline float4 operator-(float4 a) { return lanes([&](int i) { return -a.v[i]; }); }
+        inline float4 sqrt(float4 a) { return lanes([&](int i) { return std::sqrt(a.v[i]); }); }
+        inline float4 rsqrtEstimate(float4 a) { return lanes([&](int i) { return 1.0f / std::sqrt(a.v[i]); }); }
+        inline float4 abs(float4 a) { return lanes([&](int i) { return std::fabs(a.v[i]); }); }
+        inline float4 min(float4 a, float4 b) { return lanes([&](int i) { return b.v[i] < a.v[i] ? b.v[i] : a.v[i]; }); }
+        inline float4 max(float4 a, float4 b) { return lanes([&](int i) { return a.v[i] < b.v[i] ? b.v[i] : a.v[i]; }); }
+        inline mask4 operator<(float4 a, float4 b) { return {{a.v[0] < b.v[0], a.v[1] < b.v[1], a.v[2] < b.v[2], a.v[3] < b.v[3]}}; }
+        inline mask4 operator>=(float4 a, float4 b) { return {{a.v[0] >= b.v[0], a.v[1] >= b.v[1], a.v[2] >= b.v[2], a.v[3] >= b.v[3]}}; }
+        inline mask4 operator&(mask4 a, mask4 b) { return {{a.v[0] && b.v[0], a.v[1] && b.v[1], a.v[2] && b.v[2], a.v[3] && b.v[3]}}; }
+        inline float4 select(mask4 m, float4 a, float4 b) { return lanes([&](int i) { return m.v[i] ? a.v[i] : b.v[i]; }); }
+        inline int bits(mask4 m) { return int(m.v[0]) | int(m.v[1]) << 1 | int(m.v[2]) << 2 | int(m.v[3]) << 3; }
+        template <int A, int B, int C, int D>
+        inline float4 shuffle(float4 a, float4 b) { return {{a.v[A], a.v[B], b.v[C], b.v[D]}}; }
+        inline float4 roundNearest(float4 a) { return lanes([&](int i) { return std::nearbyint(a.v[i]); }); }
+#endif
+
+        // Lane i in all four lanes
+        template <int I>
+        inline float4 broadcast(float4 a) { return shuffle<I, I, I, I>(a, a); }
+
+        // Sum of all lanes in every lane, added as (a0 + a1) + (a2 + a3) on all paths
+        inline float4 horizontalSum(float4 a)
+        {
+            float4 pairs = a + shuffle<1, 0, 3, 2>(a, a);
+            return pairs + shuffle<2, 3, 0, 1>(pairs, pairs);
+        }
+
+        // Transposes the 4x4 matrix whose rows (or columns) are r0..r3
+        inline void transpose(float4 &r0, float4 &r1, float4 &r2, float4 &r3)
+        {
+            const float4 t0 = shuffle<0, 1, 0, 1>(r0, r1), t1 = shuffle<0, 1, 0, 1>(r2, r3);
+            const float4 t2 = shuffle<2, 3, 2, 3>(r0, r1), t3 = shuffle<2, 3, 2, 3>(r2, r3);
+            r0 = shuffle<0, 2, 0, 2>(t0, t1);
+            r1 = shuffle<1, 3, 1, 3>(t0, t1);
+            r2 = shuffle<0, 2, 0, 2>(t2, t3);
+            r3 = shuffle<1, 3, 1, 3>(t2, t3);
+        }
+
+#if defined(GRN_SIMD_AVX)
+        // Eight-wide counterpart of float4 for AVX builds, with the same rounding
+        struct float8
+        {
+            __m256 v;
+        };
+
+        struct mask8
+        {
+            __m256 v;
+        };
+
+        inline float8 load8(const float *p) { return {_mm256_loadu_ps(p)}; }
+        inline void store(float *p, float8 a) { _mm256_storeu_ps(p, a.v); }
+        inline float8 splat8(float x) { return {_mm256_set1_ps(x)}; }
+        inline float8 operator+(float8 a, float8 b) { return {_mm256_add_ps(a.v, b.v)}; }
+        inline float8 operator-(float8 a, float8 b) { return {_mm256_sub_ps(a.v, b.v)}; }
+        inline float8 operator*(float8 a, float8 b) { return {_mm256_mul_ps(a.v, b.v)}; }
+        inline float8 operator/(float8 a, float8 b) { return {_mm256_div_ps(a.v, b.v)}; }
+        inline float8 operator-(float8 a) { return {_mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f))}; }
+        inline float8 sqrt(float8 a) { return {_mm256_sqrt_ps(a.v)}; }
+        inline float8 rsqrtEstimate(float8 a) { return {_mm256_rsqrt_ps(a.v)}; }
+        inline float8 abs(float8 a) { return {_mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v)}; }
+        inline float8 min(float8 a, float8 b) { return {_mm256_min_ps(a.v, b.v)}; }
+        inline float8 max(float8 a, float8 b) { return {_mm256_max_ps(a.v, b.v)}; }
+        inline mask8 operator<(float8 a, float8 b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+        inline mask8 operator>=(float8 a, float8 b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)}; }
+        inline mask8 operator&(mask8 a, mask8 b) { return {_mm256_and_ps(a.v, b.v)}; }
+        inline float8 select(mask8 m, float8 a, float8 b) { return {_mm256_blendv_ps(b.v, a.v, m.v)}; }
+        inline float8 roundNearest(float8 a) { return {_mm256_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)}; }
+        inline float4 lower(float8 a) { return {_mm256_castps256_ps128(a.v)}; }
+        inline float4 upper(float8 a) { return {_mm256_extractf128_ps(a.v, 1)}; }
+#endif
+
+        // Single floats as one-lane vectors, so the kernels below also serve
+        // scalar code and loop tails
+        inline float sqrt(float a) { return std::sqrt(a); }
+        inline float abs(float a) { return std::fabs(a); }
+        inline float min(float a, float b) { return b < a ? b : a; }
+        inline float max(float a, float b) { return a < b ? b : a; }
+        inline float select(bool m, float a, float b) { return m ? a : b; }
+        inline void store(float *p, float a) { *p = a; }
+#if defined(GRN_SIMD_SSE)
+        inline float roundNearest(float a) { return float(_mm_cvtss_si32(_mm_set_ss(a))); }
+        inline float rsqrtEstimate(float a) { return _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(a))); }
+#else
+        inline float roundNearest(float a) { return std::nearbyint(a); }
+        inline float rsqrtEstimate(float a) { return 1.0f / std::sqrt(a); }
+#endif
+
+        // Loads and constants for kernels templated on the vector width
+        template <typename V>
+        struct vector_traits;
+
+        template <>
+        struct vector_traits<float>
+        {
+            static constexpr int width = 1;
+            static float load(const float *p) { return *p; }
+            static float splat(float x) { return x; }
+        };
+
+        template <>
+        struct vector_traits<float4>
+        {
+            static constexpr int width = 4;
+            static float4 load(const float *p) { return simd::load(p); }
+            static float4 splat(float x) { return simd::splat(x); }
+        };
+
+#if defined(GRN_SIMD_AVX)
+        template <>
+        struct vector_traits<float8>
+        {
+            static constexpr int width = 8;
+            static float8 load(const float *p) { return load8(p); }
+            static float8 splat(float x) { return splat8(x); }
+        };
+#endif
+
+        // Sine and cosine of every lane: reduction by multiples of pi/2 in three
+        // parts (Cody-Waite), then the Cephes minimax polynomials on
+        // [-pi/4, pi/4]. Within a few ulp of sinf/cosf for |x| up to about 10^4,
+        // and identical on every vector width.
+        template <typename V>
+        inline void sincos(V x, V &sine, V &cosine)
+        {
+            using T = vector_traits<V>;
+            const V q = roundNearest(x * T::splat(0.636619772f));
+            const V r = ((x - q * T::splat(1.5703125f)) - q * T::splat(4.837512969970703125e-4f)) - q * T::splat(7.54978995489188216e-8f);
+            const V r2 = r * r;
+            const V sinR = r + r * r2 * (T::splat(-1.6666654611e-1f) + r2 * (T::splat(8.3321608736e-3f) + r2 * T::splat(-1.9515295891e-4f)));
+            const V cosR = T::splat(1.0f) - T::splat(0.5f) * r2 +
+                           r2 * r2 * (T::splat(4.166664568298827e-2f) + r2 * (T::splat(-1.388731625493765e-3f) + r2 * T::splat(2.443315711809948e-5f)));
+
+            // Quadrant q mod 4 selects the polynomial and the signs
+            const V quarter = q * T::splat(0.25f);
+            V floorQuarter = roundNearest(quarter);
+            floorQuarter = select(quarter < floorQuarter, floorQuarter - T::splat(1.0f), floorQuarter);
+            const V quadrant = q - T::splat(4.0f) * floorQuarter;
+            const V fromMiddle = abs(quadrant - T::splat(2.0f)); // 2 1 0 1
+            const auto odd = (fromMiddle >= T::splat(0.5f)) & (fromMiddle < T::splat(1.5f));
+            const auto sineNegative = quadrant >= T::splat(1.5f);
+            const auto cosineNegative = (quadrant >= T::splat(0.5f)) & (quadrant < T::splat(2.5f));
+
+            sine = select(odd, cosR, sinR);
+            cosine = select(odd, sinR, cosR);
+            sine = select(sineNegative, -sine, sine);
+            cosine = select(cosineNegative, -cosine, cosine);
+        }
+    }
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "logger.h"
+
+namespace grn
+{
+    // Counters for StreamBuffer. A stall is a beginFrame() that had to wait for
+    // the GPU to finish with the region it was about to reuse.
+    struct StreamBufferStats
+    {
+        uint64_t frames = 0;
+        uint64_t stalls = 0;
+        double stallSeconds = 0.0;
+    };
+
+    // Space handed out by StreamBuffer::allocate(). `data` is write-only and
+    // valid until the next endFrame(); `offset` is where it starts in buffer().
+    struct StreamAllocation
+    {
+        void *data;
+        GLintptr offset;
+    };
+
+    // Ring buffer for data rewritten every frame (uniform blocks, dynamic
+    // vertices, draw parameters). It is split into `frameCount` regions and each
+    // frame writes one of them with plain memcpy. A fence placed by endFrame()
+    // keeps the CPU from reusing a region before the GPU has read it, so the
+    // driver never has to synchronize or copy.
+    //
+    // With GL 4.4 or ARB_buffer_storage the buffer is mapped once, persistently
+    // and coherently. Without them writes go to a CPU copy that flush() uploads
+    // with glBufferSubData, which keeps the same interface and fencing.
+    class StreamBuffer
+    {
+    public:
+        StreamBuffer(GLenum target, size_t frameSize, unsigned int frameCount = 3)
+            : m_target(target), m_frameSize(frameSize), m_regions(frameCount)
+        {
+            if (frameCount == 0 || frameSize == 0)
+                throw std::runtime_error("StreamBuffer needs a non-empty region per frame");
+
+            const GLsizeiptr size = GLsizeiptr(frameSize * frameCount);
+            glGenBuffers(1, &m_buffer);
+            glBindBuffer(m_target, m_buffer);
+            m_persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+            if (m_persistent)
+            {
+                const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+                glBufferStorage(m_target, size, nullptr, flags);
+                m_mapping = static_cast<char *>(glMapBufferRange(m_target, 0, size, flags));
+                if (!m_mapping)
+                {
+                    Logger::warning("Persistent mapping failed, streaming through glBufferSubData");
+                    glDeleteBuffers(1, &m_buffer);
+                    glGenBuffers(1, &m_buffer);
+                    glBindBuffer(m_target, m_buffer);
+                    m_persistent = false;
+                }
+            }
+            if (!m_persistent)
+            {
+                glBufferData(m_target, size, nullptr, GL_STREAM_DRAW);
+                m_staging.resize(frameSize * frameCount);
+                m_mapping = m_staging.data();
+            }
+            glBindBuffer(m_target, 0);
+        }
+
+        ~StreamBuffer()
+        {
+            for (GLsync &fence : m_regions)
+            {
+                if (fence)
+                    glDeleteSync(fence);
+            }
+            if (m_persistent)
+            {
+                glBindBuffer(m_target, m_buffer);
+                glUnmapBuffer(m_target);
+                glBindBuffer(m_target, 0);
+            }
+            glDeleteBuffers(1, &m_buffer);
+        }
+
+        // Non-copyable
+        StreamBuffer(const StreamBuffer &) = delete;
+        StreamBuffer &operator=(const StreamBuffer &) = delete;
+
+        // Moves to the next region, waiting if the GPU may still read it
+        void beginFrame()
+        {
+            m_frame = (m_frame + 1) % m_regions.size();
+            m_head = m_flushed = m_frame * m_frameSize;
+            ++m_stats.frames;
+
+            GLsync &fence = m_regions[m_frame];
+            if (!fence)
+                return;
+            GLenum status = glClientWaitSync(fence, 0, 0);
+            if (status == GL_TIMEOUT_EXPIRED)
+            {
+                ++m_stats.stalls;
+                auto start = std::chrono::steady_clock::now();
+                do
+                    status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+                while (status == GL_TIMEOUT_EXPIRED);
+                m_stats.stallSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+            if (status == GL_WAIT_FAILED)
+                Logger::error("StreamBuffer: waiting for a fence failed");
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+
+        // Reserves `size` bytes of the current region. `alignment` must be a
+        // power of two, e.g. GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT for uniform
+        // blocks. Throws if the region is full; size it for the worst frame.
+        StreamAllocation allocate(size_t size, size_t alignment = 16)
+        {
+            const size_t offset = (m_head + alignment - 1) & ~(alignment - 1);
+            if (offset + size > (m_frame + 1) * m_frameSize)
+                throw std::runtime_error("StreamBuffer region of " + std::to_string(m_frameSize) + " bytes is full");
+            m_head = offset + size;
+            return {m_mapping + offset, GLintptr(offset)};
+        }
+
+        // Makes the writes so far visible to GL. Call before the draws that read
+        // them; a no-op with a coherent mapping.
+        void flush()
+        {
+            if (m_persistent || m_head == m_flushed)
+                return;
+            glBindBuffer(m_target, m_buffer);
+            glBufferSubData(m_target, GLintptr(m_flushed), GLsizeiptr(m_head - m_flushed), m_mapping + m_flushed);
+            glBindBuffer(m_target, 0);
+            m_flushed = m_head;
+        }
+
+        // Fences the current region after the frame's last draw that uses it
+        void endFrame()
+        {
+            flush();
+            m_regions[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+
+        GLuint buffer() const { return m_buffer; }
+        bool persistent() const { return m_persistent; }
+        const StreamBufferStats &stats() const { return m_stats; }
+
+    private:
+        GLenum m_target;
+        GLuint m_buffer = 0;
+        size_t m_frameSize;
+        std::vector<GLsync> m_regions; // fence of the last frame that wrote each region
+        size_t m_frame = 0;
+        size_t m_head = 0;    // next free byte of the current region
+        size_t m_flushed = 0; // end of the bytes already uploaded (fallback only)
+        bool m_persistent = false;
+        char *m_mapping = nullptr;
+        std::vector<char> m_staging;
+        StreamBufferStats m_stats;
+    };
+}
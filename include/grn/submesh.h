@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+
+namespace grn
+{
+    // Material of submeshes that were not assigned one
+    constexpr uint32_t NoMaterial = ~0u;
+
+    // One part of a mesh (an OBJ object, group or material run), drawn with a
+    // single material. All parts share the mesh's vertex and index buffers.
+    // Level 0 is [firstIndex, firstIndex + indexCount), the part's levels of
+    // detail including level 0 are lods[firstLod, firstLod + lodCount), and its
+    // meshlets are meshlets[firstMeshlet, firstMeshlet + meshletCount).
+    struct Submesh
+    {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        uint32_t firstLod;
+        uint32_t lodCount;
+        uint32_t firstMeshlet;
+        uint32_t meshletCount;
+        uint32_t material; // index into the mesh's materials, or NoMaterial
+    };
+}
@@ -0,0 +1,336 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "parallel.h"
+#include "simd.h"
+#include "vertex.h"
+
+namespace grn
+{
+    namespace detail
+    {
+        // Turns a vertex's accumulated tangent and bitangent into an orthonormal
+        // frame around its normal
+        inline void finishTangentFrame(Vertex &v, const float *tangent, const float *bitangent)
+        {
+            // Gram-Schmidt orthogonalize
+            float n_dot_t = v.normal[0] * tangent[0] + v.normal[1] * tangent[1] + v.normal[2] * tangent[2];
+
+            float t_res[3];
+            t_res[0] = tangent[0] - n_dot_t * v.normal[0];
+            t_res[1] = tangent[1] - n_dot_t * v.normal[1];
+            t_res[2] = tangent[2] - n_dot_t * v.normal[2];
+
+            float t_len = std::sqrt(t_res[0] * t_res[0] + t_res[1] * t_res[1] + t_res[2] * t_res[2]);
+            if (t_len < 1e-12f)
+            {
+                // No tangent accumulated (e.g. no texture coordinates), pick any axis orthogonal to N
+                bool useX = std::fabs(v.normal[0]) < 0.9f;
+                t_res[0] = useX ? 1.0f - v.normal[0] * v.normal[0] : -v.normal[1] * v.normal[0];
+                t_res[1] = useX ? -v.normal[0] * v.normal[1] : 1.0f - v.normal[1] * v.normal[1];
+                t_res[2] = useX ? -v.normal[0] * v.normal[2] : -v.normal[1] * v.normal[2];
+                t_len = std::sqrt(t_res[0] * t_res[0] + t_res[1] * t_res[1] + t_res[2] * t_res[2]);
+                if (t_len < 1e-12f)
+                {
+                    t_res[0] = 1.0f;
+                    t_res[1] = 0.0f;
+                    t_res[2] = 0.0f;
+                    t_len = 1.0f;
+                }
+            }
+            v.tangent[0] = t_res[0] / t_len;
+            v.tangent[1] = t_res[1] / t_len;
+            v.tangent[2] = t_res[2] / t_len;
+
+            // Bitangent can be recalculated from N and T, only its handedness
+            // (mirrored UVs) has to come from the accumulated one
+            v.bitangent[0] = v.normal[1] * v.tangent[2] - v.normal[2] * v.tangent[1];
+            v.bitangent[1] = v.normal[2] * v.tangent[0] - v.normal[0] * v.tangent[2];
+            v.bitangent[2] = v.normal[0] * v.tangent[1] - v.normal[1] * v.tangent[0];
+            float b_dot = v.bitangent[0] * bitangent[0] + v.bitangent[1] * bitangent[1] + v.bitangent[2] * bitangent[2];
+            if (b_dot < 0.0f)
+            {
+                v.bitangent[0] = -v.bitangent[0];
+                v.bitangent[1] = -v.bitangent[1];
+                v.bitangent[2] = -v.bitangent[2];
+            }
+        }
+
+        // Adds the UV-space tangent and bitangent of triangles [begin, end) to
+        // their corners in `sums`: six floats (tangent, bitangent) per vertex,
+        // starting at vertex `first`. Four triangles are computed per step.
+        inline void accumulateTangents(const Vertex *vertices, const unsigned int *indices, size_t begin, size_t end, float *sums, size_t first)
+        {
+            auto scatter = [&](size_t triangle, const float *frame)
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    float *sum = sums + (indices[triangle * 3 + k] - first) * 6;
+                    for (int j = 0; j < 6; ++j)
+                        sum[j] += frame[j];
+                }
+            };
+
+            size_t t = begin;
+            for (; t + 4 <= end; t += 4)
+            {
+                // Gather into lanes: edge 1, edge 2 (xyz), then du1, dv1, du2, dv2
+                alignas(16) float in[10][4];
+                for (int i = 0; i < 4; ++i)
+                {
+                    const Vertex &v0 = vertices[indices[(t + i) * 3]];
+                    const Vertex &v1 = vertices[indices[(t + i) * 3 + 1]];
+                    const Vertex &v2 = vertices[indices[(t + i) * 3 + 2]];
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        in[k][i] = v1.position[k] - v0.position[k];
+                        in[3 + k][i] = v2.position[k] - v0.position[k];
+                    }
+                    in[6][i] = v1.texCoord[0] - v0.texCoord[0];
+                    in[7][i] = v1.texCoord[1] - v0.texCoord[1];
+                    in[8][i] = v2.texCoord[0] - v0.texCoord[0];
+                    in[9][i] = v2.texCoord[1] - v0.texCoord[1];
+                }
+
+                using namespace simd;
+                const float4 du1 = load(in[6]), dv1 = load(in[7]), du2 = load(in[8]), dv2 = load(in[9]);
+
+                // Triangles without a usable UV mapping contribute nothing. Welded vertices
+                // are shared, so a single infinite term would poison all their neighbours.
+                const float4 det = du1 * dv2 - du2 * dv1;
+                const mask4 valid = abs(det) >= splat(1e-12f);
+                const float4 f = select(valid, splat(1.0f) / det, splat(0.0f));
+
+                alignas(16) float out[6][4];
+                for (int k = 0; k < 3; ++k)
+                {
+                    const float4 e1 = load(in[k]), e2 = load(in[3 + k]);
+                    store(out[k], f * (dv2 * e1 - dv1 * e2));
+                    store(out[3 + k], f * (du1 * e2 - du2 * e1));
+                }
+
+                const int usable = bits(valid);
+                for (int i = 0; i < 4; ++i)
+                {
+                    if (usable >> i & 1)
+                    {
+                        const float frame[6] = {out[0][i], out[1][i], out[2][i], out[3][i], out[4][i], out[5][i]};
+                        scatter(t + i, frame);
+                    }
+                }
+            }
+
+            for (; t < end; ++t)
+            {
+                const Vertex &v0 = vertices[indices[t * 3]];
+                const Vertex &v1 = vertices[indices[t * 3 + 1]];
+                const Vertex &v2 = vertices[indices[t * 3 + 2]];
+                float du1 = v1.texCoord[0] - v0.texCoord[0], dv1 = v1.texCoord[1] - v0.texCoord[1];
+                float du2 = v2.texCoord[0] - v0.texCoord[0], dv2 = v2.texCoord[1] - v0.texCoord[1];
+                float det = du1 * dv2 - du2 * dv1;
+                if (std::fabs(det) < 1e-12f)
+                    continue;
+                float f = 1.0f / det;
+
+                float frame[6];
+                for (int k = 0; k < 3; ++k)
+                {
+                    float e1 = v1.position[k] - v0.position[k], e2 = v2.position[k] - v0.position[k];
+                    frame[k] = f * (dv2 * e1 - dv1 * e2);
+                    frame[3 + k] = f * (du1 * e2 - du2 * e1);
+                }
+                scatter(t, frame);
+            }
+        }
+
+        // finishTangentFrame for vertices [begin, end), four at a time; `sums` holds
+        // six floats per vertex starting at `begin`
+        inline void finishTangentFrames(Vertex *vertices, size_t begin, size_t end, const float *sums)
+        {
+            size_t v = begin;
+            for (; v + 4 <= end; v += 4)
+            {
+                alignas(16) float in[9][4]; // normal, tangent sum, bitangent sum
+                for (int i = 0; i < 4; ++i)
+                {
+                    const float *sum = sums + (v + i - begin) * 6;
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        in[k][i] = vertices[v + i].normal[k];
+                        in[3 + k][i] = sum[k];
+                        in[6 + k][i] = sum[3 + k];
+                    }
+                }
+
+                using namespace simd;
+                const float4 nx = load(in[0]), ny = load(in[1]), nz = load(in[2]);
+                const float4 ax = load(in[3]), ay = load(in[4]), az = load(in[5]);
+
+                const float4 nDotT = nx * ax + ny * ay + nz * az;
+                float4 tx = ax - nDotT * nx, ty = ay - nDotT * ny, tz = az - nDotT * nz;
+                const float4 length = sqrt(tx * tx + ty * ty + tz * tz);
+                const int degenerate = bits(length < splat(1e-12f));
+                tx = tx / length, ty = ty / length, tz = tz / length;
+
+                float4 bx = ny * tz - nz * ty, by = nz * tx - nx * tz, bz = nx * ty - ny * tx;
+                const mask4 mirrored = bx * load(in[6]) + by * load(in[7]) + bz * load(in[8]) < splat(0.0f);
+                bx = select(mirrored, -bx, bx), by = select(mirrored, -by, by), bz = select(mirrored, -bz, bz);
+
+                alignas(16) float out[6][4];
+                store(out[0], tx), store(out[1], ty), store(out[2], tz);
+                store(out[3], bx), store(out[4], by), store(out[5], bz);
+                for (int i = 0; i < 4; ++i)
+                {
+                    Vertex &vertex = vertices[v + i];
+                    if (degenerate >> i & 1)
+                    {
+                        const float *sum = sums + (v + i - begin) * 6;
+                        finishTangentFrame(vertex, sum, sum + 3);
+                        continue;
+                    }
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        vertex.tangent[k] = out[k][i];
+                        vertex.bitangent[k] = out[3 + k][i];
+                    }
+                }
+            }
+
+            for (; v < end; ++v)
+            {
+                const float *sum = sums + (v - begin) * 6;
+                finishTangentFrame(vertices[v], sum, sum + 3);
+            }
+        }
+    }
+
+    // Fills in tangent and bitangent of every vertex of an indexed triangle mesh
+    // from its positions, normals and texture coordinates, for normal mapping.
+    // Works on any mesh, loaded or generated; normals must already be set.
+    //
+    // Triangles are split into one contiguous chunk per thread. Each thread adds
+    // its triangles into a private buffer spanning only the vertex range its
+    // chunk references, then the buffers are summed per vertex block and the
+    // frames orthogonalized in parallel. Meshes whose vertices are numbered in
+    // first-use order, as the OBJ loader and optimizeVertexFetch() produce,
+    // keep those ranges nearly disjoint, so the buffers add up to little more
+    // than one copy. With one thread every sum is formed in triangle order, as a
+    // plain serial loop would.
+    inline void generateTangents(Vertex *vertices, size_t vertexCount, const unsigned int *indices, size_t indexCount, unsigned int threadCount = 0)
+    {
+        // Below this a chunk is not worth a thread
+        constexpr size_t minChunkTriangles = 16 * 1024;
+        // Accumulation buffers may add up to this many copies of the vertex range
+        constexpr size_t maxBufferCopies = 4;
+        constexpr size_t blockVertices = 16 * 1024;
+
+        if (vertexCount == 0)
+            return;
+        if (threadCount == 0)
+            threadCount = hardwareThreads();
+
+        const size_t triangleCount = indexCount / 3;
+        size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threadCount, triangleCount / minChunkTriangles));
+
+        struct Chunk
+        {
+            size_t begin, end;     // triangles
+            size_t first, last;    // vertex range referenced, inclusive
+            std::vector<float> sums;
+        };
+        std::vector<Chunk> chunks(chunkCount);
+        for (size_t c = 0; c < chunkCount; ++c)
+        {
+            chunks[c].begin = triangleCount * c / chunkCount;
+            chunks[c].end = triangleCount * (c + 1) / chunkCount;
+        }
+
+        parallelFor(chunkCount, threadCount, [&](size_t c)
+                    {
+                        Chunk &chunk = chunks[c];
+                        chunk.first = vertexCount;
+                        chunk.last = 0;
+                        for (size_t i = chunk.begin * 3; i < chunk.end * 3; ++i)
+                        {
+                            chunk.first = std::min<size_t>(chunk.first, indices[i]);
+                            chunk.last = std::max<size_t>(chunk.last, indices[i]);
+                        } });
+
+        // Scattered vertex numbering makes every chunk span most of the mesh; trade
+        // threads for memory by merging neighbouring chunks
+        auto bufferSize = [&]()
+        {
+            size_t total = 0;
+            for (const Chunk &chunk : chunks)
+                total += chunk.begin < chunk.end ? chunk.last - chunk.first + 1 : 0;
+            return total;
+        };
+        while (chunks.size() > 1 && bufferSize() > maxBufferCopies * vertexCount)
+        {
+            std::vector<Chunk> merged((chunks.size() + 1) / 2);
+            for (size_t c = 0; c < merged.size(); ++c)
+            {
+                merged[c] = std::move(chunks[c * 2]);
+                if (c * 2 + 1 < chunks.size())
+                {
+                    const Chunk &next = chunks[c * 2 + 1];
+                    merged[c].end = next.end;
+                    merged[c].first = std::min(merged[c].first, next.first);
+                    merged[c].last = std::max(merged[c].last, next.last);
+                }
+            }
+            chunks = std::move(merged);
+        }
+
+        parallelFor(chunks.size(), threadCount, [&](size_t c)
+                    {
+                        Chunk &chunk = chunks[c];
+                        if (chunk.begin == chunk.end)
+                            return;
+                        chunk.sums.assign((chunk.last - chunk.first + 1) * 6, 0.0f);
+                        detail::accumulateTangents(vertices, indices, chunk.begin, chunk.end, chunk.sums.data(), chunk.first); });
+
+        const size_t blockCount = (vertexCount + blockVertices - 1) / blockVertices;
+        parallelFor(blockCount, threadCount, [&](size_t block)
+                    {
+                        const size_t begin = block * blockVertices;
+                        const size_t end = std::min(vertexCount, begin + blockVertices);
+
+                        // A block inside a single chunk's range needs no reduction
+                        const Chunk *only = nullptr;
+                        size_t overlapping = 0;
+                        for (const Chunk &chunk : chunks)
+                        {
+                            if (!chunk.sums.empty() && chunk.first < end && chunk.last >= begin)
+                            {
+                                only = &chunk;
+                                ++overlapping;
+                            }
+                        }
+                        if (overlapping == 1 && only->first <= begin && only->last + 1 >= end)
+                        {
+                            detail::finishTangentFrames(vertices, begin, end, &only->sums[(begin - only->first) * 6]);
+                            return;
+                        }
+
+                        std::vector<float> sums((end - begin) * 6, 0.0f);
+                        for (const Chunk &chunk : chunks)
+                        {
+                            if (chunk.sums.empty())
+                                continue;
+                            const size_t from = std::max(begin, chunk.first);
+                            const size_t to = std::min(end, chunk.last + 1);
+                            for (size_t v = from; v < to; ++v)
+                            {
+                                const float *source = &chunk.sums[(v - chunk.first) * 6];
+                                float *target = &sums[(v - begin) * 6];
+                                for (int j = 0; j < 6; ++j)
+                                    target[j] += source[j];
+                            }
+                        }
+                        detail::finishTangentFrames(vertices, begin, end, sums.data()); });
+    }
+}
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include <grn/matrix.h>
+#include <grn/quaternion.h>
+#include <grn/simd.h>
+#include <grn/vector.h>
+#include "parallel.h"
+
+namespace grn
+{
+    // Object transforms stored SoA for buildModelMatrices(). Rotations are
+    // either Euler angles in radians, applied like Matrix::getModelMatrix(), or
+    // unit quaternions (x, y, z, w); rotationW is only read for quaternions.
+    struct TransformArray
+    {
+        enum class Rotation
+        {
+            Euler,
+            Quaternion
+        };
+
+        Rotation rotation = Rotation::Euler;
+        std::vector<float> positionX, positionY, positionZ;
+        std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+        std::vector<float> scaleX, scaleY, scaleZ;
+
+        size_t size() const { return positionX.size(); }
+
+        void clear()
+        {
+            for (std::vector<float> *array : arrays())
+                array->clear();
+        }
+
+        void reserve(size_t count)
+        {
+            for (std::vector<float> *array : arrays())
+                array->reserve(count);
+        }
+
+        // Returns the index of the new transform. `rotation` is (x, y, z) Euler
+        // angles, or (x, y, z, w) of a quaternion with `w`.
+        size_t push_back(const Vector &position, const Vector &rotation, const Vector &scale, float w = 0.0f)
+        {
+            positionX.push_back(position.x), positionY.push_back(position.y), positionZ.push_back(position.z);
+            rotationX.push_back(rotation.x), rotationY.push_back(rotation.y), rotationZ.push_back(rotation.z), rotationW.push_back(w);
+            scaleX.push_back(scale.x), scaleY.push_back(scale.y), scaleZ.push_back(scale.z);
+            return positionX.size() - 1;
+        }
+
+        // For Rotation::Quaternion arrays
+        size_t push_back(const Vector &position, const Quaternion &rotation, const Vector &scale)
+        {
+            return push_back(position, Vector(rotation.x, rotation.y, rotation.z), scale, rotation.w);
+        }
+
+    private:
+        std::vector<std::vector<float> *> arrays()
+        {
+            return {&positionX, &positionY, &positionZ, &rotationX, &rotationY, &rotationZ, &rotationW, &scaleX, &scaleY, &scaleZ};
+        }
+    };
+
+    namespace detail
+    {
+        // Writes the four lanes of x, y, z and w as column `column` of four matrices
+        inline void storeColumns(simd::float4 x, simd::float4 y, simd::float4 z, simd::float4 w, Matrix *out, int column)
+        {
+            simd::transpose(x, y, z, w);
+            simd::store(out[0].m_data + column * 4, x);
+            simd::store(out[1].m_data + column * 4, y);
+            simd::store(out[2].m_data + column * 4, z);
+            simd::store(out[3].m_data + column * 4, w);
+        }
+
+#if defined(GRN_SIMD_AVX)
+        inline void storeColumns(simd::float8 x, simd::float8 y, simd::float8 z, simd::float8 w, Matrix *out, int column)
+        {
+            storeColumns(simd::lower(x), simd::lower(y), simd::lower(z), simd::lower(w), out, column);
+            storeColumns(simd::upper(x), simd::upper(y), simd::upper(z), simd::upper(w), out + 4, column);
+        }
+#endif
+
+        // Writes the lanes of x, y and z as column `column` of as many 3x3 matrices
+        template <typename V>
+        inline void storeColumns(V x, V y, V z, Matrix3 *out, int column)
+        {
+            constexpr int width = simd::vector_traits<V>::width;
+            float lanes[3][width];
+            simd::store(lanes[0], x);
+            simd::store(lanes[1], y);
+            simd::store(lanes[2], z);
+            for (int lane = 0; lane < width; ++lane)
+            {
+                for (int row = 0; row < 3; ++row)
+                    out[lane][column * 3 + row] = lanes[row][lane];
+            }
+        }
+
+        // Model (and normal) matrices of the W transforms whose components start at
+        // the given pointers. The normal matrix of R * S is R * S^-1, the inverse
+        // transpose of the model's 3x3 part, because R is orthonormal.
+        template <typename V>
+        inline void buildModelMatrixLanes(TransformArray::Rotation rotation, const float *const (&in)[10], Matrix *models, Matrix3 *normals)
+        {
+            using T = simd::vector_traits<V>;
+            const V one = T::splat(1.0f), zero = T::splat(0.0f);
+            V r[9]; // rotation, column-major 3x3
+            if (rotation == TransformArray::Rotation::Euler)
+            {
+                V sinX, cosX, sinY, cosY, sinZ, cosZ;
+                simd::sincos(T::load(in[3]), sinX, cosX);
+                simd::sincos(T::load(in[4]), sinY, cosY);
+                simd::sincos(T::load(in[5]), sinZ, cosZ);
+                r[0] = cosY * cosZ;
+                r[1] = cosY * sinZ;
+                r[2] = -sinY;
+                r[3] = sinX * sinY * cosZ - cosX * sinZ;
+                r[4] = sinX * sinY * sinZ + cosX * cosZ;
+                r[5] = sinX * cosY;
+                r[6] = cosX * sinY * cosZ + sinX * sinZ;
+                r[7] = cosX * sinY * sinZ - sinX * cosZ;
+                r[8] = cosX * cosY;
+            }
+            else
+            {
+                const V x = T::load(in[3]), y = T::load(in[4]), z = T::load(in[5]), w = T::load(in[6]);
+                const V two = T::splat(2.0f);
+                r[0] = one - two * (y * y + z * z);
+                r[1] = two * (x * y + z * w);
+                r[2] = two * (x * z - y * w);
+                r[3] = two * (x * y - z * w);
+                r[4] = one - two * (x * x + z * z);
+                r[5] = two * (y * z + x * w);
+                r[6] = two * (x * z + y * w);
+                r[7] = two * (y * z - x * w);
+                r[8] = one - two * (x * x + y * y);
+            }
+
+            const V scale[3] = {T::load(in[7]), T::load(in[8]), T::load(in[9])};
+            for (int column = 0; column < 3; ++column)
+            {
+                storeColumns(r[column * 3] * scale[column], r[column * 3 + 1] * scale[column], r[column * 3 + 2] * scale[column], zero, models, column);
+                if (normals)
+                {
+                    const V inverseScale = one / scale[column];
+                    storeColumns(r[column * 3] * inverseScale, r[column * 3 + 1] * inverseScale, r[column * 3 + 2] * inverseScale, normals, column);
+                }
+            }
+            storeColumns(T::load(in[0]), T::load(in[1]), T::load(in[2]), one, models, 3);
+        }
+    }
+
+    // Writes the model matrices of transforms [begin, end) to models[begin, end),
+    // and their normal matrices to normals[begin, end) unless `normals` is null.
+    // The normal matrices are what Matrix::getNormalMatrix() returns for the
+    // model, up to rounding, ready for the shader's mat3 normalMatrix.
+    // Sine and cosine come from simd::sincos(), so Euler results differ from
+    // Matrix::getModelMatrix() by a few ulp; quaternion results match
+    // Quaternion::getModelMatrix() exactly. Works eight (AVX) or four
+    // transforms at a time; a transform's matrices do not depend on the path
+    // that computed them. Zero scales give infinite normal matrices.
+    inline void buildModelMatrices(const TransformArray &transforms, size_t begin, size_t end, Matrix *models, Matrix3 *normals = nullptr)
+    {
+        const std::vector<float> *arrays[10] = {&transforms.positionX, &transforms.positionY, &transforms.positionZ,
+                                                &transforms.rotationX, &transforms.rotationY, &transforms.rotationZ, &transforms.rotationW,
+                                                &transforms.scaleX, &transforms.scaleY, &transforms.scaleZ};
+        auto pointers = [&](size_t i, const float *(&in)[10])
+        {
+            for (int k = 0; k < 10; ++k)
+                in[k] = arrays[k]->data() + i;
+        };
+
+        size_t i = begin;
+#if defined(GRN_SIMD_AVX)
+        for (; i + 8 <= end; i += 8)
+        {
+            const float *in[10];
+            pointers(i, in);
+            detail::buildModelMatrixLanes<simd::float8>(transforms.rotation, in, models + i, normals ? normals + i : nullptr);
+        }
+#endif
+        for (; i + 4 <= end; i += 4)
+        {
+            const float *in[10];
+            pointers(i, in);
+            detail::buildModelMatrixLanes<simd::float4>(transforms.rotation, in, models + i, normals ? normals + i : nullptr);
+        }
+        if (i < end)
+        {
+            // Pad the last few transforms to a full vector by repeating the last one
+            float padded[10][4];
+            const float *in[10];
+            for (int k = 0; k < 10; ++k)
+            {
+                for (size_t lane = 0; lane < 4; ++lane)
+                    padded[k][lane] = (*arrays[k])[std::min(i + lane, end - 1)];
+                in[k] = padded[k];
+            }
+            Matrix paddedModels[4];
+            Matrix3 paddedNormals[4];
+            detail::buildModelMatrixLanes<simd::float4>(transforms.rotation, in, paddedModels, normals ? paddedNormals : nullptr);
+            std::copy(paddedModels, paddedModels + (end - i), models + i);
+            if (normals)
+                std::copy(paddedNormals, paddedNormals + (end - i), normals + i);
+        }
+    }
+
+    // All transforms, in chunks spread over threadCount threads (0 = all)
+    inline void buildModelMatrices(const TransformArray &transforms, Matrix *models, Matrix3 *normals = nullptr, unsigned int threadCount = 1)
+    {
+        constexpr size_t chunkSize = 4096;
+        const size_t count = transforms.size();
+        parallelFor((count + chunkSize - 1) / chunkSize, threadCount, [&](size_t chunk)
+                    { buildModelMatrices(transforms, chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize), models, normals); });
+    }
+}
@@ -1,73 +1,233 @@
 #pragma once
 #include <cmath>
+#include <type_traits>
 
 namespace grn
 {
 
-    struct Vector
+    template <typename T>
+    struct Vec3;
+
+    // Math policy of the templated vector, matrix and quaternion code: libm,
+    // correctly rounded where the standard says so. FastMath (fastmath.h)
+    // trades a few ulp for speed.
+    struct StdMath
+    {
+        template <typename T>
+        static T sqrt(T x) { return std::sqrt(x); }
+        template <typename T>
+        static T rsqrt(T x) { return T(1) / std::sqrt(x); }
+        template <typename T>
+        static void sincos(T x, T &sine, T &cosine) { sine = std::sin(x), cosine = std::cos(x); }
+        // Per component, for the three angles of an Euler rotation
+        template <typename T>
+        static void sincos(const Vec3<T> &x, Vec3<T> &sine, Vec3<T> &cosine)
+        {
+            sincos(x.x, sine.x, cosine.x);
+            sincos(x.y, sine.y, cosine.y);
+            sincos(x.z, sine.z, cosine.z);
+        }
+        template <typename T>
+        static T acos(T x) { return std::acos(x); }
+        template <typename T>
+        static T atan2(T y, T x) { return std::atan2(y, x); }
+    };
+
+    // Small vectors over any arithmetic scalar type. Everything except length()
+    // and normalize(), which take a math policy, is constexpr, and all of them
+    // are trivially copyable, so arrays of them can be memcpy'd and compilers
+    // can vectorize loops over them.
+
+    template <typename T>
+    struct alignas(2 * sizeof(T)) Vec2
     {
-        float x, y, z;
+        T x, y;
+
+        constexpr Vec2(T x = T(0), T y = T(0)) : x(x), y(y) {}
 
-        Vector(float x = 0, float y = 0, float z = 0) : x(x), y(y), z(z) {}
-        Vector(const Vector& other) : x(other.x), y(other.y), z(other.z) {}
+        constexpr Vec2 operator+(const Vec2 &other) const { return Vec2(x + other.x, y + other.y); }
+        constexpr Vec2 operator-(const Vec2 &other) const { return Vec2(x - other.x, y - other.y); }
+        constexpr Vec2 operator-() const { return Vec2(-x, -y); }
+        constexpr Vec2 operator*(T scalar) const { return Vec2(x * scalar, y * scalar); }
+        constexpr Vec2 operator/(T scalar) const { return Vec2(x / scalar, y / scalar); }
 
-        Vector operator+(const Vector& other) const
+        operator const T *() const { return &x; }
+        const T *data() const { return &x; }
+
+        constexpr T dot(const Vec2 &other) const { return x * other.x + y * other.y; }
+        template <typename Math = StdMath>
+        T length() const { return Math::sqrt(dot(*this)); }
+        template <typename Math = StdMath>
+        Vec2 normalize() const
         {
-            return Vector(x + other.x, y + other.y, z + other.z);
+            T squared = dot(*this);
+            if (squared == 0) return Vec2(0, 0);
+            if constexpr (std::is_same<Math, StdMath>::value)
+            {
+                T len = std::sqrt(squared);
+                return Vec2(x / len, y / len);
+            }
+            return *this * Math::rsqrt(squared);
         }
+    };
 
-        Vector operator-(const Vector& other) const
+    // Three tightly packed components: sizeof is 3 * sizeof(T), so arrays of
+    // Vec3 match xyz triples in vertex and file data
+    template <typename T>
+    struct Vec3
+    {
+        T x, y, z;
+
+        constexpr Vec3(T x = T(0), T y = T(0), T z = T(0)) : x(x), y(y), z(z) {}
+
+        constexpr Vec3 operator+(const Vec3 &other) const
         {
-            return Vector(x - other.x, y - other.y, z - other.z);
+            return Vec3(x + other.x, y + other.y, z + other.z);
         }
 
-        Vector operator-() const
+        constexpr Vec3 operator-(const Vec3 &other) const
         {
-            return Vector(-x, -y, -z);
+            return Vec3(x - other.x, y - other.y, z - other.z);
         }
 
-        Vector operator*(float scalar) const
+        constexpr Vec3 operator-() const
         {
-            return Vector(x * scalar, y * scalar, z * scalar);
+            return Vec3(-x, -y, -z);
         }
 
-        Vector operator/(float scalar) const
+        constexpr Vec3 operator*(T scalar) const
         {
-            return Vector(x / scalar, y / scalar, z / scalar);
+            return Vec3(x * scalar, y * scalar, z * scalar);
         }
 
-        operator const float*() const
+        constexpr Vec3 operator/(T scalar) const
+        {
+            return Vec3(x / scalar, y / scalar, z / scalar);
+        }
+
+        constexpr Vec3 &operator+=(const Vec3 &other) { return *this = *this + other; }
+        constexpr Vec3 &operator-=(const Vec3 &other) { return *this = *this - other; }
+        constexpr Vec3 &operator*=(T scalar) { return *this = *this * scalar; }
+
+        operator const T*() const
         {
             return &x;
         }
 
-        const float* data() const
+        const T* data() const
         {
             return &x;
         }
 
-        float dot(const Vector& other) const
+        constexpr T dot(const Vec3& other) const
         {
             return x * other.x + y * other.y + z * other.z;
         }
-        Vector cross(const Vector& other) const
-        {            return Vector(
+        constexpr Vec3 cross(const Vec3& other) const
+        {            return Vec3(
                 y * other.z - z * other.y,
                 z * other.x - x * other.z,
                 x * other.y - y * other.x
             );
         }
-        float length() const
+        template <typename Math = StdMath>
+        T length() const
+        {
+            return Math::sqrt(x * x + y * y + z * z);
+        }
+        // With StdMath this divides by the length; other policies multiply by
+        // Math::rsqrt() of the squared length
+        template <typename Math = StdMath>
+        Vec3 normalize() const
         {
-            return sqrt(x * x + y * y + z * z);
+            T squared = x * x + y * y + z * z;
+            if (squared == 0) return Vec3(0, 0, 0);
+            if constexpr (std::is_same<Math, StdMath>::value)
+            {
+                T len = std::sqrt(squared);
+                return Vec3(x / len, y / len, z / len);
+            }
+            return *this * Math::rsqrt(squared);
         }
-        Vector normalize() const
+
+    };
+
+    // Vec3 padded to four components and aligned like Vec4, so a Vec3A<float>
+    // and each element of an array of them load as one SIMD register. w is
+    // padding: constructors zero it and operations keep it zero.
+    template <typename T>
+    struct alignas(4 * sizeof(T)) Vec3A
+    {
+        T x, y, z, w;
+
+        constexpr Vec3A(T x = T(0), T y = T(0), T z = T(0)) : x(x), y(y), z(z), w(T(0)) {}
+        constexpr explicit Vec3A(const Vec3<T> &v) : x(v.x), y(v.y), z(v.z), w(T(0)) {}
+
+        constexpr Vec3A operator+(const Vec3A &other) const { return Vec3A(x + other.x, y + other.y, z + other.z); }
+        constexpr Vec3A operator-(const Vec3A &other) const { return Vec3A(x - other.x, y - other.y, z - other.z); }
+        constexpr Vec3A operator-() const { return Vec3A(-x, -y, -z); }
+        constexpr Vec3A operator*(T scalar) const { return Vec3A(x * scalar, y * scalar, z * scalar); }
+        constexpr Vec3A operator/(T scalar) const { return Vec3A(x / scalar, y / scalar, z / scalar); }
+
+        constexpr Vec3A &operator+=(const Vec3A &other) { return *this = *this + other; }
+        constexpr Vec3A &operator-=(const Vec3A &other) { return *this = *this - other; }
+        constexpr Vec3A &operator*=(T scalar) { return *this = *this * scalar; }
+
+        operator const T *() const { return &x; }
+        const T *data() const { return &x; }
+
+        constexpr Vec3<T> xyz() const { return Vec3<T>(x, y, z); }
+        constexpr T dot(const Vec3A &other) const { return x * other.x + y * other.y + z * other.z; }
+        constexpr Vec3A cross(const Vec3A &other) const
         {
-            float len = length();
-            if (len == 0) return Vector(0, 0, 0);
-            return Vector(x / len, y / len, z / len);
+            return Vec3A(y * other.z - z * other.y, z * other.x - x * other.z, x * other.y - y * other.x);
         }
+        template <typename Math = StdMath>
+        T length() const { return Math::sqrt(dot(*this)); }
+        template <typename Math = StdMath>
+        Vec3A normalize() const { return Vec3A(xyz().template normalize<Math>()); }
+    };
 
+    template <typename T>
+    struct alignas(4 * sizeof(T)) Vec4
+    {
+        T x, y, z, w;
+
+        constexpr Vec4(T x = T(0), T y = T(0), T z = T(0), T w = T(0)) : x(x), y(y), z(z), w(w) {}
+        constexpr Vec4(const Vec3<T> &xyz, T w) : x(xyz.x), y(xyz.y), z(xyz.z), w(w) {}
+
+        constexpr Vec4 operator+(const Vec4 &other) const { return Vec4(x + other.x, y + other.y, z + other.z, w + other.w); }
+        constexpr Vec4 operator-(const Vec4 &other) const { return Vec4(x - other.x, y - other.y, z - other.z, w - other.w); }
+        constexpr Vec4 operator-() const { return Vec4(-x, -y, -z, -w); }
+        constexpr Vec4 operator*(T scalar) const { return Vec4(x * scalar, y * scalar, z * scalar, w * scalar); }
+        constexpr Vec4 operator/(T scalar) const { return Vec4(x / scalar, y / scalar, z / scalar, w / scalar); }
+
+        operator const T *() const { return &x; }
+        const T *data() const { return &x; }
+
+        constexpr Vec3<T> xyz() const { return Vec3<T>(x, y, z); }
+        constexpr T dot(const Vec4 &other) const { return x * other.x + y * other.y + z * other.z + w * other.w; }
+        template <typename Math = StdMath>
+        T length() const { return Math::sqrt(dot(*this)); }
+        template <typename Math = StdMath>
+        Vec4 normalize() const
+        {
+            T squared = dot(*this);
+            if (squared == 0) return Vec4(0, 0, 0, 0);
+            if constexpr (std::is_same<Math, StdMath>::value)
+            {
+                T len = std::sqrt(squared);
+                return Vec4(x / len, y / len, z / len, w / len);
+            }
+            return *this * Math::rsqrt(squared);
+        }
     };
 
+    using Vector = Vec3<float>;
+    using VectorA = Vec3A<float>;
+
+    static_assert(std::is_trivially_copyable<Vector>::value && sizeof(Vector) == 3 * sizeof(float), "Vector must stay a plain xyz triple");
+    static_assert(std::is_trivially_copyable<Vec4<float>>::value && alignof(Vec4<float>) == 16, "Vec4<float> must fill one SIMD register");
+    static_assert(std::is_trivially_copyable<VectorA>::value && sizeof(VectorA) == 16 && alignof(VectorA) == 16, "VectorA must fill one SIMD register");
+
 } // namespace grn
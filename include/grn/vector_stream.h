@@ -0,0 +1,207 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <vector>
+#include <grn/matrix.h>
+#include <grn/simd.h>
+#include <grn/vector.h>
+#include "vertex.h"
+
+namespace grn
+{
+    // Many vectors as structure of arrays: one array per component, so the
+    // bulk operations below work on eight (AVX) or four (SSE/NEON) vectors per
+    // instruction and stream through memory instead of shuffling xyz triples.
+    struct VectorStream
+    {
+        std::vector<float> x, y, z;
+
+        size_t size() const { return x.size(); }
+        bool empty() const { return x.empty(); }
+
+        void clear()
+        {
+            x.clear(), y.clear(), z.clear();
+        }
+
+        void reserve(size_t count)
+        {
+            x.reserve(count), y.reserve(count), z.reserve(count);
+        }
+
+        void resize(size_t count)
+        {
+            x.resize(count), y.resize(count), z.resize(count);
+        }
+
+        // Returns the index of the new vector
+        size_t push_back(const Vector &vector)
+        {
+            x.push_back(vector.x), y.push_back(vector.y), z.push_back(vector.z);
+            return x.size() - 1;
+        }
+
+        Vector get(size_t index) const
+        {
+            return Vector(x[index], y[index], z[index]);
+        }
+
+        void set(size_t index, const Vector &vector)
+        {
+            x[index] = vector.x, y[index] = vector.y, z[index] = vector.z;
+        }
+    };
+
+    namespace detail
+    {
+        // Calls kernel(V(), i) for every index, with V = float8 (AVX), float4 and
+        // float for the last few; the kernel handles vector_traits<V>::width
+        // elements from i on. All widths must do the same arithmetic.
+        template <typename Kernel>
+        inline void forEachLane(size_t count, Kernel kernel)
+        {
+            size_t i = 0;
+#if defined(GRN_SIMD_AVX)
+            for (; i + 8 <= count; i += 8)
+                kernel(simd::float8(), i);
+#endif
+            for (; i + 4 <= count; i += 4)
+                kernel(simd::float4(), i);
+            for (; i < count; ++i)
+                kernel(0.0f, i);
+        }
+
+        template <typename V>
+        inline void minMaxLanes(const float *p, size_t &i, size_t count, float &low, float &high)
+        {
+            using T = simd::vector_traits<V>;
+            if (i + T::width > count)
+                return;
+            V lowLanes = T::load(p + i), highLanes = lowLanes;
+            for (i += T::width; i + T::width <= count; i += T::width)
+            {
+                const V v = T::load(p + i);
+                lowLanes = simd::min(lowLanes, v);
+                highLanes = simd::max(highLanes, v);
+            }
+            float lows[8], highs[8];
+            simd::store(lows, lowLanes);
+            simd::store(highs, highLanes);
+            for (int lane = 0; lane < T::width; ++lane)
+            {
+                low = std::min(low, lows[lane]);
+                high = std::max(high, highs[lane]);
+            }
+        }
+
+        inline void minMax(const float *p, size_t count, float &low, float &high)
+        {
+            low = std::numeric_limits<float>::infinity();
+            high = -low;
+            size_t i = 0;
+#if defined(GRN_SIMD_AVX)
+            minMaxLanes<simd::float8>(p, i, count, low, high);
+#endif
+            minMaxLanes<simd::float4>(p, i, count, low, high);
+            for (; i < count; ++i)
+            {
+                low = std::min(low, p[i]);
+                high = std::max(high, p[i]);
+            }
+        }
+    }
+
+    // Element-wise operations. Outputs are resized to the inputs' size and may
+    // be the same stream as an input; the inputs must have equal sizes.
+
+    // out = a + b
+    inline void add(const VectorStream &a, const VectorStream &b, VectorStream &out)
+    {
+        out.resize(a.size());
+        detail::forEachLane(a.size(), [&](auto lanes, size_t i)
+                            {
+            using T = simd::vector_traits<decltype(lanes)>;
+            simd::store(out.x.data() + i, T::load(a.x.data() + i) + T::load(b.x.data() + i));
+            simd::store(out.y.data() + i, T::load(a.y.data() + i) + T::load(b.y.data() + i));
+            simd::store(out.z.data() + i, T::load(a.z.data() + i) + T::load(b.z.data() + i)); });
+    }
+
+    // out = a * scale + b, e.g. mulAdd(velocities, dt, positions, positions)
+    inline void mulAdd(const VectorStream &a, float scale, const VectorStream &b, VectorStream &out)
+    {
+        out.resize(a.size());
+        detail::forEachLane(a.size(), [&](auto lanes, size_t i)
+                            {
+            using T = simd::vector_traits<decltype(lanes)>;
+            const auto s = T::splat(scale);
+            simd::store(out.x.data() + i, T::load(a.x.data() + i) * s + T::load(b.x.data() + i));
+            simd::store(out.y.data() + i, T::load(a.y.data() + i) * s + T::load(b.y.data() + i));
+            simd::store(out.z.data() + i, T::load(a.z.data() + i) * s + T::load(b.z.data() + i)); });
+    }
+
+    // out[i] = a[i].dot(b[i]); `out` holds a.size() floats
+    inline void dot(const VectorStream &a, const VectorStream &b, float *out)
+    {
+        detail::forEachLane(a.size(), [&](auto lanes, size_t i)
+                            {
+            using T = simd::vector_traits<decltype(lanes)>;
+            simd::store(out + i, T::load(a.x.data() + i) * T::load(b.x.data() + i) +
+                                     T::load(a.y.data() + i) * T::load(b.y.data() + i) +
+                                     T::load(a.z.data() + i) * T::load(b.z.data() + i)); });
+    }
+
+    // out[i] = a[i].cross(b[i])
+    inline void cross(const VectorStream &a, const VectorStream &b, VectorStream &out)
+    {
+        out.resize(a.size());
+        detail::forEachLane(a.size(), [&](auto lanes, size_t i)
+                            {
+            using T = simd::vector_traits<decltype(lanes)>;
+            const auto ax = T::load(a.x.data() + i), ay = T::load(a.y.data() + i), az = T::load(a.z.data() + i);
+            const auto bx = T::load(b.x.data() + i), by = T::load(b.y.data() + i), bz = T::load(b.z.data() + i);
+            simd::store(out.x.data() + i, ay * bz - az * by);
+            simd::store(out.y.data() + i, az * bx - ax * bz);
+            simd::store(out.z.data() + i, ax * by - ay * bx); });
+    }
+
+    // out[i] = in[i].normalize(): the same square root and divisions, so the
+    // results match Vector::normalize() exactly; zero vectors stay zero
+    inline void normalize(const VectorStream &in, VectorStream &out)
+    {
+        out.resize(in.size());
+        detail::forEachLane(in.size(), [&](auto lanes, size_t i)
+                            {
+            using V = decltype(lanes);
+            using T = simd::vector_traits<V>;
+            using namespace simd;
+            const V x = T::load(in.x.data() + i), y = T::load(in.y.data() + i), z = T::load(in.z.data() + i);
+            const V squared = x * x + y * y + z * z;
+            const auto zero = squared < T::splat(std::numeric_limits<float>::denorm_min());
+            const V len = sqrt(squared);
+            store(out.x.data() + i, select(zero, T::splat(0.0f), x / len));
+            store(out.y.data() + i, select(zero, T::splat(0.0f), y / len));
+            store(out.z.data() + i, select(zero, T::splat(0.0f), z / len)); });
+    }
+
+    // Points through the matrix as Matrix::transformPoint() does
+    inline void transformPoints(const Matrix &matrix, const VectorStream &in, VectorStream &out)
+    {
+        out.resize(in.size());
+        transformPoints(matrix, in.x.data(), in.y.data(), in.z.data(), out.x.data(), out.y.data(), out.z.data(), in.size());
+    }
+
+    // Component-wise minimum and maximum; all zero for an empty stream, like
+    // computeBounds() over vertices
+    inline Bounds computeBounds(const VectorStream &stream)
+    {
+        Bounds bounds = {{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}};
+        if (stream.empty())
+            return bounds;
+        detail::minMax(stream.x.data(), stream.size(), bounds.min[0], bounds.max[0]);
+        detail::minMax(stream.y.data(), stream.size(), bounds.min[1], bounds.max[1]);
+        detail::minMax(stream.z.data(), stream.size(), bounds.min[2], bounds.max[2]);
+        return bounds;
+    }
+}
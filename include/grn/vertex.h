@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace grn
+{
+
+    struct Vertex
+    {
+        float position[3];
+        float normal[3];
+        float texCoord[2];
+        float tangent[3];
+        float bitangent[3];
+    };
+
+    // Axis-aligned bounding box in model space
+    struct Bounds
+    {
+        float min[3];
+        float max[3];
+    };
+
+    struct BoundingSphere
+    {
+        float center[3];
+        float radius;
+    };
+
+    // Ritter's approximate bounding sphere (about 5-20% larger than minimal) of
+    // positions read as three floats at `positionStride` bytes apart
+    inline BoundingSphere computeBoundingSphere(const float *positions, size_t vertexCount, size_t positionStride)
+    {
+        auto position = [&](size_t v)
+        {
+            return reinterpret_cast<const float *>(reinterpret_cast<const char *>(positions) + v * positionStride);
+        };
+        auto distanceSquared = [](const float *a, const float *b)
+        {
+            float dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+            return dx * dx + dy * dy + dz * dz;
+        };
+        auto farthestFrom = [&](const float *from)
+        {
+            size_t farthest = 0;
+            float best = -1.0f;
+            for (size_t v = 0; v < vertexCount; ++v)
+            {
+                float d = distanceSquared(position(v), from);
+                if (d > best)
+                {
+                    best = d;
+                    farthest = v;
+                }
+            }
+            return position(farthest);
+        };
+
+        BoundingSphere sphere = {{0.0f, 0.0f, 0.0f}, 0.0f};
+        if (vertexCount == 0)
+            return sphere;
+
+        // Start from the two points farthest apart along a rough diameter
+        const float *a = farthestFrom(position(0));
+        const float *b = farthestFrom(a);
+        for (int k = 0; k < 3; ++k)
+            sphere.center[k] = (a[k] + b[k]) * 0.5f;
+        sphere.radius = std::sqrt(distanceSquared(a, b)) * 0.5f;
+
+        // Grow just enough to take in every point left outside
+        for (size_t v = 0; v < vertexCount; ++v)
+        {
+            const float *p = position(v);
+            float d = std::sqrt(distanceSquared(p, sphere.center));
+            if (d <= sphere.radius)
+                continue;
+            float grownRadius = (sphere.radius + d) * 0.5f;
+            float shift = (grownRadius - sphere.radius) / d;
+            for (int k = 0; k < 3; ++k)
+                sphere.center[k] += (p[k] - sphere.center[k]) * shift;
+            sphere.radius = grownRadius;
+        }
+        // Absorb rounding so every point tests inside
+        sphere.radius *= 1.0f + 1e-6f;
+        return sphere;
+    }
+
+    enum class VertexFormat : uint32_t
+    {
+        Full = 0,    // Vertex, 56 bytes
+        Compact = 1, // CompactVertex, 20 bytes
+    };
+
+    // Quantized vertex, decoded in shader.vert when GRN_COMPACT_VERTEX is defined:
+    //  - position: unorm16 inside the mesh bounds; w holds the tangent frame
+    //    handedness (0 = -1, 65535 = +1) so the bitangent can be rebuilt from N and T
+    //  - normal, tangent: octahedral encoding in snorm16
+    //  - texCoord: IEEE 754 half floats
+    struct CompactVertex
+    {
+        uint16_t position[4];
+        int16_t normal[2];
+        int16_t tangent[2];
+        uint16_t texCoord[2];
+    };
+
+    static_assert(sizeof(CompactVertex) == 20, "CompactVertex must stay tightly packed");
+
+    inline uint32_t vertexStride(VertexFormat format)
+    {
+        return format == VertexFormat::Compact ? sizeof(CompactVertex) : sizeof(Vertex);
+    }
+
+    // Rounds to nearest even; out of range values become infinity
+    inline uint16_t floatToHalf(float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+
+        const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+        const uint32_t magnitude = bits & 0x7FFFFFFF;
+
+        if (magnitude >= 0x47800000) // >= 65536, infinity or NaN
+            return static_cast<uint16_t>(sign | (magnitude > 0x7F800000 ? 0x7E00 : 0x7C00));
+        if (magnitude < 0x38800000) // below the smallest normal half, 2^-14
+            return static_cast<uint16_t>(sign | std::lrint(std::fabs(value) * 16777216.0f));
+
+        const uint32_t rounded = magnitude + 0x0FFF + ((magnitude >> 13) & 1);
+        return static_cast<uint16_t>(sign | ((rounded - 0x38000000) >> 13));
+    }
+
+    inline int16_t floatToSnorm16(float value)
+    {
+        value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+        return static_cast<int16_t>(std::lrint(value * 32767.0f));
+    }
+
+    // Octahedral unit vector encoding (Cigolle et al. 2014), two snorm16 components
+    inline void encodeOctahedral(const float *direction, int16_t *encoded)
+    {
+        float length = std::fabs(direction[0]) + std::fabs(direction[1]) + std::fabs(direction[2]);
+        float x = length > 0.0f ? direction[0] / length : 0.0f;
+        float y = length > 0.0f ? direction[1] / length : 0.0f;
+        if (direction[2] < 0.0f)
+        {
+            float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = foldedX;
+            y = foldedY;
+        }
+        encoded[0] = floatToSnorm16(x);
+        encoded[1] = floatToSnorm16(y);
+    }
+
+    inline CompactVertex packVertex(const Vertex &vertex, const Bounds &bounds)
+    {
+        CompactVertex packed;
+        for (int i = 0; i < 3; ++i)
+        {
+            float extent = bounds.max[i] - bounds.min[i];
+            float t = extent > 0.0f ? (vertex.position[i] - bounds.min[i]) / extent : 0.0f;
+            t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+            packed.position[i] = static_cast<uint16_t>(std::lrint(t * 65535.0f));
+        }
+
+        // The bitangent is N x T times the handedness; only the sign is kept
+        const float *n = vertex.normal;
+        const float *t = vertex.tangent;
+        float cross[3] = {n[1] * t[2] - n[2] * t[1], n[2] * t[0] - n[0] * t[2], n[0] * t[1] - n[1] * t[0]};
+        float handedness = cross[0] * vertex.bitangent[0] + cross[1] * vertex.bitangent[1] + cross[2] * vertex.bitangent[2];
+        packed.position[3] = handedness < 0.0f ? 0 : 65535;
+
+        encodeOctahedral(vertex.normal, packed.normal);
+        encodeOctahedral(vertex.tangent, packed.tangent);
+        packed.texCoord[0] = floatToHalf(vertex.texCoord[0]);
+        packed.texCoord[1] = floatToHalf(vertex.texCoord[1]);
+        return packed;
+    }
+
+    inline std::vector<CompactVertex> packVertices(const std::vector<Vertex> &vertices, const Bounds &bounds)
+    {
+        std::vector<CompactVertex> packed(vertices.size());
+        for (size_t i = 0; i < vertices.size(); ++i)
+            packed[i] = packVertex(vertices[i], bounds);
+        return packed;
+    }
+
+    enum class IndexFormat : uint32_t
+    {
+        UInt16 = 0, // meshes with at most 65536 vertices
+        UInt32 = 1,
+    };
+
+    inline uint32_t indexStride(IndexFormat format)
+    {
+        return format == IndexFormat::UInt16 ? sizeof(uint16_t) : sizeof(uint32_t);
+    }
+
+    // Narrowest index type that can address every vertex
+    inline IndexFormat chooseIndexFormat(size_t vertexCount)
+    {
+        return vertexCount <= 65536 ? IndexFormat::UInt16 : IndexFormat::UInt32;
+    }
+
+    inline std::vector<uint16_t> packIndices(const std::vector<unsigned int> &indices)
+    {
+        std::vector<uint16_t> packed(indices.size());
+        for (size_t i = 0; i < indices.size(); ++i)
+            packed[i] = static_cast<uint16_t>(indices[i]);
+        return packed;
+    }
+}
@@ -1,9 +1,27 @@
 #version 330 core
+#ifdef GRN_COMPACT_VERTEX
+// grn::CompactVertex, see include/grn/vertex.h
+layout (location = 0) in vec4 aPackedPosition; // unorm16 inside the mesh bounds, w = handedness
+layout (location = 1) in vec2 aPackedNormal;   // octahedral
+layout (location = 2) in vec2 aTexCoords;      // half floats
+layout (location = 3) in vec2 aPackedTangent;  // octahedral
+
+uniform vec3 positionOffset; // bounds min
+uniform vec3 positionScale;  // bounds max - min
+#elif defined(GRN_GLTF_VERTEX)
+// glTF attributes, see grn::ModelAttribute in include/grn/gltf.h. Missing ones
+// read as zero, and quantized ones arrive already normalized by GL.
+layout (location = 0) in vec3 aPosition;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec4 aTangent; // w = handedness
+#else
 layout (location = 0) in vec3 aPosition;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 layout (location = 3) in vec3 aTangent;
 layout (location = 4) in vec3 aBitangent;
+#endif
 
 out VS_OUT
 {
@@ -16,28 +34,64 @@ out VS_OUT
 vs_out;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat3 normalMatrix; // Matrix::getNormalMatrix(model), computed once per object
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
+// Per-frame data, streamed through a grn::StreamBuffer (FrameUniforms in main.cpp)
+layout (std140) uniform Frame
+{
+    mat4 view;
+    mat4 projection;
+    vec3 lightPos;
+    vec3 viewPos;
+};
+
+#ifdef GRN_COMPACT_VERTEX
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-v.z, 0.0);
+    v.xy += mix(vec2(t), vec2(-t), greaterThanEqual(v.xy, vec2(0.0)));
+    return normalize(v);
+}
+#endif
 
 void main()
 {
+#ifdef GRN_COMPACT_VERTEX
+    vec3 position = positionOffset + aPackedPosition.xyz * positionScale;
+    vec3 normal = decodeOctahedral(aPackedNormal);
+    vec3 tangent = decodeOctahedral(aPackedTangent);
+    float handedness = aPackedPosition.w > 0.5 ? 1.0 : -1.0;
+#elif defined(GRN_GLTF_VERTEX)
+    vec3 position = aPosition;
+    vec3 normal = dot(aNormal, aNormal) > 0.0 ? aNormal : vec3(0.0, 0.0, 1.0);
+    // Any tangent orthogonal to the normal when the file has none
+    vec3 tangent = dot(aTangent.xyz, aTangent.xyz) > 0.0 ? aTangent.xyz : cross(normal, abs(normal.x) < 0.9 ? vec3(1.0, 0.0, 0.0) : vec3(0.0, 1.0, 0.0));
+    float handedness = aTangent.w < 0.0 ? -1.0 : 1.0;
+#else
+    vec3 position = aPosition;
+    vec3 normal = aNormal;
+    vec3 tangent = aTangent;
+    float handedness = dot(cross(aNormal, aTangent), aBitangent) < 0.0 ? -1.0 : 1.0;
+#endif
 
-    vs_out.FragPos = vec3(model * vec4(aPosition, 1.0));   
+    vs_out.FragPos = vec3(model * vec4(position, 1.0));   
+#ifdef GRN_GLTF_VERTEX
+    // glTF puts the texture origin top left; images are uploaded flipped
+    vs_out.TexCoords = vec2(aTexCoords.x, 1.0 - aTexCoords.y);
+#else
     vs_out.TexCoords = aTexCoords;
+#endif
     
-    mat3 normalMatrix = transpose(inverse(mat3(model)));
-    vec3 T = normalize(normalMatrix * aTangent);
-    vec3 N = normalize(normalMatrix * aNormal);
+    vec3 T = normalize(normalMatrix * tangent);
+    vec3 N = normalize(normalMatrix * normal);
     T = normalize(T - dot(T, N) * N);
-    vec3 B = cross(N, T);
+    vec3 B = cross(N, T) * handedness;
     
     mat3 TBN = transpose(mat3(T, B, N));    
     vs_out.TangentLightPos = TBN * lightPos;
     vs_out.TangentViewPos  = TBN * viewPos;
     vs_out.TangentFragPos  = TBN * vs_out.FragPos;
 
-    gl_Position = projection * view * model * vec4(aPosition, 1.0);
+    gl_Position = projection * view * model * vec4(position, 1.0);
 }
@@ -3,16 +3,35 @@
 #include <GLFW/glfw3.h>
 #include <grn/window.h>
 #include <grn/shader.h>
+#include <grn/stream_buffer.h>
 #include <grn/logger.h>
 #include <grn/matrix.h>
+#include <grn/culling.h>
+#include <grn/geometry_arena.h>
 #include <grn/mesh.h>
+#include <grn/mesh_loader.h>
 #include <grn/texture.h>
 #include <grn/vector.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <memory>
 #include <thread>
 #include <chrono>
 
 using namespace grn;
 
+// The Frame uniform block of shader.vert, laid out as std140
+struct FrameUniforms
+{
+    float view[16];
+    float projection[16];
+    float lightPos[3];
+    float padding0;
+    float viewPos[3];
+    float padding1;
+};
+
 int main()
 {
 
@@ -20,21 +39,52 @@ int main()
     Window window(2560 / 4, 1600 / 4, "OpenGL Triangle");
     window.makeContextCurrent();
 
-    Mesh mesh = loadFromFileOBJ("res/ball.obj");
+    MeshLoadOptions meshOptions;
+    meshOptions.optimize = true;
+    meshOptions.vertexFormat = VertexFormat::Compact;
+    meshOptions.lodCount = 4;
+    meshOptions.meshlets = true;
+
+    // Meshes are parsed on worker threads and uploaded by the frame loop once ready
+    AsyncMeshLoader meshLoader;
+    meshLoader.request("res/ball.obj", meshOptions);
+    // Every mesh shares the arena's buffers and VAO
+    GeometryArena geometry(meshOptions.vertexFormat);
+    Mesh mesh = {};
+    bool meshReady = false;
+    std::vector<size_t> submeshLods;
+    std::vector<std::unique_ptr<Texture>> materialTextures; // diffuse maps by material, null if none
+    std::vector<IndexRange> visibleRanges;
+    MultiDrawBuffers multiDrawBuffers;
+    size_t submittedTriangles = 0;
+    size_t culledMeshlets = 0;
+    SphereArray objectSpheres;
+    std::vector<uint8_t> objectVisible;
+    size_t culledObjects = 0;
 
     Logger::log("OpenGL resources initialized");
 
     Logger::log("Compiling shaders");
-    Shader shader = Shader::loadFromFile("res/shaders/shader.vert", "res/shaders/shader.frag");
+    std::vector<std::string> shaderDefines;
+    if (meshOptions.vertexFormat == VertexFormat::Compact)
+        shaderDefines.push_back("GRN_COMPACT_VERTEX");
+    Shader shader = Shader::loadFromFile("res/shaders/shader.vert", "res/shaders/shader.frag", shaderDefines, "shader_cache");
 
     // Get uniform locations once and store them
-    GLint viewLoc = glGetUniformLocation(shader.getProgram(), "view");
-    GLint projLoc = glGetUniformLocation(shader.getProgram(), "projection");
     GLint modelLoc = glGetUniformLocation(shader.getProgram(), "model");
+    GLint normalMatrixLoc = glGetUniformLocation(shader.getProgram(), "normalMatrix");
     GLint texLoc = glGetUniformLocation(shader.getProgram(), "diffuseMap");
     GLint normalLoc = glGetUniformLocation(shader.getProgram(), "normalMap");
     GLint colorLoc = glGetUniformLocation(shader.getProgram(), "color");
-    GLint lightPosLoc = glGetUniformLocation(shader.getProgram(), "lightPos");
+    GLint positionOffsetLoc = glGetUniformLocation(shader.getProgram(), "positionOffset");
+    GLint positionScaleLoc = glGetUniformLocation(shader.getProgram(), "positionScale");
+
+    // Camera and light go through a uniform block written straight into a
+    // persistently mapped ring, one region per frame in flight
+    glUniformBlockBinding(shader.getProgram(), glGetUniformBlockIndex(shader.getProgram(), "Frame"), 0);
+    GLint uniformAlignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+    StreamBuffer frameData(GL_UNIFORM_BUFFER, 64 * 1024);
 
     Texture texture;
     texture.loadFromFile("res/rock/diffuse.png");
@@ -114,19 +164,54 @@ int main()
             fps = frames / (currentTime - lastFpsUpdate);
             lastFpsUpdate = currentTime;
             frames = 0;
-            Logger::log("FPS: " + std::to_string(fps));
+            Logger::log("FPS: " + std::to_string(fps) + " - Triangles: " + std::to_string(submittedTriangles) +
+                        " - Culled meshlets: " + std::to_string(culledMeshlets) + " - Culled objects: " + std::to_string(culledObjects) +
+                        " - Stream stalls: " + std::to_string(frameData.stats().stalls));
         }
 
         window.setTitle("OpenGL Triangle - FPS: " + std::to_string(fps) + " - Calulated: " + std::to_string(1.0 / deltaTime) + " - Delta Time: " + std::to_string(deltaTime));
 
+        for (LoadedMesh &loaded : meshLoader.takeFinished())
+        {
+            if (loaded.error)
+            {
+                try
+                {
+                    std::rethrow_exception(loaded.error);
+                }
+                catch (const std::exception &e)
+                {
+                    Logger::error("Failed to load mesh " + loaded.filename + ": " + e.what());
+                }
+                continue;
+            }
+            if (meshReady)
+                removeMesh(geometry, mesh);
+            mesh = uploadMesh(geometry, loaded.data);
+            meshReady = true;
+            submeshLods.assign(mesh.submeshes.size(), 0);
+            materialTextures.clear();
+            for (const Material &material : mesh.materials)
+            {
+                materialTextures.emplace_back();
+                if (!material.diffuseMap.empty() && std::filesystem::exists(material.diffuseMap))
+                {
+                    materialTextures.back() = std::make_unique<Texture>();
+                    materialTextures.back()->loadFromFile(material.diffuseMap);
+                }
+            }
+            Logger::log("Mesh uploaded: " + loaded.filename);
+        }
+
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         rotation.y = toRadians(20.0f * sin(currentTime / 2.0f) - 20.0f);
         rotation.x = toRadians(20.0f * cos(currentTime / 2.0f));
 
+        const float fov = 45.0f;
         Matrix perpective = 
-        Matrix::getPerspectiveMatrix(45.0f, (float)window.getWidth() / (float)window.getHeight(), 0.1f, 100.0f);
+        Matrix::getPerspectiveMatrix(fov, (float)window.getWidth() / (float)window.getHeight(), 0.1f, 100.0f);
         // Matrix::getOrthographicMatrix(
         //     -1.0f, 1.0f, 
         //     -1.0f * (float)window.getHeight() / (float)window.getWidth(), 
@@ -137,11 +222,32 @@ int main()
         Matrix model = Matrix::getModelMatrix(position, rotation, scale);
 
         glUseProgram(shader.getProgram());
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, view);
-        glUniformMatrix4fv(projLoc, 1, GL_FALSE, perpective);
         glUniformMatrix4fv(modelLoc, 1, GL_FALSE, model);
-
-        glUniform3fv(glGetUniformLocation(shader.getProgram(), "viewPos"), 1, -camera.position);
+        glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, Matrix::getNormalMatrix(model));
+
+        frameData.beginFrame();
+        FrameUniforms frameUniforms = {};
+        std::memcpy(frameUniforms.view, view.m_data, sizeof(frameUniforms.view));
+        std::memcpy(frameUniforms.projection, perpective.m_data, sizeof(frameUniforms.projection));
+        frameUniforms.lightPos[0] = frameUniforms.lightPos[1] = frameUniforms.lightPos[2] = 30.0f;
+        Vector viewPos = -camera.position;
+        frameUniforms.viewPos[0] = viewPos.x;
+        frameUniforms.viewPos[1] = viewPos.y;
+        frameUniforms.viewPos[2] = viewPos.z;
+        StreamAllocation frameBlock = frameData.allocate(sizeof(FrameUniforms), size_t(uniformAlignment));
+        std::memcpy(frameBlock.data, &frameUniforms, sizeof(FrameUniforms));
+        frameData.flush();
+        glBindBufferRange(GL_UNIFORM_BUFFER, 0, frameData.buffer(), frameBlock.offset, sizeof(FrameUniforms));
+
+        if (mesh.format == VertexFormat::Compact)
+        {
+            // Dequantization range of the unorm16 positions
+            glUniform3fv(positionOffsetLoc, 1, mesh.bounds.min);
+            glUniform3f(positionScaleLoc,
+                        mesh.bounds.max[0] - mesh.bounds.min[0],
+                        mesh.bounds.max[1] - mesh.bounds.min[1],
+                        mesh.bounds.max[2] - mesh.bounds.min[2]);
+        }
 
         glActiveTexture(GL_TEXTURE0);
         texture.bind();
@@ -156,12 +262,71 @@ int main()
         glUniform1i(glGetUniformLocation(shader.getProgram(), "heightMap"), 2);
 
         glUniform4f(colorLoc, 0.5f, 0.5f, 0.5f, 1.0f);
-        //light Pos
-        glUniform3f(lightPosLoc, 30.0f, 30.0f, 30.0f);
 
-        glBindVertexArray(mesh.VAO);
-        glDrawElements(GL_TRIANGLES, mesh.size, GL_UNSIGNED_INT, 0);
+        // Whole objects are culled in world space against their bounding spheres
+        objectSpheres.clear();
+        if (meshReady)
+            objectSpheres.push_back(transformSphere(model, mesh.sphere));
+        objectVisible.resize(objectSpheres.size());
+        culledObjects = objectSpheres.size() - cullSpheres(Frustum::fromMatrix(perpective * view), objectSpheres, objectVisible.data());
+        submittedTriangles = 0;
+        culledMeshlets = 0;
+
+        if (meshReady && objectVisible[0])
+        {
+            // Level of detail from the mesh's projected size
+            float meshExtent = std::max({mesh.bounds.max[0] - mesh.bounds.min[0],
+                                         mesh.bounds.max[1] - mesh.bounds.min[1],
+                                         mesh.bounds.max[2] - mesh.bounds.min[2]}) *
+                               std::max({scale.x, scale.y, scale.z});
+            float distance = (camera.position - position).length();
+            const float projectionScale = lodProjectionScale(fov, (float)window.getHeight());
+
+            // Cluster culling in model space: no bounds need transforming
+            Matrix modelView = view * model;
+            Matrix viewToModel = modelView.inverse();
+            float cameraInModel[3] = {viewToModel[12], viewToModel[13], viewToModel[14]};
+            Frustum modelFrustum = Frustum::fromMatrix(perpective * modelView);
+
+            // One VAO for all parts; textures only change where the material does
+            glBindVertexArray(mesh.VAO);
+            glActiveTexture(GL_TEXTURE0);
+            const Texture *boundTexture = &texture;
+            for (size_t i = 0; i < mesh.submeshes.size(); ++i)
+            {
+                const Submesh &submesh = mesh.submeshes[i];
+                size_t lod = selectLod(mesh.lods.data() + submesh.firstLod, submesh.lodCount, meshExtent, distance, projectionScale, submeshLods[i]);
+                if (lod != submeshLods[i])
+                {
+                    Logger::debug("Submesh " + std::to_string(i) + " LOD " + std::to_string(submeshLods[i]) + " -> " + std::to_string(lod));
+                    submeshLods[i] = lod;
+                }
+
+                const Texture *diffuse = submesh.material != NoMaterial && materialTextures[submesh.material] ? materialTextures[submesh.material].get() : &texture;
+                if (diffuse != boundTexture)
+                {
+                    diffuse->bind();
+                    boundTexture = diffuse;
+                }
+
+                if (lod == 0 && submesh.meshletCount > 0)
+                {
+                    visibleRanges.clear();
+                    culledMeshlets += cullMeshlets(mesh.meshlets.data() + submesh.firstMeshlet, submesh.meshletCount, modelFrustum,
+                                                   cameraInModel, visibleRanges);
+                    for (const IndexRange &range : visibleRanges)
+                        submittedTriangles += range.indexCount / 3;
+                    drawIndexRanges(mesh, visibleRanges, multiDrawBuffers);
+                }
+                else
+                {
+                    submittedTriangles += mesh.lods[submesh.firstLod + lod].indexCount / 3;
+                    drawLod(mesh, submesh.firstLod + lod);
+                }
+            }
+        }
 
+        frameData.endFrame();
         window.swapBuffers();
         window.pollEvents();
 
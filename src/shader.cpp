@@ -1,12 +1,22 @@
 #include <iostream>
 #include <fstream>
 #include "grn/shader.h"
+#include "grn/shader_cache.h"
 
 namespace grn
 {
 
-    Shader::Shader(const char *vertexShaderSource, const char *fragmentShaderSource)
+    Shader::Shader(const char *vertexShaderSource, const char *fragmentShaderSource, const std::string &cacheDirectory)
     {
+        const bool useCache = !cacheDirectory.empty() && programBinariesSupported();
+        uint64_t cacheKey = 0;
+        if (useCache)
+        {
+            cacheKey = programCacheKey(vertexShaderSource, fragmentShaderSource);
+            m_program = loadCachedProgram(cacheDirectory, cacheKey);
+            if (m_program)
+                return;
+        }
 
         GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
         compileShader(vertexShader, vertexShaderSource);
@@ -17,6 +27,8 @@ namespace grn
         m_program = glCreateProgram();
         glAttachShader(m_program, vertexShader);
         glAttachShader(m_program, fragmentShader);
+        if (useCache)
+            glProgramParameteri(m_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(m_program);
 
         // Check for linking errors
@@ -29,6 +41,10 @@ namespace grn
             std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n"
                       << infoLog << std::endl;
         }
+        else if (useCache)
+        {
+            storeCachedProgram(cacheDirectory, cacheKey, m_program);
+        }
 
         // Clean up shaders as they're linked into the program now
         glDeleteShader(vertexShader);
@@ -0,0 +1,231 @@
+// Checks the Matrix kernels of matrix.h against a double-precision reference
+// and, across builds, against each other.
+//
+//   grn_matrix_test [--write file | --compare file]
+//
+// Every build computes the same products, inverses, affine inverses and
+// point transforms of a fixed set of random matrices. --write stores the
+// result bytes; --compare requires the bytes of this build to be identical
+// to the stored ones. CMake runs the GRN_SIMD_SCALAR build with --write and
+// the SIMD build with --compare, so the two paths must agree bit for bit.
+// Each build also checks its results against doubles within an error bound,
+// and its constant-evaluated (scalar) results against its run-time ones.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+#include <grn/matrix.h>
+
+namespace
+{
+    using namespace grn;
+
+    int failures = 0;
+
+    void fail(const char *what, size_t index, double value)
+    {
+        if (++failures <= 20)
+            std::fprintf(stderr, "FAIL %s at %zu: %g\n", what, index, value);
+    }
+
+    // Uniform in [low, high), from the raw mt19937 output so that every
+    // standard library generates the same inputs
+    struct Random
+    {
+        std::mt19937 rng{20240611};
+
+        float operator()(float low, float high)
+        {
+            return low + (high - low) * (float(rng() >> 8) * 0x1p-24f);
+        }
+    };
+
+    struct DoubleMatrix
+    {
+        double m[16];
+    };
+
+    DoubleMatrix toDouble(const Matrix &matrix)
+    {
+        DoubleMatrix result;
+        for (int i = 0; i < 16; ++i)
+            result.m[i] = matrix[i];
+        return result;
+    }
+
+    DoubleMatrix multiply(const DoubleMatrix &a, const DoubleMatrix &b)
+    {
+        DoubleMatrix result = {};
+        for (int column = 0; column < 4; ++column)
+            for (int row = 0; row < 4; ++row)
+                for (int k = 0; k < 4; ++k)
+                    result.m[column * 4 + row] += a.m[k * 4 + row] * b.m[column * 4 + k];
+        return result;
+    }
+
+    // Largest |a * b - identity| entry
+    double identityError(const Matrix &a, const Matrix &b)
+    {
+        const DoubleMatrix product = multiply(toDouble(a), toDouble(b));
+        double error = 0.0;
+        for (int i = 0; i < 16; ++i)
+            error = std::max(error, std::fabs(product.m[i] - (i % 5 == 0 ? 1.0 : 0.0)));
+        return error;
+    }
+
+    template <typename T>
+    void append(std::vector<unsigned char> &bytes, const T &value)
+    {
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(&value);
+        bytes.insert(bytes.end(), p, p + sizeof(T));
+    }
+
+    // Constant-evaluated results take the scalar code of Mat4; they must
+    // match the same operations at run time
+    constexpr float constantColumns[16] = {2.0f, 0.5f, -1.0f, 0.0f, 0.25f, 3.0f, 0.75f, 0.0f,
+                                           -0.5f, 1.25f, 1.5f, 0.0f, 4.0f, -2.0f, 7.0f, 1.0f};
+    constexpr Matrix constantMatrix(constantColumns);
+    constexpr Matrix constantProduct = constantMatrix * constantMatrix.transpose();
+    constexpr Matrix constantInverse = constantMatrix.inverse();
+    constexpr Matrix constantAffineInverse = constantMatrix.affineInverse();
+    constexpr Vector constantPoint = constantMatrix.transformPoint(Vector(0.3f, -1.7f, 2.9f));
+
+    void checkConstantEvaluation()
+    {
+        const Matrix matrix(constantColumns); // copied at run time
+        const Matrix product = matrix * matrix.transpose(), inverse = matrix.inverse(), affineInverse = matrix.affineInverse();
+        const Vector point = matrix.transformPoint(Vector(0.3f, -1.7f, 2.9f));
+        if (std::memcmp(&product, &constantProduct, sizeof(Matrix)) != 0)
+            fail("constexpr multiply", 0, 0.0);
+        if (std::memcmp(&inverse, &constantInverse, sizeof(Matrix)) != 0)
+            fail("constexpr inverse", 0, 0.0);
+        if (std::memcmp(&affineInverse, &constantAffineInverse, sizeof(Matrix)) != 0)
+            fail("constexpr affineInverse", 0, 0.0);
+        if (std::memcmp(&point, &constantPoint, sizeof(Vector)) != 0)
+            fail("constexpr transformPoint", 0, 0.0);
+    }
+
+    std::vector<unsigned char> run()
+    {
+        constexpr size_t count = 20000;
+        Random random;
+        std::vector<unsigned char> bytes;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            // General matrices kept well conditioned by a dominant diagonal, and
+            // affine ones with positive scales
+            Matrix general, affine;
+            for (int k = 0; k < 16; ++k)
+                general[k] = random(-1.0f, 1.0f) + (k % 5 == 0 ? 4.0f : 0.0f);
+            affine = Matrix::getModelMatrix(Vector(random(-50.0f, 50.0f), random(-50.0f, 50.0f), random(-50.0f, 50.0f)),
+                                            Vector(random(-3.2f, 3.2f), random(-3.2f, 3.2f), random(-3.2f, 3.2f)),
+                                            Vector(random(0.5f, 2.0f), random(0.5f, 2.0f), random(0.5f, 2.0f)));
+
+            const Matrix product = general * affine;
+            const Matrix inverse = general.inverse();
+            const Matrix affineInverse = affine.affineInverse();
+            append(bytes, product);
+            append(bytes, inverse);
+            append(bytes, affineInverse);
+
+            // Products to within a few ulp of the largest term
+            const DoubleMatrix exact = multiply(toDouble(general), toDouble(affine));
+            for (int k = 0; k < 16; ++k)
+            {
+                const double error = std::fabs(product[k] - exact.m[k]);
+                if (error > 1e-5 * (1.0 + std::fabs(exact.m[k])) * 8.0)
+                    fail("multiply", i, error);
+            }
+            double error = identityError(general, inverse);
+            if (error > 1e-5)
+                fail("inverse", i, error);
+            error = identityError(affine, affineInverse);
+            if (error > 1e-4)
+                fail("affineInverse", i, error);
+        }
+
+        // Points through the per-point, AoS and SoA paths, with counts that
+        // leave tails for every vector width
+        const Matrix model = Matrix::getModelMatrix(Vector(1.0f, -2.0f, 3.0f), Vector(0.3f, -1.1f, 2.2f), Vector(1.5f, 0.5f, 2.0f));
+        for (size_t pointCount : {size_t(1), size_t(7), size_t(13), size_t(1000), size_t(4099)})
+        {
+            std::vector<float> packed(pointCount * 3), x(pointCount), y(pointCount), z(pointCount);
+            for (size_t i = 0; i < pointCount; ++i)
+            {
+                x[i] = packed[i * 3] = random(-100.0f, 100.0f);
+                y[i] = packed[i * 3 + 1] = random(-100.0f, 100.0f);
+                z[i] = packed[i * 3 + 2] = random(-100.0f, 100.0f);
+            }
+            std::vector<float> packedOut(pointCount * 3), outX(pointCount), outY(pointCount), outZ(pointCount);
+            transformPoints(model, packed.data(), packedOut.data(), pointCount);
+            transformPoints(model, x.data(), y.data(), z.data(), outX.data(), outY.data(), outZ.data(), pointCount);
+            for (size_t i = 0; i < pointCount; ++i)
+            {
+                const Vector expected = model.transformPoint(Vector(x[i], y[i], z[i]));
+                const Vector soa(outX[i], outY[i], outZ[i]);
+                if (std::memcmp(&expected, &packedOut[i * 3], sizeof(Vector)) != 0)
+                    fail("transformPoints (xyz) vs transformPoint", i, packedOut[i * 3] - expected.x);
+                if (std::memcmp(&expected, &soa, sizeof(Vector)) != 0)
+                    fail("transformPoints (x, y, z) vs transformPoint", i, soa.x - expected.x);
+                append(bytes, expected);
+            }
+        }
+        return bytes;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const std::string mode = argc == 3 ? argv[1] : "";
+    if (argc != 1 && mode != "--write" && mode != "--compare")
+    {
+        std::fprintf(stderr, "usage: %s [--write file | --compare file]\n", argv[0]);
+        return 2;
+    }
+
+    checkConstantEvaluation();
+    const std::vector<unsigned char> bytes = run();
+
+    if (mode == "--write")
+    {
+        std::ofstream file(argv[2], std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+        if (!file)
+        {
+            std::fprintf(stderr, "could not write %s\n", argv[2]);
+            return 2;
+        }
+    }
+    else if (mode == "--compare")
+    {
+        std::ifstream file(argv[2], std::ios::binary);
+        const std::vector<unsigned char> expected((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (expected.size() != bytes.size())
+        {
+            std::fprintf(stderr, "FAIL %s holds %zu bytes, this build produced %zu\n", argv[2], expected.size(), bytes.size());
+            ++failures;
+        }
+        else
+        {
+            const auto mismatch = std::mismatch(bytes.begin(), bytes.end(), expected.begin());
+            if (mismatch.first != bytes.end())
+                fail("result bytes differ from the other build at byte", size_t(mismatch.first - bytes.begin()), 0.0);
+        }
+    }
+
+    if (failures)
+    {
+        std::fprintf(stderr, "%d failures\n", failures);
+        return 1;
+    }
+    std::printf("matrix kernels OK\n");
+    return 0;
+}